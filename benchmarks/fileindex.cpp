@@ -0,0 +1,108 @@
+// Chunk planning with many files and many queries: the previous FileCollectionIndex (linear scan
+// of the bounding boxes of the files) versus the packed R-tree. A collection of square tiles is
+// queried with circular plots the way FileCollection::get_chunk_with_query() does: the bounding
+// box of the plot, the centroid of the plot to name the chunk and the buffered bounding box. The
+// files found by both indexes are checked to be identical.
+//
+// Build from the root of the repository:
+//
+// g++ -O2 -std=c++17 -Isrc/LASRcore benchmarks/fileindex.cpp src/LASRcore/FileCollectionIndex.cpp -o fileindex
+//
+// ./fileindex [nfiles] [nqueries]
+
+#include "FileCollectionIndex.h"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Previous implementation of FileCollectionIndex
+class LegacyFileCollectionIndex
+{
+public:
+  void add(double xmin, double ymin, double xmax, double ymax) { bboxes.push_back({xmin, ymin, xmax, ymax}); }
+
+  std::vector<int> get_overlaps(double xmin, double ymin, double xmax, double ymax) const
+  {
+    std::vector<int> overlaps;
+    for (size_t i = 0; i < bboxes.size(); ++i)
+    {
+      const auto& bbox = bboxes[i];
+      if (xmin <= bbox[2] && xmax >= bbox[0] && ymin <= bbox[3] && ymax >= bbox[1])
+        overlaps.push_back(i);
+    }
+    return overlaps;
+  }
+
+private:
+  std::vector<std::array<double, 4>> bboxes;
+};
+
+struct Query { double x, y, r; };
+
+template<typename Index>
+static uint64_t plan(const Index& index, const std::vector<Query>& queries, double buffer)
+{
+  uint64_t checksum = 0;
+  for (const auto& q : queries)
+  {
+    for (int i : index.get_overlaps(q.x - q.r, q.y - q.r, q.x + q.r, q.y + q.r)) checksum = checksum*31 + i;
+    for (int i : index.get_overlaps(q.x - 1e-8, q.y - 1e-8, q.x + 1e-8, q.y + 1e-8)) checksum = checksum*31 + i;
+    for (int i : index.get_overlaps(q.x - q.r - buffer, q.y - q.r - buffer, q.x + q.r + buffer, q.y + q.r + buffer)) checksum = checksum*31 + i;
+  }
+  return checksum;
+}
+
+int main(int argc, char** argv)
+{
+  size_t nfiles = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+  size_t nqueries = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 100000;
+  double tile = 1000;
+  double buffer = 20;
+  int ncols = (int)std::ceil(std::sqrt((double)nfiles));
+
+  LegacyFileCollectionIndex legacy;
+  FileCollectionIndex rtree;
+  for (size_t i = 0 ; i < nfiles ; i++)
+  {
+    double x = (i % ncols) * tile;
+    double y = (i / ncols) * tile;
+    legacy.add(x, y, x + tile, y + tile);
+    rtree.add(x, y, x + tile, y + tile);
+  }
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> ux(0, ncols * tile);
+  std::uniform_real_distribution<double> uy(0, (nfiles / ncols) * tile);
+  std::vector<Query> queries(nqueries);
+  for (auto& q : queries) q = {ux(gen), uy(gen), 11.28};
+
+  auto t0 = std::chrono::steady_clock::now();
+  rtree.build();
+  double tbuild = elapsed(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  uint64_t check1 = plan(legacy, queries, buffer);
+  double t1 = elapsed(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  uint64_t check2 = plan(rtree, queries, buffer);
+  double t2 = elapsed(t0);
+
+  if (check1 != check2) printf("Results differ\n");
+  printf("%zu files, %zu circular queries\n\n", nfiles, nqueries);
+  printf("%-14s %10s\n", "", "seconds");
+  printf("%-14s %10.3lf\n", "linear scan", t1);
+  printf("%-14s %10.3lf (build %.3lf)\n", "R-tree", t2, tbuild);
+  printf("%-14s %10.1lf\n", "speedup", t1/t2);
+
+  return 0;
+}
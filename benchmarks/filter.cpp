@@ -0,0 +1,119 @@
+// Microbenchmark of the evaluation of the stage filters on the blocks of points of the streaming
+// mode: PointFilter::filter(Point*) called for each point versus the filter compiled against the
+// schema and evaluated on the whole block into a PointMask. The points selected by both paths are
+// checked to be identical.
+//
+// Build from the root of the repository (no R required, GDAL headers only):
+//
+// g++ -O2 -std=c++17 -fopenmp -DNOGDAL -Isrc/LASRcore -Isrc/LASRreaders -Isrc/vendor \
+//   $(gdal-config --cflags) benchmarks/filter.cpp \
+//   src/LASRcore/{PointCloud,GridPartition,Grouper,Grid,Shape,PointFilter,error,print,openmp,BufferArena,MemoryBudget}.cpp \
+//   src/LASRreaders/{PointSchema,Header}.cpp -o filter
+//
+// Add -mavx2 to evaluate 4 points per instruction instead of 2 with SSE2.
+//
+// ./filter [npoints]
+
+#include "PointFilter.h"
+#include "PointBlock.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv)
+{
+  size_t npoints = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 20000000;
+
+  AttributeSchema schema;
+  schema.add_attribute("flags", AttributeType::UINT8);
+  schema.add_attribute("X", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Y", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Z", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Intensity", AttributeType::UINT16);
+  schema.add_attribute("ReturnNumber", AttributeType::UINT8);
+  schema.add_attribute("Classification", AttributeType::UINT8);
+  schema.add_attribute("gpstime", AttributeType::DOUBLE);
+
+  PointBlock block;
+  block.set_schema(&schema);
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> u(0, 100000);
+  AttributeAccessor intensity("Intensity");
+  AttributeAccessor return_number("ReturnNumber");
+  AttributeAccessor classification("Classification");
+  Point p;
+  while (!block.full())
+  {
+    block.next(p);
+    p.zero();
+    p.set_X(u(gen)); p.set_Y(u(gen)); p.set_Z(u(gen) % 4000 - 200);
+    intensity(&p, u(gen) % 1024);
+    return_number(&p, u(gen) % 4 + 1);
+    classification(&p, u(gen) % 10);
+    block.commit();
+  }
+
+  size_t nblocks = std::max<size_t>(npoints / block.size(), 1);
+
+  std::vector<std::vector<std::string>> sets = {
+    {"Classification == 2"},
+    {"Z > 0"},
+    {"Classification %in% 2 9"},
+    {"ReturnNumber == 1", "Classification %out% 7 18"},
+    {"Z %between% 2 30", "Intensity > 100", "Classification != 7"}
+  };
+
+  printf("%zu points, time in seconds\n\n", nblocks * block.size());
+  printf("%-72s %10s %10s %8s\n", "filter", "per point", "mask", "speedup");
+
+  for (const auto& set : sets)
+  {
+    PointFilter filter;
+    for (const auto& condition : set) filter.add_condition(condition);
+
+    size_t kept1 = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t b = 0 ; b < nblocks ; b++)
+    {
+      for (size_t i = 0 ; i < block.size() ; i++)
+      {
+        block.seek(i, p);
+        if (!filter.filter(&p)) kept1++;
+      }
+    }
+    double t1 = elapsed(t0);
+
+    size_t kept2 = 0;
+    PointMask mask;
+    t0 = std::chrono::steady_clock::now();
+    for (size_t b = 0 ; b < nblocks ; b++)
+    {
+      filter.filter(block, mask);
+      for (size_t i = 0 ; i < block.size() ; i++) kept2 += mask.get(i);
+    }
+    double t2 = elapsed(t0);
+
+    // Both paths must select the same points
+    bool same = kept1 == kept2;
+    for (size_t i = 0 ; i < block.size() ; i++)
+    {
+      block.seek(i, p);
+      if (filter.filter(&p) == mask.get(i)) same = false;
+    }
+    if (!same) printf("Results differ\n");
+
+    std::string label;
+    for (const auto& condition : set) label += condition + "; ";
+    printf("%-72s %10.3lf %10.3lf %8.2lf\n", label.c_str(), t1, t2, t1/t2);
+  }
+
+  return 0;
+}
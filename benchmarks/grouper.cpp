@@ -0,0 +1,137 @@
+// Microbenchmark of the grid partition used by the spatial queries, rasterize() and aggregate():
+// the previous implementation (one std::vector<Interval> per cell in an std::unordered_map) versus
+// the compressed sparse row partition built by counting sort. Both are benchmarked on a spatially
+// sorted tile and on the same tile shuffled, for the build and for a window query around each point.
+//
+// Build from the root of the repository:
+//
+// g++ -O2 -std=c++17 -fopenmp -Isrc/LASRcore benchmarks/grouper.cpp \
+//   src/LASRcore/{Grouper,GridPartition,Grid}.cpp -o grouper
+//
+// ./grouper [npoints] [density] [ncpu]
+
+#include "GridPartition.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Previous implementation of GridPartition
+class LegacyGridPartition : public Grid
+{
+public:
+  LegacyGridPartition(double xmin, double ymin, double xmax, double ymax, double res) : Grid(xmin, ymin, xmax, ymax, res), npoints(0) {}
+
+  void insert(double x, double y)
+  {
+    int key = cell_from_xy(x, y);
+    std::vector<Interval32>& ranges = map[key];
+    if (ranges.size() > 0 && ranges.back().end + 1 == npoints)
+      ranges.back().end = npoints;
+    else
+      ranges.push_back({npoints, npoints});
+    npoints++;
+  }
+
+  void query(double xmin, double ymin, double xmax, double ymax, std::vector<Interval>& res) const
+  {
+    std::vector<int> cells;
+    get_cells(xmin, ymin, xmax, ymax, cells);
+    for (int cell : cells)
+    {
+      auto it = map.find(cell);
+      if (it == map.end()) continue;
+      for (const auto& interval : it->second) res.push_back(interval);
+    }
+  }
+
+  uint32_t npoints;
+  std::unordered_map<int, std::vector<Interval32>> map;
+};
+
+template<typename Partition>
+static uint64_t query_all(const Partition& partition, const std::vector<double>& x, const std::vector<double>& y)
+{
+  uint64_t sum = 0;
+  std::vector<Interval> intervals;
+  for (size_t i = 0 ; i < x.size() ; i++)
+  {
+    intervals.clear();
+    partition.query(x[i]-1.5, y[i]-1.5, x[i]+1.5, y[i]+1.5, intervals);
+    for (const auto& interval : intervals) sum += interval.end - interval.start + 1;
+  }
+  return sum;
+}
+
+static void run(const char* name, const std::vector<double>& x, const std::vector<double>& y, double size, double res, int ncpu)
+{
+  size_t npoints = x.size();
+
+  auto t0 = std::chrono::steady_clock::now();
+  LegacyGridPartition legacy(0, 0, size, size, res);
+  for (size_t i = 0 ; i < npoints ; i++) legacy.insert(x[i], y[i]);
+  double t1 = elapsed(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  GridPartition32 csr(0, 0, size, size, res);
+  std::vector<int> cells(npoints);
+  #pragma omp parallel for num_threads(ncpu)
+  for (size_t i = 0 ; i < npoints ; i++) cells[i] = csr.cell_from_xy(x[i], y[i]);
+  csr.build(cells, ncpu);
+  double t2 = elapsed(t0);
+
+  printf("%-10s %-6s %12.3lf %12.3lf %8.2lf\n", name, "build", t1, t2, t1/t2);
+
+  t0 = std::chrono::steady_clock::now();
+  uint64_t check1 = query_all(legacy, x, y);
+  t1 = elapsed(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  uint64_t check2 = query_all(csr, x, y);
+  t2 = elapsed(t0);
+
+  if (check1 != check2) printf("Results differ\n");
+  printf("%-10s %-6s %12.3lf %12.3lf %8.2lf\n", name, "query", t1, t2, t1/t2);
+}
+
+int main(int argc, char** argv)
+{
+  size_t npoints = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 5000000;
+  double density = (argc > 2) ? std::atof(argv[2]) : 20;
+  int ncpu = (argc > 3) ? std::atoi(argv[3]) : 4;
+  double size = std::sqrt(npoints/density);
+  double res = GridPartition::guess_resolution_from_density(density);
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> uxy(0, size);
+  std::vector<double> x(npoints), y(npoints);
+  for (size_t i = 0 ; i < npoints ; i++) { x[i] = uxy(gen); y[i] = uxy(gen); }
+
+  // A sorted tile: points ordered by 10 m cells, like an acquisition or a sort_points() output
+  std::vector<size_t> order(npoints);
+  for (size_t i = 0 ; i < npoints ; i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+  {
+    int ca = (int)(x[a]/10), ra = (int)(y[a]/10);
+    int cb = (int)(x[b]/10), rb = (int)(y[b]/10);
+    return (ra != rb) ? ra < rb : ca < cb;
+  });
+  std::vector<double> xs(npoints), ys(npoints);
+  for (size_t i = 0 ; i < npoints ; i++) { xs[i] = x[order[i]]; ys[i] = y[order[i]]; }
+
+  printf("%zu points, density %.1f pts/m2, cell %.2lf m, %d threads\n\n", npoints, density, res, ncpu);
+  printf("%-10s %-6s %12s %12s %8s\n", "tile", "", "unordered_map", "CSR", "speedup");
+  run("sorted", xs, ys, size, res, ncpu);
+  run("shuffled", x, y, size, res, ncpu);
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+// Read throughput of uncompressed LAS files: points decoded from the LASpoint filled by LASlib
+// versus points decoded in place in the memory mapped file. A LASlib filter that keeps every point
+// forces the LASlib path. A tile of synthetic points is written in the point data formats 1, 3, 6,
+// 7 and 8 then read by chunks of one quarter of the tile with both paths. The records produced
+// by both paths are checked to be identical.
+//
+// Build from the root of the repository:
+//
+// g++ -O2 -std=c++17 -Isrc/LASRreaders -Isrc/LASRcore -Isrc/vendor/LASlib -Isrc/vendor/LASzip \
+//   benchmarks/lasmap.cpp src/LASRreaders/{LASio,Header,PointSchema,MappedFile}.cpp \
+//   src/vendor/LASlib/*.cpp src/vendor/LASzip/*.cpp -o lasmap
+//
+// ./lasmap [npoints] [directory]
+
+#include "LASio.h"
+#include "Header.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void write_tile(const std::string& file, int format, size_t npoints)
+{
+  bool extended = format >= 6;
+  Header header;
+  header.point_data_format = format;
+  header.version_minor = extended ? 4 : 2;
+
+  AttributeSchema& schema = header.schema;
+  schema.add_attribute("flags", AttributeType::UINT8);
+  schema.add_attribute("X", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Y", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Z", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Intensity", AttributeType::UINT16);
+  schema.add_attribute("Classification", AttributeType::UINT8);
+  schema.add_attribute("gpstime", AttributeType::DOUBLE);
+  if (format == 3 || format >= 7) { schema.add_attribute("R", AttributeType::UINT16); schema.add_attribute("G", AttributeType::UINT16); schema.add_attribute("B", AttributeType::UINT16); }
+  if (format == 8) schema.add_attribute("NIR", AttributeType::UINT16);
+  schema.add_attribute("Amplitude", AttributeType::INT16, 0.1, 0, "Echo amplitude");
+  schema.add_attribute("Withheld", AttributeType::BIT);
+
+  LASio io;
+  io.init(&header);
+  io.create(file);
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> u(0, 100000);
+  Point p(&schema);
+  for (size_t i = 0 ; i < npoints ; i++)
+  {
+    p.zero();
+    p.set_X(u(gen)); p.set_Y(u(gen)); p.set_Z(u(gen) % 5000);
+    for (int j = 4 ; j < schema.num_attributes() ; j++)
+    {
+      AttributeAccessor accessor(schema.attributes[j].name);
+      accessor(&p, (schema.attributes[j].type == BIT) ? u(gen) & 1 : u(gen) % 32);
+    }
+    io.write_point(&p);
+  }
+  io.close();
+}
+
+// Reads the bottom left quarter of the tile like a chunk of a collection
+static double read_tile(const std::string& file, bool laslib, uint64_t* checksum = nullptr)
+{
+  auto t0 = std::chrono::steady_clock::now();
+
+  std::vector<std::string> filters;
+  if (laslib) filters.push_back("-keep_every_nth 1");
+
+  LASio io;
+  io.query({file}, {}, 0, 0, 500, 500, 0, false, filters);
+  Header header;
+  io.populate_header(&header);
+
+  Point p(&header.schema);
+  while (io.read_point(&p))
+  {
+    if (checksum == nullptr) continue;
+    for (size_t i = 0 ; i < header.schema.total_point_size ; i++) *checksum = *checksum*31 + p.data[i];
+  }
+
+  io.close();
+  return elapsed(t0);
+}
+
+int main(int argc, char** argv)
+{
+  size_t npoints = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 5000000;
+  std::string dir = (argc > 2) ? argv[2] : ".";
+
+  printf("%zu points, throughput in million points/s\n\n", npoints);
+  printf("%-8s %12s %12s %8s\n", "format", "LASlib", "mapped", "speedup");
+
+  for (int format : {1, 3, 6, 7, 8})
+  {
+    std::string file = dir + "/lasmap_" + std::to_string(format) + ".las";
+    write_tile(file, format, npoints);
+
+    uint64_t check1 = 0;
+    uint64_t check2 = 0;
+    read_tile(file, false, &check1);
+    read_tile(file, true, &check2);
+    double t1 = read_tile(file, false);
+    double t2 = read_tile(file, true);
+
+    if (check1 != check2) printf("Results differ\n");
+    printf("%-8d %12.2lf %12.2lf %8.2lf\n", format, npoints/t2/1e6, npoints/t1/1e6, t2/t1);
+    std::remove(file.c_str());
+  }
+
+  return 0;
+}
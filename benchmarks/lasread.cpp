@@ -0,0 +1,218 @@
+// Read throughput of LASio: the previous per-field AttributeAccessor decoder versus the decoder
+// compiled once per point data format and schema. A tile of synthetic points with one extra byte
+// attribute is written in the point data formats 1, 3, 6, 7 and 8, in LAS and in LAZ, then read
+// with both decoders. The records produced by both decoders are checked to be identical.
+//
+// Build from the root of the repository:
+//
+// g++ -O2 -std=c++17 -Isrc/LASRreaders -Isrc/LASRcore -Isrc/vendor/LASlib -Isrc/vendor/LASzip \
+//   benchmarks/lasread.cpp src/LASRreaders/{LASio,Header,PointSchema}.cpp \
+//   src/vendor/LASlib/*.cpp src/vendor/LASzip/*.cpp -o lasread
+//
+// ./lasread [npoints] [directory]
+
+#include "LASio.h"
+#include "Header.h"
+
+#include "lasreader.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Previous implementation of LASio::read_point()
+class LegacyDecoder
+{
+public:
+  LegacyDecoder(const std::string& file)
+  {
+    opener.add_file_name(file.c_str());
+    reader = opener.open();
+    for (int i = 0 ; i < reader->header.number_attributes ; i++)
+      extrabytes.push_back(AttributeAccessor(reader->header.attributes[i].name));
+  }
+
+  ~LegacyDecoder() { reader->close(); delete reader; }
+
+  bool read_point(Point* p)
+  {
+    if (!reader->read_point()) return false;
+
+    p->zero();
+    p->set_X(reader->point.get_X());
+    p->set_Y(reader->point.get_Y());
+    p->set_Z(reader->point.get_Z());
+    intensity(p, reader->point.get_intensity());
+    returnnumber(p, reader->point.get_return_number());
+    numberofreturns(p, reader->point.get_number_of_returns());
+    classification(p, reader->point.get_classification());
+    userdata(p, reader->point.get_user_data());
+    psid(p, reader->point.get_point_source_ID());
+    scanangle(p, reader->point.get_scan_angle());
+    gpstime(p, reader->point.get_gps_time());
+    scannerchannel(p, reader->point.get_extended_scanner_channel());
+    red(p, reader->point.get_R());
+    green(p, reader->point.get_G());
+    blue(p, reader->point.get_B());
+    nir(p, reader->point.get_NIR());
+    for (int i = 0 ; i < reader->header.number_attributes ; i++)
+      extrabytes[i](p, reader->point.get_attribute_as_float(i));
+    eof_bit(p, reader->point.get_edge_of_flight_line());
+    scandirection_bit(p, reader->point.get_scan_direction_flag());
+    withheld_bit(p, reader->point.get_withheld_flag());
+    synthetic_bit(p, reader->point.get_synthetic_flag());
+    keypoint_bit(p, reader->point.get_keypoint_flag());
+    overlap_bit(p, reader->point.get_extended_overlap_flag());
+    return true;
+  }
+
+private:
+  LASreadOpener opener;
+  LASreader* reader;
+  AttributeAccessor intensity = AttributeAccessor("Intensity");
+  AttributeAccessor returnnumber = AttributeAccessor("ReturnNumber");
+  AttributeAccessor numberofreturns = AttributeAccessor("NumberOfReturns");
+  AttributeAccessor userdata = AttributeAccessor("UserData");
+  AttributeAccessor classification = AttributeAccessor("Classification");
+  AttributeAccessor psid = AttributeAccessor("PointSourceID");
+  AttributeAccessor scanangle = AttributeAccessor("ScanAngle");
+  AttributeAccessor gpstime = AttributeAccessor("gpstime");
+  AttributeAccessor scannerchannel = AttributeAccessor("ScannerChannel");
+  AttributeAccessor red = AttributeAccessor("R");
+  AttributeAccessor green = AttributeAccessor("G");
+  AttributeAccessor blue = AttributeAccessor("B");
+  AttributeAccessor nir = AttributeAccessor("NIR");
+  AttributeAccessor eof_bit = AttributeAccessor("EdgeOfFlightline");
+  AttributeAccessor scandirection_bit = AttributeAccessor("ScanDirectionFlag");
+  AttributeAccessor withheld_bit = AttributeAccessor("Withheld");
+  AttributeAccessor synthetic_bit = AttributeAccessor("Synthetic");
+  AttributeAccessor keypoint_bit = AttributeAccessor("Keypoint");
+  AttributeAccessor overlap_bit = AttributeAccessor("Overlap");
+  std::vector<AttributeAccessor> extrabytes;
+};
+
+static void write_tile(const std::string& file, int format, size_t npoints)
+{
+  bool extended = format >= 6;
+  Header header;
+  header.point_data_format = format;
+  header.version_minor = extended ? 4 : 2;
+  header.file_creation_year = 2024;
+  header.file_creation_day = 1;
+  header.adjusted_standard_gps_time = true;
+
+  AttributeSchema& schema = header.schema;
+  schema.add_attribute("flags", AttributeType::UINT8);
+  schema.add_attribute("X", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Y", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Z", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Intensity", AttributeType::UINT16);
+  schema.add_attribute("ReturnNumber", AttributeType::UINT8);
+  schema.add_attribute("NumberOfReturns", AttributeType::UINT8);
+  schema.add_attribute("Classification", AttributeType::UINT8);
+  schema.add_attribute("UserData", AttributeType::UINT8);
+  schema.add_attribute("PointSourceID", AttributeType::INT16);
+  schema.add_attribute("ScanAngle", extended ? AttributeType::FLOAT : AttributeType::INT8);
+  if (extended) schema.add_attribute("ScannerChannel", AttributeType::UINT8);
+  schema.add_attribute("gpstime", AttributeType::DOUBLE);
+  if (format == 3 || format >= 7) { schema.add_attribute("R", AttributeType::UINT16); schema.add_attribute("G", AttributeType::UINT16); schema.add_attribute("B", AttributeType::UINT16); }
+  if (format == 8) schema.add_attribute("NIR", AttributeType::UINT16);
+  schema.add_attribute("Amplitude", AttributeType::INT16, 0.1, 0, "Echo amplitude");
+  schema.add_attribute("EdgeOfFlightline", AttributeType::BIT);
+  schema.add_attribute("ScanDirectionFlag", AttributeType::BIT);
+  schema.add_attribute("Synthetic", AttributeType::BIT);
+  schema.add_attribute("Keypoint", AttributeType::BIT);
+  schema.add_attribute("Withheld", AttributeType::BIT);
+  if (extended) schema.add_attribute("Overlap", AttributeType::BIT);
+
+  LASio io;
+  io.init(&header);
+  io.create(file);
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> u(0, 100000);
+  Point p(&schema);
+  for (size_t i = 0 ; i < npoints ; i++)
+  {
+    p.zero();
+    p.set_X(u(gen)); p.set_Y(u(gen)); p.set_Z(u(gen) % 5000);
+    for (int j = 4 ; j < schema.num_attributes() ; j++)
+    {
+      AttributeAccessor accessor(schema.attributes[j].name);
+      int v = u(gen);
+      switch (schema.attributes[j].type)
+      {
+        case BIT: accessor(&p, v & 1); break;
+        case UINT8: accessor(&p, (j == 5 || j == 6) ? 1 + v % 5 : v % 32); break;
+        case INT8: accessor(&p, v % 90 - 45); break;
+        case FLOAT: accessor(&p, (v % 15000) * 0.006 - 45); break;
+        case DOUBLE: accessor(&p, i * 1e-5); break;
+        case INT16: accessor(&p, schema.attributes[j].scale_factor * (v % 30000)); break;
+        default: accessor(&p, v % 65535); break;
+      }
+    }
+    io.write_point(&p);
+  }
+  io.close();
+}
+
+// Reads a tile with LASio or with the legacy decoder. The checksum of the records is optional so
+// it does not count in the timings.
+static double read_tile(const std::string& file, bool legacy, uint64_t* checksum = nullptr)
+{
+  LASio io;
+  io.open(file);
+  Header header;
+  io.populate_header(&header);
+  LegacyDecoder* decoder = (legacy) ? new LegacyDecoder(file) : nullptr;
+
+  Point p(&header.schema);
+  auto t0 = std::chrono::steady_clock::now();
+  while ((legacy) ? decoder->read_point(&p) : io.read_point(&p))
+  {
+    if (checksum == nullptr) continue;
+    for (size_t i = 0 ; i < header.schema.total_point_size ; i++) *checksum = *checksum*31 + p.data[i];
+  }
+  double t = elapsed(t0);
+
+  delete decoder;
+  io.close();
+  return t;
+}
+
+int main(int argc, char** argv)
+{
+  size_t npoints = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+  std::string dir = (argc > 2) ? argv[2] : ".";
+
+  printf("%zu points, throughput in million points/s\n\n", npoints);
+  printf("%-8s %-6s %12s %12s %8s\n", "format", "file", "accessors", "compiled", "speedup");
+
+  for (int format : {1, 3, 6, 7, 8})
+  {
+    for (const char* ext : {"las", "laz"})
+    {
+      std::string file = dir + "/lasread_" + std::to_string(format) + "." + ext;
+      write_tile(file, format, npoints);
+
+      uint64_t check1 = 0;
+      uint64_t check2 = 0;
+      read_tile(file, false, &check1);
+      read_tile(file, true, &check2);
+      double t1 = read_tile(file, false);
+      double t2 = read_tile(file, true);
+
+      if (check1 != check2) printf("Results differ\n");
+      printf("%-8d %-6s %12.2lf %12.2lf %8.2lf\n", format, ext, npoints/t2/1e6, npoints/t1/1e6, t2/t1);
+      std::remove(file.c_str());
+    }
+  }
+
+  return 0;
+}
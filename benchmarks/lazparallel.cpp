@@ -0,0 +1,171 @@
+// Read throughput of LAZ files decompressed chunk by chunk by several threads like reader_las()
+// does in memory mode. A tile of synthetic points is written in the point data formats 1 and 7
+// then read entirely and by a quarter of the tile, sequentially with LASlib and in parallel with
+// one reader per thread that seeks to the first point of each chunk. The records are appended in
+// the order of the chunks and are checked to be identical to the sequential read.
+//
+// Build from the root of the repository:
+//
+// g++ -O2 -std=c++17 -fopenmp -Isrc/LASRreaders -Isrc/LASRcore -Isrc/vendor/LASlib -Isrc/vendor/LASzip \
+//   benchmarks/lazparallel.cpp src/LASRreaders/{LASio,Header,PointSchema,MappedFile}.cpp \
+//   src/vendor/LASlib/*.cpp src/vendor/LASzip/*.cpp -o lazparallel
+//
+// ./lazparallel [npoints] [directory]
+
+#include "LASio.h"
+#include "Header.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void write_tile(const std::string& file, int format, size_t npoints)
+{
+  bool extended = format >= 6;
+  Header header;
+  header.point_data_format = format;
+  header.version_minor = extended ? 4 : 2;
+
+  AttributeSchema& schema = header.schema;
+  schema.add_attribute("flags", AttributeType::UINT8);
+  schema.add_attribute("X", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Y", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Z", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Intensity", AttributeType::UINT16);
+  schema.add_attribute("Classification", AttributeType::UINT8);
+  schema.add_attribute("gpstime", AttributeType::DOUBLE);
+  if (format == 3 || format >= 7) { schema.add_attribute("R", AttributeType::UINT16); schema.add_attribute("G", AttributeType::UINT16); schema.add_attribute("B", AttributeType::UINT16); }
+
+  LASio io;
+  io.init(&header);
+  io.create(file);
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> u(0, 100000);
+  Point p(&schema);
+  for (size_t i = 0 ; i < npoints ; i++)
+  {
+    p.zero();
+    p.set_X(u(gen)); p.set_Y(u(gen)); p.set_Z(u(gen) % 5000);
+    for (int j = 4 ; j < schema.num_attributes() ; j++)
+    {
+      AttributeAccessor accessor(schema.attributes[j].name);
+      accessor(&p, u(gen) % 32);
+    }
+    io.write_point(&p);
+  }
+  io.close();
+}
+
+static uint64_t checksum(uint64_t sum, const unsigned char* data, size_t size)
+{
+  for (size_t i = 0 ; i < size ; i++) sum = sum*31 + data[i];
+  return sum;
+}
+
+static double read_sequential(const std::string& file, double xmax, uint64_t& sum)
+{
+  auto t0 = std::chrono::steady_clock::now();
+
+  LASio io;
+  io.query({file}, {}, 0, 0, xmax, xmax, 0, false, {});
+  Header header;
+  io.populate_header(&header);
+
+  Point p(&header.schema);
+  while (io.read_point(&p)) sum = checksum(sum, p.data, header.schema.total_point_size);
+
+  io.close();
+  return elapsed(t0);
+}
+
+static double read_parallel(const std::string& file, double xmax, int ncpu, uint64_t& sum)
+{
+  auto t0 = std::chrono::steady_clock::now();
+
+  LASio io;
+  io.query({file}, {}, 0, 0, xmax, xmax, 0, false, {});
+  Header header;
+  io.populate_header(&header);
+
+  int64_t chunk_size = io.get_laz_chunk_size();
+  int64_t npoints = io.get_npoints();
+  int64_t nchunks = (npoints + chunk_size - 1) / chunk_size;
+  size_t size = header.schema.total_point_size;
+  double r = xmax + 1e-9;
+
+  #pragma omp parallel num_threads(ncpu)
+  {
+    LASio reader;
+    reader.open(file);
+    std::vector<unsigned char> records;
+
+    #pragma omp for ordered schedule(static, 1)
+    for (int64_t i = 0 ; i < nchunks ; i++)
+    {
+      int64_t count = std::min(chunk_size, npoints - i * chunk_size);
+      int64_t n = 0;
+      records.assign(count * size, 0);
+      Point q(records.data(), &header.schema);
+      reader.seek(i * chunk_size);
+
+      for (int64_t k = 0 ; k < count ; k++)
+      {
+        q.data = records.data() + n * size;
+        if (!reader.read_point(&q)) break;
+        double x = q.get_x();
+        double y = q.get_y();
+        if (x < -1e-9 || x >= r || y < -1e-9 || y >= r) continue;
+        n++;
+      }
+
+      #pragma omp ordered
+      sum = checksum(sum, records.data(), n * size);
+    }
+  }
+
+  io.close();
+  return elapsed(t0);
+}
+
+int main(int argc, char** argv)
+{
+  size_t npoints = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 5000000;
+  std::string dir = (argc > 2) ? argv[2] : ".";
+
+  printf("%zu points, throughput in million points/s\n\n", npoints);
+  printf("%-8s %-8s %12s %8s %8s %8s %8s\n", "format", "query", "sequential", "1 core", "2 cores", "4 cores", "8 cores");
+
+  for (int format : {1, 7})
+  {
+    std::string file = dir + "/lazparallel_" + std::to_string(format) + ".laz";
+    write_tile(file, format, npoints);
+
+    for (double xmax : {1000.0, 500.0})
+    {
+      uint64_t ref = 0;
+      double t0 = read_sequential(file, xmax, ref);
+      printf("%-8d %-8s %12.2lf", format, (xmax == 1000) ? "tile" : "quarter", npoints/t0/1e6);
+
+      for (int ncpu : {1, 2, 4, 8})
+      {
+        uint64_t sum = 0;
+        double t = read_parallel(file, xmax, ncpu, sum);
+        if (sum != ref) printf("\nResults differ with %d cores\n", ncpu);
+        printf(" %8.2lf", npoints/t/1e6);
+      }
+      printf("\n");
+    }
+
+    std::remove(file.c_str());
+  }
+
+  return 0;
+}
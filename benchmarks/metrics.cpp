@@ -0,0 +1,128 @@
+// Microbenchmark of the metrics of rasterize(), summary() and neighborhood_metrics(): each metric
+// evaluated independently with MetricManager::get_metric() versus all the metrics evaluated at once
+// with MetricManager::compute(). Streamable metrics are also accumulated point by point in the
+// state of their cell like in a streamed pipeline. A tile of random points is split into cells
+// like rasterize(20, ...) and the metrics are computed for each cell. The values produced by all
+// the paths are checked to be identical.
+//
+// Build from the root of the repository:
+//
+// g++ -O2 -std=c++17 -Isrc/LASRreaders -Isrc/LASRcore benchmarks/metrics.cpp \
+//   src/LASRcore/{Metrics,error}.cpp src/LASRreaders/PointSchema.cpp -o metrics
+//
+// ./metrics [npoints] [points per cell]
+
+#include "Metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv)
+{
+  size_t npoints = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 5000000;
+  size_t ncell = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 400;
+
+  AttributeSchema schema;
+  schema.add_attribute("flags", AttributeType::UINT8);
+  schema.add_attribute("X", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Y", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Z", AttributeType::INT32, 0.01, 0);
+  schema.add_attribute("Intensity", AttributeType::UINT16);
+  schema.add_attribute("Classification", AttributeType::UINT8);
+
+  std::vector<unsigned char> buffer(npoints * schema.total_point_size);
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> z(0, 4000);
+  std::uniform_int_distribution<int> u(0, 255);
+  AttributeAccessor intensity("Intensity");
+  AttributeAccessor classification("Classification");
+  for (size_t i = 0 ; i < npoints ; i++)
+  {
+    Point p(buffer.data() + i * schema.total_point_size, &schema);
+    p.set_Z(z(gen));
+    intensity(&p, u(gen));
+    classification(&p, u(gen) % 8);
+  }
+
+  std::vector<size_t> indexes(npoints);
+  for (size_t i = 0 ; i < npoints ; i++) indexes[i] = i;
+  Point origin(buffer.data(), &schema);
+  origin.record_size = schema.total_point_size;
+
+  std::vector<std::vector<std::string>> sets = {
+    {"z_max", "z_mean", "z_median", "z_p95", "z_sd", "i_mean"},
+    {"z_p10", "z_p25", "z_p50", "z_p75", "z_p90", "z_p95", "z_p99"},
+    {"z_mean", "z_sd", "z_cv", "z_skew", "z_kurt", "z_above2", "c_mode", "count"},
+    {"z_max", "z_mean", "z_sd", "z_cv", "z_skew", "z_kurt", "z_above2", "i_mean", "i_sum", "count"}
+  };
+
+  printf("%zu points, %zu points per cell, time in seconds\n\n", npoints, ncell);
+  printf("%-72s %10s %10s %10s %8s\n", "metrics", "one by one", "fused", "streamed", "speedup");
+
+  for (const auto& names : sets)
+  {
+    MetricManager metrics;
+    metrics.parse(names, false);
+
+    std::vector<float> ref(npoints / ncell * names.size());
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t c = 0, k = 0 ; c + ncell <= npoints ; c += ncell)
+    {
+      PointSpan span(origin, indexes.data() + c, ncell);
+      for (int i = 0 ; i < metrics.size() ; i++) ref[k++] = metrics.get_metric(i, span);
+    }
+    double t1 = elapsed(t0);
+
+    std::vector<float> res(ref.size());
+    std::vector<float> values;
+    t0 = std::chrono::steady_clock::now();
+    for (size_t c = 0, k = 0 ; c + ncell <= npoints ; c += ncell)
+    {
+      PointSpan span(origin, indexes.data() + c, ncell);
+      metrics.compute(span, values);
+      for (float v : values) res[k++] = v;
+    }
+    double t2 = elapsed(t0);
+
+    if (memcmp(ref.data(), res.data(), ref.size() * sizeof(float)) != 0) printf("Results differ\n");
+
+    // Streamable metrics: one state per cell updated point by point
+    double t3 = 0;
+    MetricManager streamed;
+    streamed.parse(names, true);
+    if (streamed.is_streamable())
+    {
+      size_t size = streamed.get_state_size();
+      std::vector<double> states(npoints / ncell * size);
+      t0 = std::chrono::steady_clock::now();
+      for (size_t c = 0, k = 0 ; c + ncell <= npoints ; c += ncell, k++)
+      {
+        double* state = &states[k * size];
+        streamed.init_state(state);
+        for (size_t i = c ; i < c + ncell ; i++)
+        {
+          Point p(buffer.data() + i * schema.total_point_size, &schema);
+          streamed.accumulate(state, &p);
+        }
+      }
+      for (size_t k = 0 ; k < states.size() / size ; k++) streamed.finalize(&states[k * size], &res[k * names.size()]);
+      t3 = elapsed(t0);
+
+      if (memcmp(ref.data(), res.data(), ref.size() * sizeof(float)) != 0) printf("Streamed results differ\n");
+    }
+
+    std::string label;
+    for (const auto& name : names) label += name + " ";
+    printf("%-72s %10.3lf %10.3lf %10.3lf %8.2lf\n", label.c_str(), t1, t2, t3, t1/t2);
+  }
+
+  return 0;
+}
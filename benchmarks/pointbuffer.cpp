@@ -0,0 +1,73 @@
+// Allocation of the buffer of a PointCloud for consecutive chunks: the previous strategy (a
+// buffer of 100000 points grown by doubling with realloc() and freed after each chunk) versus a
+// buffer allocated once from the number of points in the header with the BufferArena, that
+// recycles the buffer of the previous chunk.
+//
+// Build from the root of the repository:
+//
+// g++ -O2 -std=c++17 -Isrc/LASRcore benchmarks/pointbuffer.cpp src/LASRcore/BufferArena.cpp -o pointbuffer
+//
+// ./pointbuffer [npoints] [nchunks]
+
+#include "BufferArena.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static double elapsed(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static const size_t point_size = 34; // Point format 3
+
+int main(int argc, char** argv)
+{
+  size_t npoints = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  size_t nchunks = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 10;
+
+  unsigned char record[point_size];
+  memset(record, 1, point_size);
+
+  // Previous strategy
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t k = 0 ; k < nchunks ; k++)
+  {
+    size_t capacity = 100000 * point_size;
+    unsigned char* buffer = (unsigned char*)calloc(capacity, 1);
+    for (size_t i = 0 ; i < npoints ; i++)
+    {
+      if ((i+1) * point_size > capacity)
+      {
+        capacity = std::min(capacity*2, npoints * point_size);
+        buffer = (unsigned char*)realloc(buffer, capacity);
+      }
+      memcpy(buffer + i * point_size, record, point_size);
+    }
+    free(buffer);
+  }
+  double t1 = elapsed(t0);
+
+  // Exact size from the header and recycling
+  t0 = std::chrono::steady_clock::now();
+  for (size_t k = 0 ; k < nchunks ; k++)
+  {
+    size_t capacity = npoints * point_size;
+    unsigned char* buffer = BufferArena::allocate(capacity);
+    for (size_t i = 0 ; i < npoints ; i++) memcpy(buffer + i * point_size, record, point_size);
+    BufferArena::release(buffer, capacity);
+  }
+  BufferArena::purge();
+  double t2 = elapsed(t0);
+
+  printf("%zu chunks of %zu points (%.0lf MB)\n\n", nchunks, npoints, npoints * point_size / 1024.0 / 1024.0);
+  printf("%-22s %10s\n", "", "seconds");
+  printf("%-22s %10.3lf\n", "doubling realloc", t1);
+  printf("%-22s %10.3lf\n", "exact size + recycling", t2);
+  printf("%-22s %10.1lf\n", "speedup", t1/t2);
+
+  return 0;
+}
@@ -200,7 +200,12 @@ PYBIND11_MODULE(pylasr, m) {
         .def("set_concurrent_points_strategy", &api::Pipeline::set_concurrent_points_strategy, "Set concurrent points processing strategy", py::arg("ncores"))
         .def("set_concurrent_files_strategy", &api::Pipeline::set_concurrent_files_strategy, "Set concurrent files processing strategy", py::arg("ncores"))
         .def("set_nested_strategy", &api::Pipeline::set_nested_strategy, "Set nested processing strategy", py::arg("ncores1"), py::arg("ncores2"))
+        .def("set_auto_strategy", &api::Pipeline::set_auto_strategy, "Choose the number of concurrent files and concurrent points from the pipeline and the memory budget", py::arg("ncores"))
         .def("set_verbose", &api::Pipeline::set_verbose, "Set verbose mode", py::arg("verbose"))
+        .def("set_columnar", &api::Pipeline::set_columnar, "Store loaded point clouds by attribute (structure of arrays)", py::arg("columnar"))
+        .def("set_max_memory", &api::Pipeline::set_max_memory, "Set the memory budget in MB (0 for half of the available RAM)", py::arg("mb"))
+        .def("set_buffer_cache", &api::Pipeline::set_buffer_cache, "Set the memory in MB used to keep the edges of the files for the buffer of the neighbouring chunks (0 to disable)", py::arg("mb"))
+        .def("set_header_cache", &api::Pipeline::set_header_cache, "Set a file caching the headers of the files between runs", py::arg("path"))
         .def("set_buffer", &api::Pipeline::set_buffer, "Set buffer size", py::arg("buffer"))
         .def("set_progress", &api::Pipeline::set_progress, "Set progress display", py::arg("progress"))
         .def("set_chunk", &api::Pipeline::set_chunk, "Set chunk size", py::arg("chunk"))
@@ -339,7 +344,7 @@ PYBIND11_MODULE(pylasr, m) {
 
     m.def("sort_points", &api::sort_points,
           "Sort points",
-          py::arg("spatial") = true);
+          py::arg("spatial") = true, py::arg("ofile") = "");
 
     // Filtering
     m.def("filter_with_grid", &api::filter_with_grid,
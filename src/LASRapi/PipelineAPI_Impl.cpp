@@ -73,6 +73,12 @@ void Pipeline::set_nested_strategy(int ncores1, int ncores2)
   opt_strategy = "nested";
 }
 
+void Pipeline::set_auto_strategy(int ncores)
+{
+  opt_ncores = {ncores, 0};
+  opt_strategy = "auto";
+}
+
 std::string Pipeline::to_string() const
 {
   std::string out;
@@ -183,6 +189,10 @@ nlohmann::json Pipeline::generate_json() const
   j["processing"]["progress"]  = opt_progress;
   j["processing"]["chunk"]     = opt_chunk;
   j["processing"]["verbose"]   = opt_verbose;
+  j["processing"]["columnar"]  = opt_columnar;
+  j["processing"]["max_memory"] = opt_max_memory;
+  j["processing"]["header_cache"] = opt_header_cache;
+  j["processing"]["buffer_cache"] = opt_buffer_cache;
   j["processing"]["profile_file"] = opt_profiling_file;
   j["processing"]["progress_file"] = opt_progress_file;
   j["processing"]["log_file"] = opt_log_file;
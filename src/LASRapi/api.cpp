@@ -504,10 +504,11 @@ Pipeline stop_if_chunk_id_below(int index)
   return Pipeline(s);
 }
 
-Pipeline sort_points(bool spatial)
+Pipeline sort_points(bool spatial, std::string ofile)
 {
   Stage s("sort");
   s.set("spatial", spatial);
+  s.set("output", ofile);
 
   return Pipeline(s);
 }
@@ -150,7 +150,12 @@ public:
   void set_concurrent_points_strategy(int ncores);
   void set_concurrent_files_strategy(int ncores);
   void set_nested_strategy(int ncores1, int ncores2);
+  void set_auto_strategy(int ncores);
   void set_verbose(bool b) { opt_verbose = b; };
+  void set_columnar(bool b) { opt_columnar = b; };
+  void set_max_memory(double mb) { opt_max_memory = mb; };
+  void set_header_cache(const std::string& path) { opt_header_cache = path; };
+  void set_buffer_cache(double mb) { opt_buffer_cache = mb; };
   void set_buffer(double val) { opt_buffer = val; };
   void set_progress(bool b) { opt_progress = b; };
   void set_chunk(double val) { if(val> 0) opt_chunk = val; };
@@ -179,6 +184,10 @@ private:
   bool opt_progress = false;
   double opt_chunk = 0;
   bool opt_verbose = false;
+  bool opt_columnar = false;
+  double opt_max_memory = 0;
+  std::string opt_header_cache = "";
+  double opt_buffer_cache = 512;
   std::vector<bool> opt_noprocess;
   std::string opt_profiling_file = "";
   std::string opt_progress_file = "";
@@ -226,7 +235,7 @@ Pipeline sampling_poisson(double distance = 2,  std::vector<std::string> filter
 Pipeline spikefree(double res = 0.5, double freeze_distance = 0.5, double height_buffer = 0.5, std::vector<std::string> filter = {""}, std::string ofile = "");
 Pipeline stop_if_outside(double xmin, double ymin, double xmax, double ymax);
 Pipeline stop_if_chunk_id_below(int index);
-Pipeline sort_points(bool spatial = true);
+Pipeline sort_points(bool spatial = true, std::string ofile = "");
 Pipeline summarise(double zwbin = 2, double iwbin = 50, std::vector<std::string> metrics = {},  std::vector<std::string> filter = {""});
 Pipeline triangulate(double max_edge = 0, std::vector<std::string> filter = {""}, std::string ofile = "", std::string use_attribute = "Z");
 Pipeline transform_with(std::string connect_uid, std::string operation = "-", std::string store_in_attribute = "", bool bilinear = true);
@@ -18,6 +18,8 @@
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <algorithm>
+#include <atomic>
 
 #include "api.h"
 #include "openmp.h"
@@ -26,6 +28,7 @@
 
 #include "Engine.h"
 #include "FileCollection.h"
+#include "MemoryBudget.h"
 
 #include "DrawflowParser.h"
 #include "nlohmann/json.hpp"
@@ -71,7 +74,11 @@ ReturnType execute(const std::string& config_file)
   std::string strategy = processing_options.value("strategy", "concurrent-points");
   bool progrss = processing_options.value("progress", true);
   bool verbose = processing_options.value("verbose", false);
+  bool columnar = processing_options.value("columnar", false);
   double chunk_size = processing_options.value("chunk", 0);
+  double buffer_cache = processing_options.value("buffer_cache", 512.0); // MB, 0 to disable
+  std::string header_cache = processing_options.value("header_cache", ""); // Optional file to cache the headers of the files
+  double max_memory = processing_options.value("max_memory", 0.0); // MB, 0 for half of the available RAM
 
   // Optional log files
   std::string progress_file = processing_options.value("progress_file", "");
@@ -126,6 +133,7 @@ ReturnType execute(const std::string& config_file)
   int ncpu_outer_loop = 1; // concurrent files
   int ncpu_inner_loops = 1; // concurrent points
   if (strategy == "concurrent-points") ncpu_inner_loops = ncpu[0];
+  if (strategy == "auto") ncpu_inner_loops = ncpu[0]; // Decided once the pipeline is parsed
   if (strategy == "concurrent-files") ncpu_outer_loop = ncpu[0];
   if (strategy == "nested")
   {
@@ -136,6 +144,10 @@ ReturnType execute(const std::string& config_file)
   }
   if (ncpu_outer_loop > 1 && ncpu_inner_loops > 1) omp_set_max_active_levels(2); // nested
 
+  // The headers of the files are read with all the cores whatever the strategy
+  json_pipeline[0]["ncpu"] = ncpu[0];
+  json_pipeline[0]["header_cache"] = header_cache;
+
   //#ifdef USING_R
   //uintptr_t original_CStackLimit = R_CStackLimit;
   //#endif
@@ -155,6 +167,42 @@ ReturnType execute(const std::string& config_file)
 
     int n = lascatalog->get_number_chunks();
 
+    if (max_memory <= 0) max_memory = getAvailableRAM() / 2.0;
+
+    // Automatic strategy: as many concurrent files as possible, limited by the memory needed to
+    // load the largest chunk when the pipeline is not streamable. The remaining cores go to the
+    // stages that process the points in parallel.
+    if (strategy == "auto")
+    {
+      bool streamable = pipeline.is_streamable();
+      bool read_points = pipeline.need_points();
+      double largest = 0;
+      for (int i = 0 ; i < n ; i++) largest = std::max(largest, lascatalog->get_chunk_memory(i));
+      largest /= 1024*1024;
+
+      int ncores = ncpu[0];
+      int files = ncores;
+      if (!is_parallelizable || use_rcapi)
+        files = 1;
+      else if (read_points && !streamable && largest > 0)
+        files = std::max(1, std::min(ncores, (int)(max_memory / largest)));
+      files = std::max(1, std::min(files, n));
+
+      ncpu_outer_loop = files;
+      ncpu_inner_loops = (is_parallelized) ? std::max(1, ncores / files) : 1;
+      if (ncpu_outer_loop > 1 && ncpu_inner_loops > 1) omp_set_max_active_levels(2);
+
+      log(flog, verbose, "Automatic strategy:\n");
+      log(flog, verbose, "  Cores: %d\n", ncores);
+      log(flog, verbose, "  Chunks: %d\n", n);
+      log(flog, verbose, "  Streamable: %s\n", streamable ? "true" : "false");
+      log(flog, verbose, "  Buffer: %.1lf\n", pipeline.need_buffer());
+      log(flog, verbose, "  Largest chunk: %.0lf MB (estimated)\n", largest);
+      log(flog, verbose, "  Memory budget: %.0lf MB\n", max_memory);
+      log(flog, verbose, "  Parallelizable: files %s, points %s\n", (is_parallelizable && !use_rcapi) ? "yes" : "no", is_parallelized ? "yes" : "no");
+      log(flog, verbose, "  Decision: %d concurrent files x %d concurrent points\n\n", ncpu_outer_loop, ncpu_inner_loops);
+    }
+
     if (n == 1 && ncpu_outer_loop > 1)
       std::swap(ncpu_outer_loop, ncpu_inner_loops);
 
@@ -182,9 +230,19 @@ ReturnType execute(const std::string& config_file)
     }
 
     pipeline.set_verbose(verbose);
+    pipeline.set_columnar(columnar);
     pipeline.set_ncpu(ncpu_inner_loops);
     pipeline.set_ncpu_concurrent_files(ncpu_outer_loop);
 
+    // Edge strips of the files kept for the buffer of the neighbouring chunks
+    StripCache strip_cache((uint64_t)(std::max(buffer_cache, 0.0)*1024*1024));
+    pipeline.set_strip_cache(&strip_cache);
+
+    // Memory budget: the chunks processed concurrently must fit in max_memory. The points of a
+    // streamed pipeline are read by blocks and only the rasters of such pipeline are counted.
+    bool load_points = pipeline.need_points() && !pipeline.is_streamable();
+    MemoryBudget budget((uint64_t)(max_memory*1024*1024));
+
     log(flog, verbose, "File processing options:\n");
     log(flog, verbose, "  Read points: %s\n", pipeline.need_points() ? "true" : "false");
     log(flog, verbose, "  Streamable: %s\n", pipeline.is_streamable() ? "true" : "false");
@@ -192,6 +250,8 @@ ReturnType execute(const std::string& config_file)
     log(flog, verbose, "  Concurrent files: %d\n", ncpu_outer_loop);
     log(flog, verbose, "  Concurrent points: %d\n", ncpu_inner_loops);
     log(flog, verbose, "  Chunks: %d\n", n);
+    log(flog, verbose, "  Buffer cache: %.0lf MB\n", buffer_cache);
+    log(flog, verbose, "  Memory budget: %.0lf MB\n", max_memory);
     log(flog, verbose, "\n");
 
     // Initialize progress bars
@@ -216,6 +276,23 @@ ReturnType execute(const std::string& config_file)
     bool failure = false;
     int k = 0;
 
+    // The chunks are ordered by the catalog (largest first or by proximity, see get_schedule())
+    // and each thread takes the next chunk from this shared pool. A thread that found no more
+    // chunk gives its cores to the concurrent-points level of the next chunks started by the
+    // other threads. A chunk only receives cores that are free so the threads in use never
+    // exceed ncpu_total.
+    std::vector<int> schedule = lascatalog->get_schedule();
+    std::atomic<int> next(0);
+    int ncpu_total = std::min(ncpu_outer_loop * ncpu_inner_loops, available_threads());
+    bool rebalance = is_parallelized && ncpu_outer_loop > 1;
+    if (rebalance) omp_set_max_active_levels(2);
+    int ncpu_spare = 0;  // Cores of the threads that found no more chunk, not given to a chunk
+    int ncpu_busy = 0;   // Cores used by the chunks in progress
+    int ncpu_peak = 0;
+
+    std::vector<float> finished(ncpu_outer_loop, -1);   // Time at which each thread found no more work
+    std::vector<Profile> chunk_profiles;                // Time and size of each chunk
+
     #pragma omp parallel num_threads(ncpu_outer_loop)
     {
       try
@@ -224,10 +301,14 @@ ReturnType execute(const std::string& config_file)
         // ensure that shared resources are protected (such as connections to output files)
         // and private data are copied.
         Engine private_pipeline(pipeline);
+        std::vector<Profile> private_chunk_profiles;
 
-        #pragma omp for schedule(dynamic)
-        for (int i = 0 ; i < n ; ++i)
+        while (true)
         {
+          int j = next++;
+          if (j >= n) break;
+          int i = schedule[j];
+
           // We cannot exit a parallel loop easily. Instead we can rather run the loop until the end
           // skipping the processing
           if (failure) continue;
@@ -268,23 +349,60 @@ ReturnType execute(const std::string& config_file)
 
           log(flog, verbose, "Processing chunk %d/%d in thread %d: %s\n", i+1, n, omp_get_thread_num(), chunk.name.c_str()); // # nocov
 
+          // Wait until the other threads released enough memory to load this chunk. The
+          // reservation is released at the end of the iteration.
+          double need = private_pipeline.need_raster_memory(chunk);
+          if (load_points) need += lascatalog->get_chunk_memory(i);
+          MemoryBudget::Reservation reservation(budget, (uint64_t)need);
+          if (reservation.wait > 0.01)
+            log(flog, verbose, "Chunk %d waited %.1lf s for %.0lf MB of memory\n", i+1, reservation.wait, need/1024/1024);
+
+          // Cores of this chunk: its own plus the free cores of the threads that have finished
+          int ncpu_chunk = ncpu_inner_loops;
+          if (rebalance)
+          {
+            #pragma omp critical (rebalance)
+            {
+              int extra = std::max(0, std::min(ncpu_spare, ncpu_total - ncpu_busy - ncpu_inner_loops));
+              ncpu_spare -= extra;
+              ncpu_chunk += extra;
+              ncpu_busy += ncpu_chunk;
+              ncpu_peak = std::max(ncpu_peak, ncpu_busy);
+            }
+            private_pipeline.set_ncpu(ncpu_chunk);
+            if (ncpu_chunk > ncpu_inner_loops) log(flog, verbose, "Chunk %d uses %d threads\n", i+1, ncpu_chunk);
+          }
+
+          MemoryTracker::reset_peak();
+          int64_t memory_start = MemoryTracker::current();
+          float start = pipeline.profiler.elapsed();
+
           // set_chunk() initialize the region we are working with which is a sub-part of the
-          // overall processed region
-          if (!private_pipeline.set_chunk(chunk))
+          // overall processed region. run() does execute the pipeline. This is encapsulated but
+          // at the end each stage is supposed to contains the data for the current chunk and
+          // optionally write the result into a file
+          bool success = private_pipeline.set_chunk(chunk) && private_pipeline.run();
+
+          // The extra cores are returned to the pool for the next chunks
+          if (rebalance)
           {
-            failure = true;
-            continue;
+            #pragma omp critical (rebalance)
+            {
+              ncpu_busy -= ncpu_chunk;
+              ncpu_spare += ncpu_chunk - ncpu_inner_loops;
+            }
           }
 
-          // run() does execute the pipeline. This is encapsulated but at the end each stage
-          // is supposed to contains the data for the current chunk and optionally write the
-          // result into a file
-          if (!private_pipeline.run())
+          if (!success)
           {
             failure = true;
             continue;
           }
 
+          float end = pipeline.profiler.elapsed();
+          private_chunk_profiles.emplace_back("chunk " + chunk.name, start, end, omp_get_thread_num(), (uint64_t)lascatalog->get_chunk_cost(i), end - start);
+          private_chunk_profiles.back().memory = std::max<int64_t>(0, MemoryTracker::peak() - memory_start);
+
           #pragma omp critical (progressupdate)
           {
             k++;
@@ -296,6 +414,14 @@ ReturnType execute(const std::string& config_file)
           log(flog, verbose, "Chunk %d completed\n", i+1);
         }
 
+        finished[omp_get_thread_num()] = pipeline.profiler.elapsed();
+
+        if (rebalance)
+        {
+          #pragma omp critical (rebalance)
+          ncpu_spare += ncpu_inner_loops;
+        }
+
         // We are outside the main loop. We can clear the pipeline with last = true;
         // Pipelines can do something special or not (such a freeing resource) at the very end of
         // the process.
@@ -307,6 +433,7 @@ ReturnType execute(const std::string& config_file)
         #pragma omp critical
         {
           pipeline.merge(private_pipeline);
+          chunk_profiles.insert(chunk_profiles.end(), private_chunk_profiles.begin(), private_chunk_profiles.end());
         }
       }
       catch (std::string e)
@@ -325,6 +452,35 @@ ReturnType execute(const std::string& config_file)
 
     progress.done(true);
 
+    // Time spent by each thread waiting for the others at the end of the run
+    float end = pipeline.profiler.elapsed();
+    float idle = 0;
+    for (int t = 0 ; t < ncpu_outer_loop ; t++)
+    {
+      if (finished[t] < 0) continue;
+      Profile profile("idle", finished[t], end, t, 0, end - finished[t]);
+      chunk_profiles.push_back(profile);
+      idle += end - finished[t];
+    }
+
+    uint64_t npoints = 0;
+    float busy = 0;
+    for (const auto& profile : chunk_profiles) { if (profile.name != "idle") { npoints += profile.npoints; busy += profile.busy; } }
+    log(flog, verbose, "Scheduler: %d chunks in %.1lf s, %.0lf points/s per thread, idle time %.1lf s\n", n, end, (busy > 0) ? npoints/busy : 0, idle);
+    if (rebalance) log(flog, verbose, "Scheduler: peak %d threads used by the chunks out of %d\n", ncpu_peak, ncpu_total);
+
+    if (strip_cache.get_stats().insertions > 0)
+    {
+      StripCache::Stats stats = strip_cache.get_stats();
+      log(flog, verbose, "Buffer cache: %llu hits, %llu misses, %llu strips inserted, %llu evicted, %llu too large, peak memory %.1lf MB\n",
+          (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.insertions,
+          (unsigned long long)stats.evictions, (unsigned long long)stats.rejections, stats.peak_memory/1024.0/1024.0);
+    }
+    strip_cache.clear();
+
+    log(flog, verbose, "Memory: peak %.1lf MB of points, peak %.1lf MB reserved out of %.0lf MB, %llu chunks waited\n",
+        MemoryTracker::global_peak()/1024.0/1024.0, budget.get_peak()/1024.0/1024.0, max_memory, (unsigned long long)budget.get_waits());
+
     // closing log files
     if (flog)
     {
@@ -338,6 +494,7 @@ ReturnType execute(const std::string& config_file)
     }
 
     pipeline.sort();
+    pipeline.profiler.profiles.insert(pipeline.profiler.profiles.end(), chunk_profiles.begin(), chunk_profiles.end());
 
     pipeline.profiler.write(profile_file);
 
@@ -0,0 +1,147 @@
+#include "BufferArena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define USE_MMAP 1
+#endif
+
+#ifdef USE_MMAP
+
+static const size_t MMAP_THRESHOLD = 2*1024*1024; // Size of a huge page
+
+static size_t mapped_size(size_t bytes)
+{
+  static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (bytes + page - 1) / page * page;
+}
+
+static unsigned char* map(size_t size)
+{
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return nullptr;
+
+  // MAP_HUGETLB is not used because it fails unless huge pages were reserved by the administrator.
+  // Transparent huge pages work without configuration when they are enabled in 'madvise' mode.
+  #ifdef MADV_HUGEPAGE
+  madvise(p, size, MADV_HUGEPAGE);
+  #endif
+
+  return (unsigned char*)p;
+}
+
+// Last large buffer released by the thread
+struct RecycledBuffer
+{
+  unsigned char* data = nullptr;
+  size_t size = 0;
+  ~RecycledBuffer() { if (data) munmap(data, size); }
+};
+
+static thread_local RecycledBuffer recycled;
+
+#endif
+
+unsigned char* BufferArena::allocate(size_t bytes)
+{
+  #ifdef USE_MMAP
+  if (bytes >= MMAP_THRESHOLD)
+  {
+    size_t size = mapped_size(bytes);
+
+    if (recycled.data)
+    {
+      unsigned char* p = recycled.data;
+      size_t old_size = recycled.size;
+      recycled.data = nullptr;
+      recycled.size = 0;
+
+      if (old_size != size)
+      {
+        void* q = mremap(p, old_size, size, MREMAP_MAYMOVE);
+        if (q == MAP_FAILED)
+        {
+          munmap(p, old_size);
+          return map(size);
+        }
+        p = (unsigned char*)q;
+      }
+
+      // The pages added by mremap() are already zeroed
+      memset(p, 0, std::min(old_size, size));
+      return p;
+    }
+
+    return map(size);
+  }
+  #endif
+
+  return (unsigned char*)calloc(bytes, sizeof(unsigned char));
+}
+
+unsigned char* BufferArena::reallocate(unsigned char* buffer, size_t old_bytes, size_t new_bytes)
+{
+  if (buffer == nullptr) return allocate(new_bytes);
+
+  #ifdef USE_MMAP
+  bool old_mapped = old_bytes >= MMAP_THRESHOLD;
+  bool new_mapped = new_bytes >= MMAP_THRESHOLD;
+
+  if (old_mapped && new_mapped)
+  {
+    void* p = mremap(buffer, mapped_size(old_bytes), mapped_size(new_bytes), MREMAP_MAYMOVE);
+    return (p == MAP_FAILED) ? nullptr : (unsigned char*)p;
+  }
+
+  if (old_mapped || new_mapped)
+  {
+    unsigned char* p = allocate(new_bytes);
+    if (p == nullptr) return nullptr;
+    memcpy(p, buffer, std::min(old_bytes, new_bytes));
+    release(buffer, old_bytes);
+    return p;
+  }
+  #endif
+
+  return (unsigned char*)realloc(buffer, new_bytes);
+}
+
+void BufferArena::release(unsigned char* buffer, size_t bytes)
+{
+  if (buffer == nullptr) return;
+
+  #ifdef USE_MMAP
+  if (bytes >= MMAP_THRESHOLD)
+  {
+    size_t size = mapped_size(bytes);
+
+    // Keep the largest buffer for the next chunk
+    if (recycled.data == nullptr || recycled.size < size)
+    {
+      if (recycled.data) munmap(recycled.data, recycled.size);
+      recycled.data = buffer;
+      recycled.size = size;
+    }
+    else
+    {
+      munmap(buffer, size);
+    }
+    return;
+  }
+  #endif
+
+  free(buffer);
+}
+
+void BufferArena::purge()
+{
+  #ifdef USE_MMAP
+  if (recycled.data) munmap(recycled.data, recycled.size);
+  recycled.data = nullptr;
+  recycled.size = 0;
+  #endif
+}
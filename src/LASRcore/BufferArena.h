@@ -0,0 +1,24 @@
+#ifndef BUFFERARENA_H
+#define BUFFERARENA_H
+
+#include <cstddef>
+
+// Allocator of the buffers of the point clouds. On Linux large buffers are mapped directly with
+// mmap() and advised to use transparent huge pages. They are resized with mremap() that moves the
+// pages without copying the points. The last large buffer released by a thread is kept and
+// recycled for the next point cloud allocated by this thread, so consecutive chunks processed by
+// the same pipeline reuse the same pages. Small buffers and other platforms use the C heap.
+//
+// Buffers returned by allocate() are zeroed. Like realloc(), reallocate() does not zero the new
+// bytes and leaves the buffer untouched on failure. The size of a buffer must be passed back to
+// reallocate() and release() because it decides how the buffer was allocated.
+class BufferArena
+{
+public:
+  static unsigned char* allocate(size_t bytes);
+  static unsigned char* reallocate(unsigned char* buffer, size_t old_bytes, size_t new_bytes);
+  static void release(unsigned char* buffer, size_t bytes);
+  static void purge(); // Frees the buffer kept by the calling thread
+};
+
+#endif
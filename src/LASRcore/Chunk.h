@@ -3,6 +3,7 @@
 
 #include "Shape.h"
 #include <string>
+#include <vector>
 
 struct Chunk
 {
@@ -29,6 +30,8 @@ struct Chunk
     name.clear();
     main_files.clear();
     neighbour_files.clear();
+    main_bboxes.clear();
+    neighbour_bboxes.clear();
   };
 
   // # nocov start
@@ -55,6 +58,10 @@ struct Chunk
   std::string name;
   std::vector<std::string> main_files;
   std::vector<std::string> neighbour_files;
+
+  // Bounding boxes of the files. Only for chunks made of whole files.
+  std::vector<Rectangle> main_bboxes;
+  std::vector<Rectangle> neighbour_bboxes;
 };
 
 #endif
\ No newline at end of file
@@ -3,10 +3,12 @@
 #include "FileCollection.h"
 #include "Stage.h"
 #include "Progress.h"
+#include "BufferArena.h"
 #include "macros.h"
 #include "openmp.h"
 
 #include <algorithm>
+#include <cmath>
 #include <unordered_map>
 
 Engine::Engine()
@@ -116,10 +118,17 @@ bool Engine::run_streamed()
   Progress prg;
   prg.set_total(INT64_MAX);
 
-  size_t i = -1;
+  // Time spent and number of points processed in each stage. Stages are interleaved
+  // block by block so we accumulate the time actually spent in each of them.
+  std::vector<double> busy(pipeline.size(), 0);
+  std::vector<uint64_t> processed(pipeline.size(), 0);
+  profiler.tic();
+
+  // The loop may end at the first iteration without reading any point
+  bool has_points = false;
+
   while(!last_point)
   {
-    i++;
     prg++;
     if (prg.interrupted())
     {
@@ -127,8 +136,14 @@ bool Engine::run_streamed()
       return false;
     }
 
+    // The block is emptied and is going to be filled by the reader
+    block.clear();
+
+    int j = -1;
     for (auto&& stage : pipeline)
     {
+      j++;
+
       // Some stage process the header. The first stage being a reader, the LASheader, which is
       // initially nullptr, will be initialized by pipeline[0]
       success = stage->process(header);
@@ -156,11 +171,25 @@ bool Engine::run_streamed()
         return false; // # nocov
       }
 
-      // Each stage process the LASpoint. The first stage being a reader, the LASpoint, which is
-      // initially nullptr, will be initialized by pipeline[0]
+      // Each stage process the block of points. The first stage being a reader, the block, which
+      // is initially empty, will be filled by pipeline[0]
       if (read_payload)
       {
-        success = stage->process(point);
+        try
+        {
+          block.set_schema(&header->schema);
+        }
+        catch (const std::exception& e)
+        {
+          last_error = e.what(); // # nocov
+          return false; // # nocov
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        success = stage->process(block);
+        auto t1 = std::chrono::steady_clock::now();
+        busy[j] += std::chrono::duration<double>(t1 - t0).count();
+        processed[j] += block.size();
 
         if (!success)
         {
@@ -168,20 +197,26 @@ bool Engine::run_streamed()
           return false; // # nocov
         }
 
-        if (point == nullptr)
+        if (block.empty())
         {
           last_point = true;
           break;
         }
+
+        has_points = true;
       }
       else
       {
         last_point = true;
       }
     }
+
+    // The reader hit the end of the file while filling this block. The block has been
+    // processed by all the stages, there is no need to call the reader again.
+    if (block.eof) last_point = true;
   }
 
-  if (i == 0)
+  if (!has_points)
   {
     order.pop_back();
   }
@@ -199,6 +234,15 @@ bool Engine::run_streamed()
     stage->reset_filter();
   }
 
+  // Record the throughput of each stage
+  profiler.toc();
+  int j = 0;
+  for (auto&& stage : pipeline)
+  {
+    if (processed[j] > 0) profiler.insert(stage->get_name(), processed[j], (float)busy[j]);
+    j++;
+  }
+
   return true;
 }
 
@@ -215,6 +259,8 @@ bool Engine::run_loaded()
     }
 
     profiler.tic();
+    const PointCloud* las_before = las;
+    IndexStats index_stats = (las) ? las->get_index_stats() : IndexStats();
 
     if (verbose) print("Stage: %s\n", stage->get_name().c_str());
 
@@ -288,7 +334,12 @@ bool Engine::run_loaded()
     }
 
     profiler.toc();
-    profiler.insert(stage->get_name());
+    if (las && las == las_before)
+      profiler.insert(stage->get_name(), las->npoints, las->get_index_stats() - index_stats);
+    else if (las)
+      profiler.insert(stage->get_name(), las->npoints, las->get_index_stats());
+    else
+      profiler.insert(stage->get_name());
   }
 
   for (auto&& stage : pipeline)
@@ -353,6 +404,11 @@ void Engine::set_progress(Progress* progress)
   for (auto&& stage : pipeline) stage->set_progress(progress);
 }
 
+void Engine::set_strip_cache(StripCache* cache)
+{
+  for (auto&& stage : pipeline) stage->set_strip_cache(cache);
+}
+
 void Engine::set_ncpu(int ncpu)
 {
   if (ncpu > available_threads())
@@ -377,6 +433,11 @@ void Engine::set_verbose(bool verbose)
   for (auto&& stage : pipeline) stage->set_verbose(verbose);
 }
 
+void Engine::set_columnar(bool columnar)
+{
+  for (auto&& stage : pipeline) stage->set_columnar(columnar);
+}
+
 bool Engine::is_streamable() const
 {
   bool b = true;
@@ -452,6 +513,104 @@ bool Engine::need_points() const
   return b;
 }
 
+// Predicate pushdown. A condition that is part of the filter of every stage that processes the
+// points removes points that all the stages ignore: it is pushed into the reader that discards
+// these points instead of loading them. LASlib filters (e.g. '-keep_first') are not pushed because
+// they only apply in the reader.
+// Attribute projection. If every stage declares the attributes it reads and writes, the reader
+// does not decode the others and removes them from the point cloud. A stage that keeps only some
+// attributes bounds the attributes that the next stages can use.
+void Engine::push_down()
+{
+  auto it = std::find_if(pipeline.begin(), pipeline.end(), [](const std::unique_ptr<Stage>& stage) { return stage->get_name().rfind("reader", 0) == 0; });
+  if (it == pipeline.end()) return;
+  Stage* reader = it->get();
+
+  bool first = true;
+  std::vector<std::string> shared;
+
+  for (auto stage = std::next(it) ; stage != pipeline.end() ; stage++)
+  {
+    if (!(*stage)->need_points()) continue;
+
+    std::vector<std::string> conditions;
+    if ((*stage)->is_filter_pushable())
+    {
+      for (const auto& filter : (*stage)->get_filters())
+      {
+        size_t start = filter.find_first_not_of(" \t");
+        size_t end = filter.find_last_not_of(" \t");
+        if (start == std::string::npos || filter[start] == '-') continue;
+        conditions.push_back(filter.substr(start, end - start + 1));
+      }
+    }
+
+    if (first)
+      shared = conditions;
+    else
+      shared.erase(std::remove_if(shared.begin(), shared.end(), [&](const std::string& s) { return std::find(conditions.begin(), conditions.end(), s) == conditions.end(); }), shared.end());
+
+    first = false;
+  }
+
+  // No stage processes the points
+  if (first) return;
+
+  for (const auto& condition : shared) reader->push_filter(condition);
+
+  // From the last stage to the reader
+  bool known = true;
+  std::vector<std::string> decoded;
+  std::vector<std::string> written;
+
+  for (auto stage = pipeline.rbegin() ; stage->get() != reader ; stage++)
+  {
+    if (!(*stage)->need_points()) continue;
+
+    std::vector<std::string> kept;
+    if ((*stage)->keep_only_attributes(kept) && !known)
+    {
+      decoded = kept;
+      written.clear();
+      known = true;
+    }
+
+    if (!(*stage)->need_attributes(decoded)) known = false;
+    (*stage)->get_filter_attributes(decoded);
+    (*stage)->written_attributes(written);
+  }
+
+  if (!known) return;
+
+  reader->get_filter_attributes(decoded);
+  reader->set_decoded_attributes(decoded);
+
+  written.insert(written.end(), decoded.begin(), decoded.end());
+  reader->set_projected_attributes(written);
+}
+
+// Memory in bytes of the rasters produced by the stages for this chunk (buffer included)
+double Engine::need_raster_memory(const Chunk& chunk) const
+{
+  double bytes = 0;
+  for (auto&& stage : pipeline)
+  {
+    StageRaster* p = dynamic_cast<StageRaster*>(stage.get());
+    if (p == nullptr) continue;
+
+    const Raster& raster = p->get_raster();
+    double xres = raster.get_xres();
+    double yres = raster.get_yres();
+    if (xres <= 0 || yres <= 0) continue;
+
+    double w = chunk.xmax - chunk.xmin + 2*chunk.buffer;
+    double h = chunk.ymax - chunk.ymin + 2*chunk.buffer;
+    bytes += std::ceil(w/xres) * std::ceil(h/yres) * std::max(1, raster.get_nbands()) * sizeof(float);
+  }
+
+  return bytes;
+}
+
 double Engine::need_buffer()
 {
   for (auto&& stage : pipeline)
@@ -491,6 +650,9 @@ void Engine::clear(bool last)
   {
     stage->clear(last);
   }
+
+  // The buffer recycled from one chunk to the next is no longer needed
+  if (last) BufferArena::purge();
 }
 
 void Engine::clean()
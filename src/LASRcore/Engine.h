@@ -42,13 +42,16 @@ public:
   bool use_rcapi() const;
   double need_buffer();
   bool need_points() const;
+  double need_raster_memory(const Chunk& chunk) const;
   bool set_chunk(Chunk& chunk);
   void set_ncpu(int ncpu);
   void set_ncpu_concurrent_files(int ncpu);
   void set_verbose(bool verbose);
+  void set_columnar(bool columnar);
   void sort();
   void show_profiling(const std::string& path);
   void set_progress(Progress* progress);
+  void set_strip_cache(StripCache* cache);
   FileCollection* get_catalog() const { return catalog.get(); };
 
 #ifdef USING_R
@@ -61,6 +64,7 @@ public:
 private:
   bool run_streamed();
   bool run_loaded();
+  void push_down();
   void clean();
 
 private:
@@ -76,6 +80,7 @@ private:
 
   PointCloud* las;                           // owned by this
   Point* point;                              // owned by las or by reader_las in streaming mode
+  PointBlock block;                          // owned by this, recycled between chunks in streaming mode
   Header* header;                            // owned by las or by reader_las in streaming mode
   std::shared_ptr<FileCollection> catalog;   // owned by this and shared in cloned pipelines
   bool point_cloud_ownership_transfered;
@@ -14,7 +14,7 @@ public:
   template<typename T> void lookup(T& shape, std::vector<PointXYI>&);
 
 private:
-  unsigned int npoints;
+  size_t npoints;
   unsigned int ncols, nrows, ncells;
   double xmin,ymin,xmax,ymax;
   double xres, yres;
@@ -82,7 +82,7 @@ inline FastGridPartition2D::FastGridPartition2D(PointCloud& las)
   // Precompute cell indexes and number of points per cells
   std::vector<int> cell_index(npoints, 0);
   std::vector<unsigned int> cell_points(ncells, 0);
-  unsigned int i = 0;
+  size_t i = 0;
   while (las.read_point())
   {
     double x = las.point.get_x();
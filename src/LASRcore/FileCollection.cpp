@@ -5,6 +5,8 @@
 #include "print.h"
 #include "Grid.h"
 #include "PointSchema.h"
+#include "HeaderCache.h"
+#include "openmp.h"
 
 // To read the header of files
 #include "PCDio.h"
@@ -16,6 +18,7 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
 #include <filesystem>
 
 // To parse JSON VPC
@@ -76,25 +79,24 @@ bool FileCollection::read(const std::vector<std::string>& files, bool progress)
   pb.set_prefix("Read files headers");
   pb.set_display(progress);
 
+  // LAS and PCD files are collected and their headers are read in parallel by batch. The batch is
+  // flushed before an EPT or a VPC source to preserve the order of the files.
+  std::vector<std::pair<std::string, PathType>> batch;
+
   for (auto& file : files)
   {
-    pb++;
-    pb.show();
     PathType type = parse_path(file);
 
     // A LAS, LAZ, or remote LAS/LAZ file
-    if (type == PathType::LASFILE || type == PathType::REMOTELASFILE)
+    if (type == PathType::LASFILE || type == PathType::REMOTELASFILE || type == PathType::PCDFILE)
     {
-      if (!add_las_file(file)) return false;
+      batch.push_back({file, type});
     }
     else if (type == PathType::EPTFILE || type == PathType::REMOTEEPTFILE)
     {
+      if (!add_files(batch, pb)) return false;
       if (!add_ept_endpoint(file)) return false;
     }
-    else if (type == PathType::PCDFILE)
-    {
-      if (!add_pcd_file(file)) return false;
-    }
     // A virtual point cloud file
     else if (type == PathType::VPCFILE)
     {
@@ -120,14 +122,7 @@ bool FileCollection::read(const std::vector<std::string>& files, bool progress)
         {
           std::string f = entry.path().string();
           PathType type = parse_path(f);
-          bool success = true;
-
-          if (type == LASFILE)
-            success = add_las_file(f);
-          else if (type == PCDFILE)
-            success = add_pcd_file(f);
-
-          if (!success) return false;
+          if (type == LASFILE || type == PCDFILE) batch.push_back({f, type});
         }
       }
     }
@@ -143,6 +138,8 @@ bool FileCollection::read(const std::vector<std::string>& files, bool progress)
     }
   }
 
+  if (!add_files(batch, pb)) return false;
+
   pb.done();
 
   // Fix #160 with empty folders
@@ -528,62 +525,105 @@ void FileCollection::add_query(double xcenter, double ycenter, double radius)
   queries.push_back(circ);
 }
 
-bool FileCollection::add_las_file(std::string file, bool noprocess)
+// Reads the header of a LAS/LAZ or PCD file. Throws on failure. Thread safe.
+static void read_file_header(const std::string& file, PathType type, Header& header)
 {
-  std::replace(file.begin(), file.end(), '\\', '/' );
-
-  Header header;
-  LASio reader;
-
-  try
+  if (type == PathType::PCDFILE)
   {
+    PCDio reader;
+    reader.preread_bbox = true;
     reader.open(file);
-    reader.populate_header(&header, true);
+    reader.populate_header(&header);
     reader.close();
   }
-  catch (const std::exception& e)
-  {
-    last_error = e.what();
-    return false;
-  }
-
-  if (header.number_of_point_records == 0)
+  else
   {
-    warning("File %s containing 0 point was discarded.\n", file.c_str());
-    return true;
+    LASio reader;
+    reader.open(file);
+    reader.populate_header(&header, true);
+    reader.close();
   }
+}
 
-  add_header(header, noprocess);
-  files.push_back(file);
-
-  use_dataframe = false;
-  return true;
+bool FileCollection::add_las_file(std::string file, bool noprocess)
+{
+  std::vector<std::pair<std::string, PathType>> entries = {{file, PathType::LASFILE}};
+  Progress pb;
+  return add_files(entries, pb, noprocess);
 }
 
-bool FileCollection::add_pcd_file(std::string file, bool noprocess)
+// Reads the headers of the files with 'ncpu' threads. Headers found in the header cache with the
+// same size and modification time are not read again. The files are added in the order of 'entries'
+// and the first error in this order is reported.
+bool FileCollection::add_files(std::vector<std::pair<std::string, PathType>>& entries, Progress& pb, bool noprocess)
 {
-  std::replace(file.begin(), file.end(), '\\', '/' );
+  if (entries.empty()) return true;
 
-  Header header;
-  PCDio reader;
-  reader.preread_bbox = true;
+  size_t n = entries.size();
+  for (auto& entry : entries) std::replace(entry.first.begin(), entry.first.end(), '\\', '/');
 
-  try
+  HeaderCache cache;
+  if (!header_cache.empty()) cache.load(header_cache);
+
+  std::vector<Header> headers(n);
+  std::vector<std::string> errors(n);
+  std::vector<char> cached(n, 0);
+
+  pb.set_total(n);
+  uint64_t done = 0;
+
+  #pragma omp parallel for num_threads(ncpu) schedule(dynamic)
+  for (size_t i = 0 ; i < n ; i++)
   {
-    reader.open(file);
-    reader.populate_header(&header);
-    reader.close();
+    cached[i] = cache.get(entries[i].first, headers[i]);
+
+    if (!cached[i])
+    {
+      try
+      {
+        read_file_header(entries[i].first, entries[i].second, headers[i]);
+      }
+      catch (const std::exception& e)
+      {
+        errors[i] = e.what();
+      }
+    }
+
+    uint64_t current;
+    #pragma omp atomic capture
+    current = ++done;
+
+    pb.update(current, true);
+    if (omp_get_thread_num() == 0) pb.show();
   }
-  catch (const std::exception& e)
+
+  for (size_t i = 0 ; i < n ; i++)
   {
-    last_error = e.what();
-    return false;
-  }
+    if (!errors[i].empty())
+    {
+      last_error = errors[i];
+      return false;
+    }
 
-  add_header(header, noprocess);
-  files.push_back(file);
+    if (!cached[i]) cache.set(entries[i].first, headers[i]);
+
+    // Empty PCD files are kept
+    if (entries[i].second != PathType::PCDFILE && headers[i].number_of_point_records == 0)
+    {
+      warning("File %s containing 0 point was discarded.\n", entries[i].first.c_str());
+      continue;
+    }
+
+    add_header(headers[i], noprocess);
+    files.push_back(entries[i].first);
+  }
 
   use_dataframe = false;
+
+  if (!header_cache.empty() && cache.is_modified() && !cache.save(header_cache))
+    warning("Failed to write the header cache %s\n", header_cache.c_str());
+
+  entries.clear();
   return true;
 }
 
@@ -787,6 +827,7 @@ bool FileCollection::get_chunk_regular(int i, Chunk& chunk) const
   }
 
   chunk.buffer = buffer;
+  chunk.main_bboxes.emplace_back(h.min_x, h.min_y, h.max_x, h.max_y);
 
   // Perform a query to find the files that encompass the buffered region
   std::vector<int> indexes = file_index.get_overlaps(h.min_x - buffer, h.min_y - buffer, h.max_x + buffer, h.max_y + buffer);
@@ -796,6 +837,7 @@ bool FileCollection::get_chunk_regular(int i, Chunk& chunk) const
     if (chunk.main_files[0] != file)
     {
       chunk.neighbour_files.push_back(file);
+      chunk.neighbour_bboxes.emplace_back(headers[index].min_x, headers[index].min_y, headers[index].max_x, headers[index].max_y);
     }
   }
 
@@ -918,6 +960,105 @@ int FileCollection::get_number_chunks() const
   return (queries.size() == 0) ? get_number_files() : queries.size();
 }
 
+// Estimated number of points of a chunk. For a query it is the number of points of the files
+// that intersect the query, in proportion to the area of the intersection.
+double FileCollection::get_chunk_cost(int i) const
+{
+  if (queries.empty()) return (double)headers[i].number_of_point_records;
+
+  const Shape* q = queries[i];
+  double cost = 0;
+  for (int index : file_index.get_overlaps(q->xmin(), q->ymin(), q->xmax(), q->ymax()))
+  {
+    const Header& h = headers[index];
+    double area = (h.max_x - h.min_x) * (h.max_y - h.min_y);
+    double dx = std::min(h.max_x, q->xmax()) - std::max(h.min_x, q->xmin());
+    double dy = std::min(h.max_y, q->ymax()) - std::max(h.min_y, q->ymin());
+    double ratio = (area > 0) ? std::max(dx, 0.0) * std::max(dy, 0.0) / area : 1;
+    cost += h.number_of_point_records * std::min(ratio, 1.0);
+  }
+
+  return cost;
+}
+
+// Estimated memory in bytes to load a chunk with its buffer in a PointCloud: the records of the
+// points plus the spatial indexes. The size of the records is guessed from the point data format.
+double FileCollection::get_chunk_memory(int i) const
+{
+  static const int record_length[] = {20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67};
+  static const int index_size = 32; // kd-tree and grid partition, per point
+
+  double w, h;
+  int format = 0;
+  if (queries.empty())
+  {
+    w = headers[i].max_x - headers[i].min_x;
+    h = headers[i].max_y - headers[i].min_y;
+    format = headers[i].point_data_format;
+  }
+  else
+  {
+    w = queries[i]->xmax() - queries[i]->xmin();
+    h = queries[i]->ymax() - queries[i]->ymin();
+    if (!headers.empty()) format = headers[0].point_data_format;
+  }
+
+  // The buffer adds the points of a band around the chunk
+  double ratio = (w > 0 && h > 0) ? (w + 2*buffer) * (h + 2*buffer) / (w * h) : 1;
+  ratio = std::min(ratio, 9.0);
+
+  int size = (format <= 10) ? record_length[format] : record_length[0];
+  return get_chunk_cost(i) * ratio * (size + index_size);
+}
+
+// Order in which the chunks are processed. The outputs are reordered by chunk id anyway (see
+// Engine::sort()).
+// - When the chunks are buffered files, the files are visited row by row in a serpentine order,
+//   so that the neighbours of a file are processed close in time and their edge strips are still
+//   in the StripCache.
+// - Otherwise the chunks are processed by decreasing number of points so that the largest chunks
+//   do not end up alone at the end of the run while the other threads are idle.
+std::vector<int> FileCollection::get_schedule() const
+{
+  int n = get_number_chunks();
+  std::vector<int> order(n);
+  for (int i = 0 ; i < n ; i++) order[i] = i;
+
+  if (n < 3 || use_dataframe) return order;
+
+  if (!queries.empty() || buffer <= 0 || get_format() != LASFILE)
+  {
+    std::vector<double> cost(n);
+    for (int i = 0 ; i < n ; i++) cost[i] = get_chunk_cost(i);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return cost[a] > cost[b]; });
+    return order;
+  }
+
+  // Rows are as high as the median height of the files
+  std::vector<double> heights(n);
+  for (int i = 0 ; i < n ; i++) heights[i] = headers[i].max_y - headers[i].min_y;
+  std::nth_element(heights.begin(), heights.begin() + n/2, heights.end());
+  double height = heights[n/2];
+  if (height <= 0) return order;
+
+  std::vector<int> rows(n);
+  std::vector<double> cx(n);
+  for (int i = 0 ; i < n ; i++)
+  {
+    const Header& h = headers[i];
+    rows[i] = (int)std::floor(((h.min_y + h.max_y)/2 - ymin) / height);
+    cx[i] = (h.min_x + h.max_x)/2;
+  }
+
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+  {
+    if (rows[a] != rows[b]) return rows[a] < rows[b];
+    return (rows[a] % 2 == 0) ? cx[a] < cx[b] : cx[a] > cx[b];
+  });
+
+  return order;
+}
+
 int FileCollection::get_number_files() const
 {
   return files.size();
@@ -951,6 +1092,7 @@ void FileCollection::clear()
   headers.clear();
   noprocess.clear();
   files.clear();
+  file_index.clear();
 
   for (auto p : queries) delete p;
   queries.clear();
@@ -1021,6 +1163,7 @@ PathType FileCollection::parse_path(const std::string& path)
 
 FileCollection::FileCollection()
 {
+  ncpu = 1;
   clear();
 }
 
@@ -1028,36 +1171,3 @@ FileCollection::~FileCollection()
 {
   for (auto p : queries) delete p;
 }
-
-void FileCollectionIndex::add(double xmin, double ymin, double xmax, double ymax)
-{
-  bboxes.emplace_back(xmin, ymin, xmax, ymax);
-}
-
-bool FileCollectionIndex::has_overlap(double xmin, double ymin, double xmax, double ymax) const
-{
-  for (const auto& bbox : bboxes)
-  {
-    if (!(xmax < bbox.xmin() || xmin > bbox.xmax() || ymax < bbox.ymin() || ymin > bbox.ymax()))
-    {
-      return true;
-    }
-  }
-  return false;
-}
-
-std::vector<int> FileCollectionIndex::get_overlaps(double xmin, double ymin, double xmax, double ymax) const
-{
-  std::vector<int> overlaps;
-  for (size_t i = 0; i < bboxes.size(); ++i)
-  {
-    const auto& bbox = bboxes[i];
-
-    if (xmin <= bbox.xmax() && xmax >= bbox.xmin() && ymin <= bbox.ymax() && ymax >= bbox.ymin())
-    {
-      overlaps.push_back(i);
-    }
-  }
-
-  return overlaps;
-}
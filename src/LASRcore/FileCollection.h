@@ -7,6 +7,7 @@
 #include "Chunk.h"
 #include "Shape.h"
 #include "Header.h"
+#include "FileCollectionIndex.h"
 
 #include <string>
 #include <vector>
@@ -15,18 +16,7 @@
 enum PathType {DIRECTORY, VPCFILE, LASFILE, LAXFILE, PCDFILE, OTHERFILE, MISSINGFILE, UNKNOWNFILE, DATAFRAME, XPTR, REMOTELASFILE, EPTFILE, REMOTEEPTFILE};
 
 class Header;
-
-class FileCollectionIndex
-{
-private:
-  std::vector<Rectangle> bboxes;
-
-public:
-  void add(double xmin, double ymin, double xmax, double ymax);
-  bool has_overlap(double xmin, double ymin, double xmax, double ymax) const;
-  std::vector<int> get_overlaps(double xmin, double ymin, double xmax, double ymax) const;
-};
-
+class Progress;
 
 class FileCollection
 {
@@ -37,12 +27,17 @@ public:
   bool write_vpc(const std::string& file, const CRS& crs, bool absolute_path, bool use_gpstime);
   bool is_source_vpc() { return use_vpc; };
   void set_buffer(double buffer) { this->buffer = buffer; };
+  void set_ncpu(int ncpu) { this->ncpu = ncpu; };
+  void set_header_cache(const std::string& file) { header_cache = file; };
   void add_query(double xmin, double ymin, double xmax, double ymax);
   void add_query(double xcenter, double ycenter, double radius);
   bool set_noprocess(const std::vector<bool>& b);
   bool set_chunk_size(double size);
   bool get_chunk(int index, Chunk& chunk) const;
   int get_number_chunks() const;
+  std::vector<int> get_schedule() const;
+  double get_chunk_cost(int index) const;
+  double get_chunk_memory(int index) const;
   int get_number_files() const;
   int get_number_indexed_files() const;
   PathType get_format() const;
@@ -67,7 +62,7 @@ public:
 private:
   bool read_vpc(const std::string& file);
   bool add_las_file(std::string file, bool noprocess = false);
-  bool add_pcd_file(std::string file, bool noprocess = false);
+  bool add_files(std::vector<std::pair<std::string, PathType>>& entries, Progress& pb, bool noprocess = false);
   bool add_ept_endpoint(std::string path, bool noprocess = false);
   bool add_header(const Header& header, bool noprocess = false);
   bool get_chunk_regular(int index, Chunk& chunk) const;
@@ -93,6 +88,10 @@ private:
   double buffer;
   double chunk_size;
 
+  // reading the headers
+  int ncpu;
+  std::string header_cache; // optional file caching the headers between runs
+
   // information about each file
   std::vector<Header> headers;
   std::vector<std::filesystem::path> files; // path to files
@@ -0,0 +1,175 @@
+#include "FileCollectionIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+FileCollectionIndex::FileCollectionIndex() : built(false)
+{
+}
+
+FileCollectionIndex::FileCollectionIndex(const FileCollectionIndex& other) : boxes(other.boxes), built(false)
+{
+}
+
+FileCollectionIndex& FileCollectionIndex::operator=(const FileCollectionIndex& other)
+{
+  if (this != &other)
+  {
+    boxes = other.boxes;
+    order.clear();
+    levels.clear();
+    built = false;
+  }
+  return *this;
+}
+
+void FileCollectionIndex::add(double xmin, double ymin, double xmax, double ymax)
+{
+  boxes.push_back({xmin, ymin, xmax, ymax});
+  built = false;
+}
+
+void FileCollectionIndex::clear()
+{
+  boxes.clear();
+  order.clear();
+  levels.clear();
+  built = false;
+}
+
+// Sort-Tile-Recursive packing of one level: the items are sorted by x, cut in vertical slices of
+// S nodes, each slice is sorted by y and cut in nodes of 'node_capacity' items. 'items' are
+// reordered so that the children of each node are contiguous.
+void FileCollectionIndex::pack(std::vector<int>& items, const std::vector<Box>& bboxes, std::vector<Node>& level)
+{
+  auto cx = [&](int i) { return bboxes[i].xmin + bboxes[i].xmax; };
+  auto cy = [&](int i) { return bboxes[i].ymin + bboxes[i].ymax; };
+
+  size_t n = items.size();
+  size_t nnodes = (n + node_capacity - 1) / node_capacity;
+  size_t nslices = (size_t)std::ceil(std::sqrt((double)nnodes));
+  size_t slice_size = nslices * node_capacity;
+
+  std::sort(items.begin(), items.end(), [&](int a, int b) { return cx(a) < cx(b); });
+
+  for (size_t start = 0 ; start < n ; start += slice_size)
+  {
+    size_t end = std::min(start + slice_size, n);
+    std::sort(items.begin() + start, items.begin() + end, [&](int a, int b) { return cy(a) < cy(b); });
+  }
+
+  level.clear();
+  level.reserve(nnodes);
+  for (size_t first = 0 ; first < n ; first += node_capacity)
+  {
+    size_t last = std::min(first + node_capacity, n);
+
+    Node node;
+    node.first = (int)first;
+    node.count = (int)(last - first);
+    node.bbox = bboxes[items[first]];
+    for (size_t k = first + 1 ; k < last ; k++)
+    {
+      const Box& b = bboxes[items[k]];
+      node.bbox.xmin = std::min(node.bbox.xmin, b.xmin);
+      node.bbox.ymin = std::min(node.bbox.ymin, b.ymin);
+      node.bbox.xmax = std::max(node.bbox.xmax, b.xmax);
+      node.bbox.ymax = std::max(node.bbox.ymax, b.ymax);
+    }
+    level.push_back(node);
+  }
+}
+
+void FileCollectionIndex::build() const
+{
+  if (built) return;
+
+  #pragma omp critical (filecollectionindex)
+  {
+    if (!built)
+    {
+      levels.clear();
+      order.resize(boxes.size());
+      for (size_t i = 0 ; i < boxes.size() ; i++) order[i] = i;
+
+      if (!boxes.empty())
+      {
+        levels.emplace_back();
+        pack(order, boxes, levels.back());
+
+        // Pack the nodes of each level until there is a single root
+        while (levels.back().size() > 1)
+        {
+          std::vector<Node>& lower = levels.back();
+
+          std::vector<Box> bboxes(lower.size());
+          std::vector<int> items(lower.size());
+          for (size_t i = 0 ; i < lower.size() ; i++) { bboxes[i] = lower[i].bbox; items[i] = i; }
+
+          std::vector<Node> upper;
+          pack(items, bboxes, upper);
+
+          // Reorder the lower level to make the children of each node contiguous
+          std::vector<Node> sorted(lower.size());
+          for (size_t i = 0 ; i < items.size() ; i++) sorted[i] = lower[items[i]];
+          lower.swap(sorted);
+
+          levels.push_back(std::move(upper));
+        }
+      }
+
+      built = true;
+    }
+  }
+}
+
+// Depth first traversal. 'visit' is called with the index of each box that intersects the query
+// and returns false to stop the traversal.
+template<typename Visitor>
+void FileCollectionIndex::query(double xmin, double ymin, double xmax, double ymax, Visitor visit) const
+{
+  build();
+
+  if (levels.empty()) return;
+
+  // (level, node) pairs to visit
+  std::vector<std::pair<int,int>> stack;
+  stack.emplace_back((int)levels.size() - 1, 0);
+
+  while (!stack.empty())
+  {
+    auto [l, i] = stack.back();
+    stack.pop_back();
+
+    const Node& node = levels[l][i];
+    if (!node.bbox.intersects(xmin, ymin, xmax, ymax)) continue;
+
+    for (int k = node.first ; k < node.first + node.count ; k++)
+    {
+      if (l > 0)
+      {
+        stack.emplace_back(l - 1, k);
+      }
+      else
+      {
+        int index = order[k];
+        if (boxes[index].intersects(xmin, ymin, xmax, ymax) && !visit(index)) return;
+      }
+    }
+  }
+}
+
+bool FileCollectionIndex::has_overlap(double xmin, double ymin, double xmax, double ymax) const
+{
+  bool found = false;
+  query(xmin, ymin, xmax, ymax, [&](int) { found = true; return false; });
+  return found;
+}
+
+std::vector<int> FileCollectionIndex::get_overlaps(double xmin, double ymin, double xmax, double ymax) const
+{
+  std::vector<int> overlaps;
+  query(xmin, ymin, xmax, ymax, [&](int index) { overlaps.push_back(index); return true; });
+  std::sort(overlaps.begin(), overlaps.end()); // Same order as the files
+  return overlaps;
+}
@@ -0,0 +1,51 @@
+#ifndef FILECOLLECTIONINDEX_H
+#define FILECOLLECTIONINDEX_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// Spatial index of the bounding boxes of the files of a FileCollection. Boxes are added one by one
+// while the collection is read. On the first query the boxes are bulk loaded in a static packed
+// R-tree with the Sort-Tile-Recursive algorithm. Adding a box after a query invalidates the tree
+// that is rebuilt on the next query. Queries are thread safe (the tree is built once under a lock
+// and then read only). Bounding boxes are closed: touching boxes overlap.
+class FileCollectionIndex
+{
+public:
+  FileCollectionIndex();
+  FileCollectionIndex(const FileCollectionIndex& other);
+  FileCollectionIndex& operator=(const FileCollectionIndex& other);
+  void add(double xmin, double ymin, double xmax, double ymax);
+  bool has_overlap(double xmin, double ymin, double xmax, double ymax) const;
+  std::vector<int> get_overlaps(double xmin, double ymin, double xmax, double ymax) const; // Sorted indexes
+  void build() const;
+  void clear();
+  size_t size() const { return boxes.size(); };
+
+private:
+  struct Box
+  {
+    double xmin, ymin, xmax, ymax;
+    inline bool intersects(double x0, double y0, double x1, double y1) const { return x0 <= xmax && x1 >= xmin && y0 <= ymax && y1 >= ymin; }
+  };
+
+  struct Node
+  {
+    Box bbox;
+    int first;  // First child in the level below (or first entry in 'order' for the leaves)
+    int count;  // Number of children
+  };
+
+  template<typename Visitor> void query(double xmin, double ymin, double xmax, double ymax, Visitor visit) const;
+  static void pack(std::vector<int>& items, const std::vector<Box>& bboxes, std::vector<Node>& level);
+
+  static constexpr int node_capacity = 16;
+
+  std::vector<Box> boxes;                  // Bounding boxes of the files in insertion order
+  mutable std::vector<int> order;          // Indexes of the boxes in leaf order
+  mutable std::vector<std::vector<Node>> levels; // levels[0] are the leaves, levels.back() the root
+  mutable std::atomic<bool> built;
+};
+
+#endif
@@ -2,35 +2,57 @@
 
 GridPartition::GridPartition(double xmin, double ymin, double xmax, double ymax, double res) : Grid(xmin, ymin, xmax, ymax, res)
 {
-  npoints = 0;
 }
 
-/*GridPartition::GridPartition(double xmin, double ymin, double xmax, double ymax, int nrows, int ncols) : Grid(xmin, ymin, xmax, ymax, nrows, ncols)
+GridPartition* GridPartition::create(double xmin, double ymin, double xmax, double ymax, double res, uint64_t npoints)
+{
+  if (Grouper32::fits(npoints))
+    return new GridPartition32(xmin, ymin, xmax, ymax, res);
+  else
+    return new GridPartition64(xmin, ymin, xmax, ymax, res);
+}
+
+template<typename Index>
+GridPartitionT<Index>::GridPartitionT(double xmin, double ymin, double xmax, double ymax, double res) : GridPartition(xmin, ymin, xmax, ymax, res)
+{
+  this->npoints = 0;
+}
+
+/*template<typename Index>
+GridPartitionT<Index>::GridPartitionT(double xmin, double ymin, double xmax, double ymax, int nrows, int ncols) : Grid(xmin, ymin, xmax, ymax, nrows, ncols)
 {
   npoints = 0;
 }*/
 
-bool GridPartition::insert(double x, double y)
+template<typename Index>
+bool GridPartitionT<Index>::insert(double x, double y)
 {
+  // A point outside the grid is recorded anyway with the key -1 to keep the indexes in sync
   int key = cell_from_xy(x, y);
-  if (key == -1) return false;
-  return Grouper::insert(key);
+  GrouperT<Index>::insert(key);
+  return key != -1;
 }
 
-void GridPartition::query(double xmin, double ymin, double xmax, double ymax, std::vector<Interval>& res) const
+template<typename Index>
+void GridPartitionT<Index>::build(int ncpu)
+{
+  GrouperT<Index>::build(ncpu);
+}
+
+template<typename Index>
+void GridPartitionT<Index>::build(std::vector<int>& cells, int ncpu)
+{
+  GrouperT<Index>::assign(cells);
+  GrouperT<Index>::build(ncpu);
+}
+
+template<typename Index>
+void GridPartitionT<Index>::query(double xmin, double ymin, double xmax, double ymax, std::vector<Interval>& res) const
 {
   std::vector<int> cells;
   get_cells(xmin, ymin, xmax, ymax, cells);
 
-  for (int cell : cells)
-  {
-    auto _it = map.find(cell);
-    if (_it == map.end()) continue;
-    for (auto it = _it->second.begin() ; it != _it->second.end() ; it++)
-    {
-      res.push_back({it->start, it->end});
-    }
-  }
+  for (int cell : cells) this->intervals(cell, res);
 }
 
 double GridPartition::guess_resolution_from_density(double density)
@@ -45,12 +67,5 @@ double GridPartition::guess_resolution_from_density(double density)
   return res;
 }
 
-/*void GridPartition::query(int cell, std::vector<Interval>& res) const
-{
-  auto _it = map.find(cell);
-  if (_it == map.end()) return;
-  for (auto it = _it->second.begin() ; it != _it->second.end() ; it++)
-  {
-    res.push_back({it->start, it->end});
-  }
-}*/
\ No newline at end of file
+template class GridPartitionT<uint32_t>;
+template class GridPartitionT<uint64_t>;
@@ -8,15 +8,35 @@
 
 class LASpoint;
 
-class GridPartition : public Grouper, public Grid
+class GridPartition : public Grid
 {
 public:
   GridPartition(double xmin, double ymin, double xmax, double ymax, double res);
-  //GridPartition(double xmin, double ymin, double xmax, double ymax, int nrows, int ncols);
-  bool insert(double x, double y);
-  void query(double xmin, double ymin, double xmax, double ymax, std::vector<Interval>& res) const;
+  virtual ~GridPartition() = default;
+  // Points are inserted in their order. The partition must be built before to be queried.
+  virtual bool insert(double x, double y) = 0;
+  virtual void build(int ncpu = 1) = 0;
+  virtual void build(std::vector<int>& cells, int ncpu = 1) = 0; // One cell per point (-1 if outside). cells is consumed.
+  virtual void query(double xmin, double ymin, double xmax, double ymax, std::vector<Interval>& res) const = 0;
   static double guess_resolution_from_density(double density);
+  // Allocate the compact 32-bit partition if npoints fits in 32 bits and the 64-bit one otherwise
+  static GridPartition* create(double xmin, double ymin, double xmax, double ymax, double res, uint64_t npoints);
+};
+
+template<typename Index>
+class GridPartitionT : public GridPartition, public GrouperT<Index>
+{
+public:
+  GridPartitionT(double xmin, double ymin, double xmax, double ymax, double res);
+  //GridPartitionT(double xmin, double ymin, double xmax, double ymax, int nrows, int ncols);
+  bool insert(double x, double y) override;
+  void build(int ncpu = 1) override;
+  void build(std::vector<int>& cells, int ncpu = 1) override;
+  void query(double xmin, double ymin, double xmax, double ymax, std::vector<Interval>& res) const override;
   //void query(int cell, std::vector<Interval>& res) const;
 };
 
+typedef GridPartitionT<uint32_t> GridPartition32;
+typedef GridPartitionT<uint64_t> GridPartition64;
+
 #endif
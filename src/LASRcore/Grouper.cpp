@@ -1,92 +1,163 @@
 #include "Grouper.h"
+#include "openmp.h"
 
 #include <algorithm>
 
-inline bool sort_range(const Interval& a, const Interval& b) { return a.start < b.start; }
-
-Grouper::Grouper()
+template<typename Index>
+GrouperT<Index>::GrouperT()
 {
   npoints = 0;
 }
 
-bool Grouper::insert(int key)
+template<typename Index>
+bool GrouperT<Index>::insert(int key)
 {
-  std::vector<Interval>& ranges = map[key];
+  keys.push_back(key);
+  if (!owners.empty()) owners.push_back(npoints);
+  npoints++;
+  return true;
+}
 
-  if (ranges.size() == 0)
+template<typename Index>
+bool GrouperT<Index>::insert(const std::vector<int>& keys)
+{
+  // Most of the time a point belongs to a single group. The owners of the pairs are recorded
+  // only when it is no longer the case.
+  if (owners.empty())
   {
-    ranges.push_back({npoints, npoints});
+    if (keys.size() == 1) return insert(keys[0]);
+    if (keys.size() == 0) return insert(-1);
+
+    owners.resize(this->keys.size());
+    for (size_t i = 0 ; i < owners.size() ; i++) owners[i] = (Index)i;
   }
-  else
+
+  for (int key : keys)
   {
-    Interval& interval = ranges.back();
-    if (interval.end == npoints - 1)
-    {
-      interval.end = npoints;
-    }
-    else
-    {
-      ranges.push_back({npoints, npoints});
-    }
+    this->keys.push_back(key);
+    owners.push_back(npoints);
   }
 
   npoints++;
   return true;
 }
 
-bool Grouper::insert(const std::vector<int>& keys)
+template<typename Index>
+void GrouperT<Index>::assign(std::vector<int>& keys)
 {
-  for (int key: keys)
-  {
-    insert(key);
-    npoints--;
-  }
-
-  npoints++;
-  return true;
+  this->keys.swap(keys);
+  keys.clear();
+  owners.clear();
+  npoints = (Index)this->keys.size();
 }
 
-int Grouper::largest_group_size()
+template<typename Index>
+void GrouperT<Index>::build(int ncpu)
 {
-  int max = 0;
-  for (const auto& pair : map)
+  const size_t npairs = keys.size();
+
+  int max_key = -1;
+  for (int key : keys) if (key > max_key) max_key = key;
+  size_t ngroups = (size_t)(max_key + 1);
+
+  offsets.assign(ngroups+1, 0);
+  indexes.clear();
+
+  if (ngroups == 0)
   {
-    int sum = 0;
-    for (const auto& interval : pair.second) sum += (interval.end - interval.start) + 1;
-    if (sum >= max) max = sum;
+    keys.clear();
+    owners.clear();
+    return;
   }
 
-  return max;
-}
+  // Each thread counts the group ids of a contiguous range of pairs and scatters its range at
+  // offsets computed from the counts of all the threads, so the indexes stay sorted in each group
+  // whatever the number of threads. The per thread counts cost ngroups integers per thread: more
+  // threads than pairs per group is not worth it.
+  int nthreads = (int)std::min<size_t>({(size_t)std::max(ncpu, 1), npairs/ngroups, npairs/65536 + 1});
+  if (nthreads < 1) nthreads = 1;
 
-/*void Grouper::merge_intervals(std::vector<Interval>& x)
-{
-  if (x.size() < 2) return;
-  std::sort(x.begin(), x.end(), sort_range);
-  std::vector<Interval> ans;
-  ans.reserve(x.size()/2);
-  Interval prev = x[0];
+  std::vector<size_t> counts((size_t)nthreads*ngroups, 0);
+  int nt = 1;
 
-  for (size_t i = 1 ; i < x.size() ; i++)
+  #pragma omp parallel num_threads(nthreads)
   {
-    Interval current = x[i];
-    if ((current.start-prev.end) <= 1)
+    #pragma omp single
+    nt = omp_get_num_threads();
+
+    int t = omp_get_thread_num();
+    size_t begin = npairs*t/nt;
+    size_t end = npairs*(t+1)/nt;
+    size_t* count = &counts[(size_t)t*ngroups];
+
+    for (size_t i = begin ; i < end ; i++)
+    {
+      if (keys[i] >= 0) count[keys[i]]++;
+    }
+
+    #pragma omp barrier
+    #pragma omp single
     {
-      prev.end = current.end;
+      size_t sum = 0;
+      for (size_t g = 0 ; g < ngroups ; g++)
+      {
+        offsets[g] = sum;
+        for (int k = 0 ; k < nt ; k++)
+        {
+          size_t c = counts[(size_t)k*ngroups+g];
+          counts[(size_t)k*ngroups+g] = sum;
+          sum += c;
+        }
+      }
+      offsets[ngroups] = sum;
+      indexes.resize(sum);
     }
-    else
+
+    for (size_t i = begin ; i < end ; i++)
     {
-      ans.push_back(prev);
-      prev = current;
+      int key = keys[i];
+      if (key < 0) continue;
+      indexes[count[key]++] = (owners.empty()) ? (Index)i : owners[i];
     }
   }
 
-  ans.push_back(prev);
-  x.swap(ans);
-}*/
+  // The pairs are no longer needed
+  std::vector<int>().swap(keys);
+  std::vector<Index>().swap(owners);
+}
 
-void Grouper::clear()
+template<typename Index>
+void GrouperT<Index>::groups(std::vector<int>& keys) const
 {
-  map.clear();
+  keys.clear();
+  for (size_t g = 0 ; g < ngroups() ; g++)
+  {
+    if (offsets[g+1] > offsets[g]) keys.push_back((int)g);
+  }
+}
+
+template<typename Index>
+uint64_t GrouperT<Index>::largest_group_size() const
+{
+  uint64_t max = 0;
+  for (size_t g = 0 ; g < ngroups() ; g++)
+  {
+    uint64_t n = offsets[g+1] - offsets[g];
+    if (n > max) max = n;
+  }
+
+  return max;
+}
+
+template<typename Index>
+void GrouperT<Index>::clear()
+{
+  std::vector<int>().swap(keys);
+  std::vector<Index>().swap(owners);
+  std::vector<size_t>().swap(offsets);
+  std::vector<Index>().swap(indexes);
   npoints = 0;
-}
\ No newline at end of file
+}
+
+template class GrouperT<uint32_t>;
+template class GrouperT<uint64_t>;
@@ -4,21 +4,74 @@
 #include "Interval.h"
 
 #include <vector>
-#include <unordered_map>
+#include <limits>
+#include <cstddef>
 
-class Grouper
+// A Grouper assigns the points, in their order of insertion, to one or several groups identified
+// by a non negative integer (typically the cell of a grid). Negative ids (e.g. outside the grid)
+// are ignored. After build() the groups are stored in compressed sparse row format: the indexes of
+// the points of the group k are indexes[offsets[k]] to indexes[offsets[k+1]-1] in increasing order.
+// build() is a counting sort of the group ids, so there is one allocation for the whole partition
+// and no hashing, whatever the order of the points.
+//
+// Index is the storage type of the point indexes. Use GrouperT<uint32_t> when the number of
+// points fits in 32 bits (see fits()) and GrouperT<uint64_t> otherwise.
+template<typename Index>
+class GrouperT
 {
 public:
-  Grouper();
+  GrouperT();
   bool insert(int key);
   bool insert(const std::vector<int>& keys);
-  //void merge_intervals(std::vector<Interval>& x);
+  void assign(std::vector<int>& keys); // One key per point. keys is consumed.
+  void build(int ncpu = 1);
   void clear();
-  int largest_group_size();
+  uint64_t largest_group_size() const;
+  static bool fits(uint64_t npoints) { return npoints <= (uint64_t)std::numeric_limits<Index>::max(); }
+
+  // Access to the groups (after build)
+  inline size_t ngroups() const { return (offsets.size() > 0) ? offsets.size() - 1 : 0; }
+  inline size_t group_size(int key) const { return (key >= 0 && (size_t)key < ngroups()) ? offsets[key+1] - offsets[key] : 0; }
+  inline const Index* group(int key) const { return indexes.data() + offsets[key]; }
+  void groups(std::vector<int>& keys) const; // Ids of the non empty groups
+  template<typename Other> void intervals(int key, std::vector<IntervalT<Other>>& res) const; // Consecutive indexes are merged
 
 public:
-  int npoints;
-  std::unordered_map<int, std::vector<Interval>> map;
+  Index npoints;
+
+protected:
+  std::vector<int> keys;       // Group id of each (point, group) pair inserted (until build)
+  std::vector<Index> owners;   // Point index of each pair. Empty if each point belongs to exactly one group
+  std::vector<size_t> offsets;
+  std::vector<Index> indexes;
 };
 
+template<typename Index>
+template<typename Other>
+void GrouperT<Index>::intervals(int key, std::vector<IntervalT<Other>>& res) const
+{
+  size_t n = group_size(key);
+  if (n == 0) return;
+
+  const Index* idx = group(key);
+  IntervalT<Other> interval(idx[0], idx[0]);
+  for (size_t i = 1 ; i < n ; i++)
+  {
+    if ((Other)idx[i] == interval.end + 1)
+    {
+      interval.end = idx[i];
+    }
+    else
+    {
+      res.push_back(interval);
+      interval = IntervalT<Other>(idx[i], idx[i]);
+    }
+  }
+  res.push_back(interval);
+}
+
+typedef GrouperT<uint32_t> Grouper32;
+typedef GrouperT<uint64_t> Grouper64;
+typedef Grouper64 Grouper;
+
 #endif
@@ -0,0 +1,166 @@
+#include "HeaderCache.h"
+#include "Header.h"
+
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#define HEADERCACHEVERSION 1
+
+HeaderCache::HeaderCache()
+{
+  entries = nlohmann::json::object();
+  modified = false;
+}
+
+bool HeaderCache::load(const std::string& file)
+{
+  std::ifstream f(file);
+  if (!f.good()) return false;
+
+  try
+  {
+    nlohmann::json json = nlohmann::json::parse(f);
+    if (json.value("version", 0) != HEADERCACHEVERSION || !json.contains("files")) return false;
+    entries = json["files"];
+  }
+  catch (const std::exception&)
+  {
+    // A corrupted cache is ignored and will be overwritten
+    entries = nlohmann::json::object();
+    return false;
+  }
+
+  return true;
+}
+
+bool HeaderCache::save(const std::string& file) const
+{
+  nlohmann::json json;
+  json["version"] = HEADERCACHEVERSION;
+  json["files"] = entries;
+
+  // Written in a temporary file then renamed so a concurrent run never reads a partial cache
+  std::string tmp = file + ".tmp";
+  {
+    std::ofstream f(tmp);
+    if (!f.good()) return false;
+    f << json.dump();
+    if (!f.good()) return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp, file, ec);
+  return !ec;
+}
+
+bool HeaderCache::stat(const std::string& path, uint64_t& size, int64_t& mtime, int64_t& lax_mtime)
+{
+  std::error_code ec;
+  std::filesystem::path p(path);
+
+  size = std::filesystem::file_size(p, ec);
+  if (ec) return false;
+
+  mtime = std::filesystem::last_write_time(p, ec).time_since_epoch().count();
+  if (ec) return false;
+
+  // The spatial index of the file is part of the header
+  lax_mtime = 0;
+  std::filesystem::path lax = p;
+  lax.replace_extension(".lax");
+  if (std::filesystem::exists(lax, ec))
+    lax_mtime = std::filesystem::last_write_time(lax, ec).time_since_epoch().count();
+
+  return true;
+}
+
+bool HeaderCache::get(const std::string& path, Header& header) const
+{
+  auto it = entries.find(path);
+  if (it == entries.end()) return false;
+
+  uint64_t size;
+  int64_t mtime, lax_mtime;
+  if (!stat(path, size, mtime, lax_mtime)) return false;
+
+  const nlohmann::json& e = *it;
+
+  try
+  {
+    if (e.at("size").get<uint64_t>() != size || e.at("mtime").get<int64_t>() != mtime || e.at("lax_mtime").get<int64_t>() != lax_mtime)
+      return false;
+
+    header.signature = e.at("signature").get<std::string>();
+    header.version_major = e.at("version")[0].get<int>();
+    header.version_minor = e.at("version")[1].get<int>();
+    header.point_data_format = e.at("format").get<int>();
+    header.number_of_point_records = e.at("npoints").get<uint64_t>();
+    header.spatial_index = e.at("indexed").get<bool>();
+
+    const auto& bbox = e.at("bbox");
+    header.min_x = bbox[0]; header.min_y = bbox[1]; header.min_z = bbox[2];
+    header.max_x = bbox[3]; header.max_y = bbox[4]; header.max_z = bbox[5];
+
+    const auto& scale = e.at("scale");
+    const auto& offset = e.at("offset");
+    header.x_scale_factor = scale[0]; header.y_scale_factor = scale[1]; header.z_scale_factor = scale[2];
+    header.x_offset = offset[0]; header.y_offset = offset[1]; header.z_offset = offset[2];
+
+    header.gpstime = e.at("gpstime").get<double>();
+    header.adjusted_standard_gps_time = e.at("adjusted_gpstime").get<bool>();
+    header.file_creation_year = e.at("date")[0].get<int>();
+    header.file_creation_day = e.at("date")[1].get<int>();
+
+    // CRS are built from an EPSG code when it is how they were read to get identical CRS
+    int epsg = e.value("epsg", 0);
+    std::string wkt = e.value("wkt", "");
+    if (epsg != 0)
+      header.set_crs(epsg);
+    else if (!wkt.empty())
+      header.set_crs(wkt);
+  }
+  catch (const std::exception&)
+  {
+    return false;
+  }
+
+  return true;
+}
+
+void HeaderCache::set(const std::string& path, const Header& header)
+{
+  uint64_t size;
+  int64_t mtime, lax_mtime;
+  if (!stat(path, size, mtime, lax_mtime)) return;
+
+  nlohmann::json e;
+  e["size"] = size;
+  e["mtime"] = mtime;
+  e["lax_mtime"] = lax_mtime;
+  e["signature"] = header.signature;
+  e["version"] = { (int)header.version_major, (int)header.version_minor };
+  e["format"] = (int)header.point_data_format;
+  e["npoints"] = header.number_of_point_records;
+  e["indexed"] = header.spatial_index;
+  e["bbox"] = { header.min_x, header.min_y, header.min_z, header.max_x, header.max_y, header.max_z };
+  e["scale"] = { header.x_scale_factor, header.y_scale_factor, header.z_scale_factor };
+  e["offset"] = { header.x_offset, header.y_offset, header.z_offset };
+  e["gpstime"] = header.gpstime;
+  e["adjusted_gpstime"] = header.adjusted_standard_gps_time;
+  e["date"] = { (int)header.file_creation_year, (int)header.file_creation_day };
+
+  #ifdef USING_GDAL
+  int epsg = header.crs.get_epsg();
+  if (epsg != 0 && CRS(epsg) == header.crs)
+    e["epsg"] = epsg;
+  else
+    e["wkt"] = header.crs.get_wkt();
+  #else
+  e["epsg"] = header.epsg;
+  e["wkt"] = header.wkt;
+  #endif
+
+  entries[path] = e;
+  modified = true;
+}
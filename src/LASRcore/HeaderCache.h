@@ -0,0 +1,31 @@
+#ifndef HEADERCACHE_H
+#define HEADERCACHE_H
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+class Header;
+
+// Persistent cache of the headers of the files of a FileCollection stored in a JSON file. An
+// entry is valid as long as the size and the modification time of the file (and of its .lax
+// spatial index) did not change. Only the fields of the header used by the FileCollection are
+// cached: the bounding box, the number of points, the spatial index, the CRS and the fields used
+// by write_vpc(). The readers still read the full header of the files they process.
+class HeaderCache
+{
+public:
+  HeaderCache();
+  bool load(const std::string& file);
+  bool save(const std::string& file) const;
+  bool get(const std::string& path, Header& header) const;
+  void set(const std::string& path, const Header& header);
+  bool is_modified() const { return modified; };
+
+private:
+  static bool stat(const std::string& path, uint64_t& size, int64_t& mtime, int64_t& lax_mtime);
+
+  nlohmann::json entries;
+  bool modified;
+};
+
+#endif
@@ -1,12 +1,22 @@
 #ifndef INTERVAL_H
 #define INTERVAL_H
 
-struct Interval
+#include <cstdint>
+
+// Inclusive range [start, end] of point indexes. The public API uses 64-bit indexes. The compact
+// 32-bit version is the storage type of the spatial indexes when the point cloud is small enough,
+// which is the case for most tiles, so the memory footprint stays the same than with int.
+template<typename Index>
+struct IntervalT
 {
-  Interval() : start(0), end(0) {};
-  Interval(int start, int end) : start(start), end(end) {};
-  int start;
-  int end;
+  IntervalT() : start(0), end(0) {};
+  IntervalT(Index start, Index end) : start(start), end(end) {};
+  template<typename Other> IntervalT(const IntervalT<Other>& other) : start(other.start), end(other.end) {};
+  Index start;
+  Index end;
 };
 
-#endif
\ No newline at end of file
+typedef IntervalT<uint64_t> Interval;
+typedef IntervalT<uint32_t> Interval32;
+
+#endif
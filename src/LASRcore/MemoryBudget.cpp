@@ -0,0 +1,83 @@
+#include "MemoryBudget.h"
+
+#include <atomic>
+#include <chrono>
+
+static thread_local int64_t thread_current = 0;
+static thread_local int64_t thread_peak = 0;
+static std::atomic<int64_t> global_current(0);
+static std::atomic<int64_t> global_max(0);
+
+void MemoryTracker::add(int64_t bytes)
+{
+  thread_current += bytes;
+  if (thread_current > thread_peak) thread_peak = thread_current;
+
+  int64_t total = global_current += bytes;
+  int64_t max = global_max.load();
+  while (total > max && !global_max.compare_exchange_weak(max, total));
+}
+
+void MemoryTracker::reset_peak()
+{
+  thread_peak = thread_current;
+}
+
+int64_t MemoryTracker::current()
+{
+  return thread_current;
+}
+
+int64_t MemoryTracker::peak()
+{
+  return thread_peak;
+}
+
+int64_t MemoryTracker::global_peak()
+{
+  return global_max;
+}
+
+MemoryBudget::MemoryBudget(uint64_t capacity)
+{
+  this->capacity = capacity;
+  used = 0;
+  peak = 0;
+  waits = 0;
+  next_ticket = 0;
+  serving = 0;
+}
+
+float MemoryBudget::acquire(uint64_t bytes)
+{
+  auto t0 = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  uint64_t ticket = next_ticket++;
+
+  auto ready = [&]() { return ticket == serving && (used == 0 || used + bytes <= capacity); };
+  if (!ready())
+  {
+    waits++;
+    cv.wait(lock, ready);
+  }
+
+  used += bytes;
+  if (used > peak) peak = used;
+  serving++;
+  lock.unlock();
+
+  // The next ticket may fit in the remaining memory
+  cv.notify_all();
+
+  return std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void MemoryBudget::release(uint64_t bytes)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    used -= bytes;
+  }
+  cv.notify_all();
+}
@@ -0,0 +1,58 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+// Bytes allocated by the point clouds. Each thread counts what it allocates and frees so that the
+// thread that processes a chunk can measure the peak memory of this chunk. A global counter gives
+// the peak of the whole process. Only the buffers of the points are tracked.
+struct MemoryTracker
+{
+  static void add(int64_t bytes);
+  static void reset_peak();        // The peak of the calling thread becomes its current usage
+  static int64_t current();        // Bytes currently allocated by the calling thread
+  static int64_t peak();           // Peak of the calling thread since the last reset_peak()
+  static int64_t global_peak();    // Peak of all the threads
+};
+
+// Memory shared by the threads that process chunks concurrently. Before loading a chunk a thread
+// reserves the estimated memory of the chunk and waits until the other threads released enough
+// memory to stay under the capacity. Reservations are served in order so a large chunk is not
+// starved by smaller ones. A chunk larger than the capacity is processed alone.
+class MemoryBudget
+{
+public:
+  MemoryBudget(uint64_t capacity);
+  float acquire(uint64_t bytes); // Returns the time spent waiting in seconds
+  void release(uint64_t bytes);
+  uint64_t get_capacity() const { return capacity; };
+  uint64_t get_peak() const { return peak; };
+  uint64_t get_waits() const { return waits; };
+
+  // Reservation released automatically at the end of the scope, even if the chunk failed
+  class Reservation
+  {
+  public:
+    Reservation(MemoryBudget& budget, uint64_t bytes) : budget(budget), bytes(bytes) { wait = budget.acquire(bytes); };
+    ~Reservation() { budget.release(bytes); };
+    float wait;
+
+  private:
+    MemoryBudget& budget;
+    uint64_t bytes;
+  };
+
+private:
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint64_t capacity;
+  uint64_t used;
+  uint64_t peak;
+  uint64_t waits;
+  uint64_t next_ticket;
+  uint64_t serving;
+};
+
+#endif
@@ -12,26 +12,50 @@ bool MetricManager::parse(const std::vector<std::string>& names, bool support_st
 {
   streaming_operators.clear();
   regular_operators.clear();
+  fused_attributes.clear();
+  fused_metrics.clear();
+  this->names.clear();
+  streamable = false;
+  stateless = false;
+  state_size = 0;
 
   if (names.size() == 0) return true;
 
-  // Check if we have only streamable MetricManager
+  try
+  {
+    for (const auto& name : names)
+    {
+      add_fused(name);
+      this->names.push_back(name);
+    }
+  }
+  catch(std::exception& e)
+  {
+    last_error = e.what();
+    return false;
+  }
+
+  // Check if we have only streamable metrics
   if (support_streamable)
   {
-    streamable = true;
+    streamable = build_state();
+
+    stateless = true;
     for (const auto& name : names)
     {
       if (name != "max" && name != "min" && name != "count" && name != "z_max" && name != "z_min")
       {
-        streamable = false;
+        stateless = false;
         break;
       }
     }
   }
 
-  // If we have only streamable MetricManager
+  // If we have only streamable metrics
   if (streamable)
   {
+    if (!stateless) return true;
+
     for (const auto& name : names)
     {
       if (name == "max" || name == "z_max")
@@ -40,8 +64,6 @@ bool MetricManager::parse(const std::vector<std::string>& names, bool support_st
         streaming_operators.push_back(&MetricManager::pmin);
       else if (name == "count")
         streaming_operators.push_back(&MetricManager::pcount);
-
-      this->names.push_back(name);
     }
 
     return true;
@@ -51,10 +73,7 @@ bool MetricManager::parse(const std::vector<std::string>& names, bool support_st
   try
   {
     for (const auto& name : names)
-    {
       regular_operators.push_back(parse(name));
-      this->names.push_back(name);
-    }
   }
   catch(std::exception& e)
   {
@@ -65,14 +84,12 @@ bool MetricManager::parse(const std::vector<std::string>& names, bool support_st
   return true;
 }
 
-MetricCalculator MetricManager::parse(const std::string& name)
+void MetricManager::split(const std::string& name, std::string& attribute, std::string& metric, float& param) const
 {
   // name is in the format attribute_functionXX where attribute is an attribute of the points
-  // function is a function to apply and XX an optional parameter. We first parse the string
+  // function is a function to apply and XX an optional parameter.
 
-  float param = 0;
-  std::string metric;
-  std::string attribute;
+  param = 0;
 
   std::string::size_type underscore_pos = name.find('_');
   if (underscore_pos == std::string::npos)
@@ -106,16 +123,78 @@ MetricCalculator MetricManager::parse(const std::string& name)
     metric = metric.substr(0,5);
   }
 
+  attribute = map_attribute(attribute);
+}
+
+MetricCalculator MetricManager::parse(const std::string& name)
+{
+  float param;
+  std::string metric;
+  std::string attribute;
+  split(name, attribute, metric, param);
+
   // The string is parsed. We can instantiate the accessors
   auto it1 = metric_functions.find(metric);
   if (it1 == metric_functions.end()) throw std::invalid_argument("Invalid metric name: " + metric);
 
-  attribute = map_attribute(attribute);
   AttributeAccessor attribute_accessor(attribute);
 
   return MetricCalculator(it1->second, attribute_accessor, param);
 }
 
+void MetricManager::add_fused(const std::string& name)
+{
+  static const std::unordered_map<std::string, MetricType> types = {
+    {"max", MetricType::MAX}, {"min", MetricType::MIN}, {"mean", MetricType::MEAN},
+    {"median", MetricType::MEDIAN}, {"sd", MetricType::SD}, {"cv", MetricType::CV},
+    {"sum", MetricType::SUM}, {"above", MetricType::ABOVE}, {"mode", MetricType::MODE},
+    {"count", MetricType::COUNT}, {"p", MetricType::PERCENTILE}, {"skew", MetricType::SKEW},
+    {"kurt", MetricType::KURT}
+  };
+
+  float param;
+  std::string metric;
+  std::string attribute;
+  split(name, attribute, metric, param);
+
+  FusedMetric m;
+  m.type = types.at(metric);
+  m.param = param;
+  m.attribute = -1;
+
+  for (size_t i = 0 ; i < fused_attributes.size() ; i++)
+  {
+    if (fused_attributes[i].name == attribute) { m.attribute = (int)i; break; }
+  }
+
+  if (m.attribute == -1)
+  {
+    FusedAttribute a;
+    a.name = attribute;
+    a.accessor = AttributeAccessor(attribute);
+    fused_attributes.push_back(a);
+    m.attribute = (int)fused_attributes.size() - 1;
+  }
+
+  FusedAttribute& a = fused_attributes[m.attribute];
+  switch (m.type)
+  {
+    case MetricType::MEAN: case MetricType::SD: case MetricType::CV: case MetricType::SUM: a.moments = true; break;
+    case MetricType::SKEW: case MetricType::KURT: a.higher = true; break;
+    case MetricType::MODE: a.mode = true; break;
+    case MetricType::MEDIAN: case MetricType::PERCENTILE: a.sorted = true; break;
+    default: break;
+  }
+
+  fused_metrics.push_back(m);
+}
+
+// Attributes read by the metrics
+void MetricManager::get_attributes(std::vector<std::string>& attributes) const
+{
+  for (const auto& a : fused_attributes) attributes.push_back(a.name);
+}
+
 // streamable MetricManager
 float MetricManager::pmax  (float x, float y) const { if (x == NA_F32_RASTER) return y; return (x > y) ? x : y; }
 float MetricManager::pmin  (float x, float y) const { if (x == NA_F32_RASTER) return y; return (x < y) ? x : y; }
@@ -123,7 +202,7 @@ float MetricManager::pcount(float x, float y) const { if (x == NA_F32_RASTER) re
 
 // batch MetricManager
 
-float MetricManager::min(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::min(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   double min = std::numeric_limits<double>::max();
   for (const auto& point : points)
@@ -134,7 +213,7 @@ float MetricManager::min(AttributeAccessor& accessor, const PointCollection& poi
   return min;
 }
 
-float MetricManager::max(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::max(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   double max = std::numeric_limits<double>::lowest();
   for (const auto& point : points)
@@ -145,14 +224,14 @@ float MetricManager::max(AttributeAccessor& accessor, const PointCollection& poi
   return max;
 }
 
-float MetricManager::mean(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::mean(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   double sum = 0.0;
   for (const auto& point : points) sum += accessor(&point);
   return (float)(sum/points.size());
 }
 
-float MetricManager::median(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::median(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   std::vector<double> x;
   x.reserve(points.size());
@@ -161,7 +240,7 @@ float MetricManager::median(AttributeAccessor& accessor, const PointCollection&
   return percentile(x, 50);
 }
 
-float MetricManager::sd(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::sd(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   if (points.size() < 2) return NA_F32_RASTER;
 
@@ -179,7 +258,7 @@ float MetricManager::sd(AttributeAccessor& accessor, const PointCollection& poin
   return (float)(std::sqrt(sum/(points.size()-1)));
 }
 
-float MetricManager::mode(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::mode(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   std::unordered_map<double, int> registry;
 
@@ -204,7 +283,7 @@ float MetricManager::mode(AttributeAccessor& accessor, const PointCollection& po
   return (float)mode;
 }
 
-float MetricManager::cv(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::cv(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   float avg = mean(accessor, points, param);
   float std = sd(accessor, points, param);
@@ -212,20 +291,20 @@ float MetricManager::cv(AttributeAccessor& accessor, const PointCollection& poin
   return std/avg;
 }
 
-float MetricManager::sum(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::sum(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   double sum = 0;
   for (const auto& point : points) sum += accessor(&point);
   return (float)sum;
 }
 
-float MetricManager::count(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::count(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   return (float)points.size();
 }
 
 
-float MetricManager::percentile(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::percentile(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   std::vector<double> x;
   x.reserve(points.size());
@@ -234,7 +313,7 @@ float MetricManager::percentile(AttributeAccessor& accessor, const PointCollecti
   return percentile(x, param);
 }
 
-float MetricManager::above(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::above(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   float k = 0;
   for (const auto& point : points)
@@ -242,7 +321,7 @@ float MetricManager::above(AttributeAccessor& accessor, const PointCollection& p
   return k/(float)points.size();
 }
 
-float MetricManager::moment(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::moment(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   if (points.size() < 2) return NA_F32_RASTER;
   if (param <= 1) return 0.0f;
@@ -268,12 +347,12 @@ float MetricManager::moment(AttributeAccessor& accessor, const PointCollection&
   return (float)(numerator / denominator);
 }
 
-float MetricManager::skewness(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::skewness(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   return moment(accessor, points, 3);
 }
 
-float MetricManager::kurtosis(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::kurtosis(AttributeAccessor& accessor, const PointSpan& points, float param) const
 {
   return moment(accessor, points, 4);
 }
@@ -286,15 +365,341 @@ float MetricManager::get_metric(int index, float x, float y) const
   return (this->*f)(x,y);
 }
 
-float MetricManager::get_metric(int index, const PointCollection& points)
+float MetricManager::get_metric(int index, const PointSpan& points)
 {
   if (points.size() == 0) return default_value;
   return regular_operators[index].compute(points);
 }
 
+// Layout of the state of the streamable metrics: the number of points, then for each attribute
+// min, max, sum and the moments required, then a counter for each 'above' metric. Returns false
+// if a metric can't be streamed (median, percentiles, mode).
+bool MetricManager::build_state()
+{
+  for (auto& a : fused_attributes) a.order = 0;
+
+  for (const auto& m : fused_metrics)
+  {
+    FusedAttribute& a = fused_attributes[m.attribute];
+    switch (m.type)
+    {
+      case MetricType::MEDIAN: case MetricType::PERCENTILE: case MetricType::MODE: return false;
+      case MetricType::SD: case MetricType::CV: a.order = std::max(a.order, 2); break;
+      case MetricType::SKEW: case MetricType::KURT: a.order = 4; break;
+      default: break;
+    }
+  }
+
+  state_size = 1;
+  for (auto& a : fused_attributes)
+  {
+    a.offset = state_size;
+    state_size += 3;
+    if (a.order >= 2) state_size += 2;
+    if (a.order >= 4) state_size += 2;
+  }
+
+  for (auto& m : fused_metrics)
+  {
+    if (m.type == MetricType::ABOVE) m.offset = state_size++;
+  }
+
+  return true;
+}
+
+void MetricManager::init_state(double* state) const
+{
+  std::fill(state, state + state_size, 0.0);
+
+  for (const auto& a : fused_attributes)
+  {
+    state[a.offset] = std::numeric_limits<double>::max();
+    state[a.offset+1] = std::numeric_limits<double>::lowest();
+  }
+}
+
+// Online update of the central moments (Welford, Terriberry)
+void MetricManager::accumulate(double* state, const Point* p)
+{
+  double n1 = state[0];
+  double n = n1 + 1;
+  state[0] = n;
+
+  if (scratch.size() < fused_attributes.size()) scratch.resize(fused_attributes.size());
+
+  for (size_t j = 0 ; j < fused_attributes.size() ; j++)
+  {
+    FusedAttribute& a = fused_attributes[j];
+    double x = a.accessor(p);
+    scratch[j] = x;
+
+    double* s = state + a.offset;
+    if (s[0] > x) s[0] = x;
+    if (s[1] < x) s[1] = x;
+    s[2] += x;
+
+    if (a.order < 2) continue;
+
+    double delta = x - s[3];
+    double delta_n = delta / n;
+    double term = delta * delta_n * n1;
+
+    if (a.order >= 4)
+    {
+      double delta_n2 = delta_n * delta_n;
+      s[6] += term * delta_n2 * (n*n - 3*n + 3) + 6 * delta_n2 * s[4] - 4 * delta_n * s[5];
+      s[5] += term * delta_n * (n - 2) - 3 * delta_n * s[4];
+    }
+
+    s[3] += delta_n;
+    s[4] += term;
+  }
+
+  for (const auto& m : fused_metrics)
+  {
+    if (m.type == MetricType::ABOVE && scratch[m.attribute] > m.param) state[m.offset]++;
+  }
+}
+
+// Pairwise combination of the central moments (Chan et al., Pebay)
+void MetricManager::merge_state(double* state, const double* other) const
+{
+  double na = state[0];
+  double nb = other[0];
+  double n = na + nb;
+  if (nb == 0) return;
+  if (na == 0) { std::copy(other, other + state_size, state); return; }
+
+  for (const auto& a : fused_attributes)
+  {
+    double* s = state + a.offset;
+    const double* o = other + a.offset;
+    if (s[0] > o[0]) s[0] = o[0];
+    if (s[1] < o[1]) s[1] = o[1];
+    s[2] += o[2];
+
+    if (a.order < 2) continue;
+
+    double delta = o[3] - s[3];
+    double delta2 = delta * delta;
+
+    if (a.order >= 4)
+    {
+      double m4 = s[6] + o[6] + delta2 * delta2 * na * nb * (na*na - na*nb + nb*nb) / (n*n*n) + 6 * delta2 * (na*na * o[4] + nb*nb * s[4]) / (n*n) + 4 * delta * (na * o[5] - nb * s[5]) / n;
+      double m3 = s[5] + o[5] + delta2 * delta * na * nb * (na - nb) / (n*n) + 3 * delta * (na * o[4] - nb * s[4]) / n;
+      s[6] = m4;
+      s[5] = m3;
+    }
+
+    s[3] += delta * nb / n;
+    s[4] += o[4] + delta2 * na * nb / n;
+  }
+
+  for (const auto& m : fused_metrics)
+  {
+    if (m.type == MetricType::ABOVE) state[m.offset] += other[m.offset];
+  }
+
+  state[0] = n;
+}
+
+// Same definitions than the metrics computed on a set of points. The mean is the sum divided by
+// the number of points. skew and kurt use moments around the mean rounded to float (see moment()):
+// the central moments are shifted by d = mean - (float)mean.
+bool MetricManager::finalize(const double* state, float* values) const
+{
+  double n = state[0];
+
+  if (n == 0)
+  {
+    std::fill(values, values + fused_metrics.size(), default_value);
+    return false;
+  }
+
+  for (size_t i = 0 ; i < fused_metrics.size() ; i++)
+  {
+    const FusedMetric& m = fused_metrics[i];
+    const double* s = state + fused_attributes[m.attribute].offset;
+    float avg = (float)(s[2]/n);
+    float sd = (n < 2) ? NA_F32_RASTER : (float)(std::sqrt(s[4]/(n-1)));
+
+    switch (m.type)
+    {
+      case MetricType::MIN: values[i] = s[0]; break;
+      case MetricType::MAX: values[i] = s[1]; break;
+      case MetricType::SUM: values[i] = (float)s[2]; break;
+      case MetricType::MEAN: values[i] = avg; break;
+      case MetricType::COUNT: values[i] = (float)n; break;
+      case MetricType::SD: values[i] = sd; break;
+      case MetricType::CV: values[i] = (avg == 0 || avg == NA_F32_RASTER || sd == NA_F32_RASTER) ? NA_F32_RASTER : sd/avg; break;
+      case MetricType::ABOVE: values[i] = (float)state[m.offset]/(float)n; break;
+      case MetricType::SKEW:
+      case MetricType::KURT:
+      {
+        if (n < 2) { values[i] = NA_F32_RASTER; break; }
+        double d = s[3] - avg;
+        double m2 = s[4] + n*d*d;
+        double m3 = s[5] + 3*d*s[4] + n*d*d*d;
+        double m4 = s[6] + 4*d*s[5] + 6*d*d*s[4] + n*d*d*d*d;
+        float param = (m.type == MetricType::SKEW) ? 3 : 4;
+        double numerator = (1/n) * ((m.type == MetricType::SKEW) ? m3 : m4);
+        double denominator = std::pow((1/n)*m2, param/2);
+        values[i] = (float)(numerator / denominator);
+        break;
+      }
+      default: break;
+    }
+  }
+
+  return true;
+}
+
+// Same results than the metrics computed one by one with get_metric(). The sums are accumulated
+// in the same order and the central moments use the same means.
+void MetricManager::compute(const PointSpan& points, std::vector<float>& values)
+{
+  values.resize(fused_metrics.size());
+
+  size_t n = points.size();
+  if (n == 0)
+  {
+    std::fill(values.begin(), values.end(), default_value);
+    return;
+  }
+
+  // Extract the attributes in a single traversal of the points
+  size_t natt = fused_attributes.size();
+  if (scratch.size() < natt * n) scratch.resize(natt * n);
+
+  for (size_t k = 0 ; k < n ; k++)
+  {
+    const Point& point = points[k];
+    for (size_t j = 0 ; j < natt ; j++) scratch[j*n + k] = fused_attributes[j].accessor(&point);
+  }
+
+  for (size_t j = 0 ; j < natt ; j++)
+  {
+    FusedAttribute& s = fused_attributes[j];
+    const double* x = &scratch[j*n];
+
+    s.min = std::numeric_limits<double>::max();
+    s.max = std::numeric_limits<double>::lowest();
+    s.sum = 0;
+    for (size_t k = 0 ; k < n ; k++)
+    {
+      double val = x[k];
+      if (s.min > val) s.min = val;
+      if (s.max < val) s.max = val;
+      s.sum += val;
+    }
+
+    s.ss = 0;
+    if (s.moments)
+    {
+      double mean = s.sum/n;
+      for (size_t k = 0 ; k < n ; k++) s.ss += (x[k] - mean) * (x[k] - mean);
+    }
+
+    // moment() uses the mean rounded to float
+    s.m2 = s.m3 = s.m4 = 0;
+    if (s.higher)
+    {
+      float mean = (float)(s.sum/n);
+      for (size_t k = 0 ; k < n ; k++)
+      {
+        double diff = x[k] - mean;
+        s.m2 += std::pow(diff, 2);
+        s.m3 += std::pow(diff, 3);
+        s.m4 += std::pow(diff, 4);
+      }
+    }
+
+    s.modal = 0;
+    if (s.mode)
+    {
+      std::unordered_map<double, int> registry;
+      for (size_t k = 0 ; k < n ; k++) registry[x[k]]++;
+
+      double mode = x[0];
+      int count = registry[mode];
+      for (const auto& pair : registry)
+      {
+        if (pair.second > count)
+        {
+          mode = pair.first;
+          count = pair.second;
+        }
+      }
+      s.modal = (float)mode;
+    }
+  }
+
+  auto moment = [n](const FusedAttribute& s, double m, float param)
+  {
+    if (n < 2) return NA_F32_RASTER;
+    double numerator = (1/(double)n)*m;
+    double denominator = std::pow((1/(double)n)*s.m2, param/2);
+    return (float)(numerator / denominator);
+  };
+
+  for (size_t i = 0 ; i < fused_metrics.size() ; i++)
+  {
+    const FusedMetric& m = fused_metrics[i];
+    const FusedAttribute& s = fused_attributes[m.attribute];
+    const double* x = &scratch[m.attribute*n];
+    float sd = (n < 2) ? NA_F32_RASTER : (float)(std::sqrt(s.ss/(n-1)));
+
+    switch (m.type)
+    {
+      case MetricType::MIN: values[i] = s.min; break;
+      case MetricType::MAX: values[i] = s.max; break;
+      case MetricType::MEAN: values[i] = (float)(s.sum/n); break;
+      case MetricType::SUM: values[i] = (float)s.sum; break;
+      case MetricType::SD: values[i] = sd; break;
+      case MetricType::CV:
+      {
+        float avg = (float)(s.sum/n);
+        values[i] = (avg == 0 || avg == NA_F32_RASTER || sd == NA_F32_RASTER) ? NA_F32_RASTER : sd/avg;
+        break;
+      }
+      case MetricType::COUNT: values[i] = (float)n; break;
+      case MetricType::ABOVE:
+      {
+        float k = 0;
+        for (size_t j = 0 ; j < n ; j++) if (x[j] > m.param) k++;
+        values[i] = k/(float)n;
+        break;
+      }
+      case MetricType::MODE: values[i] = s.modal; break;
+      case MetricType::SKEW: values[i] = moment(s, s.m3, 3); break;
+      case MetricType::KURT: values[i] = moment(s, s.m4, 4); break;
+      default: break;
+    }
+  }
+
+  // One sort per attribute for all its percentiles
+  for (size_t j = 0 ; j < natt ; j++)
+  {
+    if (fused_attributes[j].sorted) std::sort(scratch.begin() + j*n, scratch.begin() + (j+1)*n);
+  }
+
+  for (size_t i = 0 ; i < fused_metrics.size() ; i++)
+  {
+    const FusedMetric& m = fused_metrics[i];
+    const double* x = &scratch[m.attribute*n];
+    if (m.type == MetricType::MEDIAN) values[i] = percentile(x, n, 50);
+    else if (m.type == MetricType::PERCENTILE) values[i] = percentile(x, n, m.param);
+  }
+}
+
 double MetricManager::percentile(const std::vector<double>& x, float p) const
 {
-  float rank = (p / 100.0f) * ((float)x.size() - 1) + 1;
+  return percentile(x.data(), x.size(), p);
+}
+
+double MetricManager::percentile(const double* x, size_t n, float p) const
+{
+  float rank = (p / 100.0f) * ((float)n - 1) + 1;
   int lowerIndex = (int)(std::floor(rank)) - 1;
   int upperIndex = (int)(std::ceil(rank)) - 1;
   double lowerValue = x[lowerIndex];
@@ -304,7 +709,7 @@ double MetricManager::percentile(const std::vector<double>& x, float p) const
 
 int MetricManager::size() const
 {
-  return (streamable) ? (int)streaming_operators.size() : (int)regular_operators.size();
+  return (int)names.size();
 };
 
 bool MetricManager::active() const
@@ -317,6 +722,9 @@ void MetricManager::reset()
 {
   for(auto& op : regular_operators)
     op.reset();
+
+  for (auto& a : fused_attributes)
+    a.accessor.reset();
 }
 
 float MetricManager::string_to_float(const std::string& s) const
@@ -336,6 +744,8 @@ float MetricManager::string_to_float(const std::string& s) const
 MetricManager::MetricManager()
 {
   streamable = false;
+  stateless = false;
+  state_size = 0;
   default_value = NA_F32_RASTER;
 }
 
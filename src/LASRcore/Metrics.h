@@ -7,15 +7,15 @@
 #include <unordered_map>
 
 #include "PointSchema.h"
+#include "PointSpan.h"
 
-using PointCollection = std::vector<Point>;
-using MetricComputation = std::function<float(AttributeAccessor&, const PointCollection&, float)>;
+using MetricComputation = std::function<float(AttributeAccessor&, const PointSpan&, float)>;
 
 class MetricCalculator
 {
 public:
   MetricCalculator(MetricComputation computation, AttributeAccessor& accessor, float param) : computation(computation), accessor(accessor), param(param) {}
-  float compute(const PointCollection& points) { return computation(accessor, points, param); }
+  float compute(const PointSpan& points) { return computation(accessor, points, param); }
   void set_param(float x) { param = x; }
   void reset() { accessor.reset(); };
 
@@ -33,17 +33,33 @@ public:
   bool parse(const std::vector<std::string>& names, bool support_streamable = true);
   int size() const;
   bool active() const;
-  float get_metric(int index, const PointCollection& points);
+  float get_metric(int index, const PointSpan& points);
+  void compute(const PointSpan& points, std::vector<float>& values);
   float get_metric(int index, float x, float y) const;
   const std::string& get_name(int index) { return names[index]; }
   float get_default_value() const { return default_value; }
   void set_default_value(float val) { default_value = val; }
   bool is_streamable() const { return streamable; }
+  void get_attributes(std::vector<std::string>& attributes) const;
   void reset();
 
+  // Streamable metrics are computed point by point. max, min and count of Z only need the value of
+  // the metric itself (stateless, see get_metric(int, float, float)). The others need a state per
+  // cell (e.g. the number of points and the moments of the values): an array of get_state_size()
+  // doubles initialized by init_state(), updated by accumulate() and converted into the metrics by
+  // finalize(). The states of the same cell computed on different points can be merged.
+  bool is_stateless() const { return streamable && stateless; }
+  int get_state_size() const { return state_size; }
+  void init_state(double* state) const;
+  void accumulate(double* state, const Point* p);
+  void merge_state(double* state, const double* other) const;
+  bool finalize(const double* state, float* values) const;
+
 private:
   double percentile(const std::vector<double>& x, float p) const;
+  double percentile(const double* x, size_t n, float p) const;
   float string_to_float(const std::string& s) const;
+  void split(const std::string& name, std::string& attribute, std::string& metric, float& param) const;
 
   // Streamable metrics
   float pmax  (float x, float y) const;
@@ -51,26 +67,27 @@ private:
   float pcount(float x, float y) const;
 
   // Non-streamable metrics
-  float min(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float max(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float mean(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float median(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float sd(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float cv(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float sum(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float percentile(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float above(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float count(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float mode(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float moment(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float skewness(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float kurtosis(AttributeAccessor& accessor, const PointCollection& points, float param) const;
+  float min(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float max(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float mean(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float median(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float sd(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float cv(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float sum(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float percentile(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float above(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float count(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float mode(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float moment(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float skewness(AttributeAccessor& accessor, const PointSpan& points, float param) const;
+  float kurtosis(AttributeAccessor& accessor, const PointSpan& points, float param) const;
 
   float default_value;
   std::vector<std::string> names;
 
   // Predefined metrics such as z_max or z_min can be streamed. We use a pointer to simple functions.
   bool streamable;
+  bool stateless;
   typedef float (MetricManager::*StreamingMetric)(float, float) const;
   std::vector<StreamingMetric> streaming_operators;
 
@@ -78,21 +95,60 @@ private:
   MetricCalculator parse(const std::string& name);
   std::vector<MetricCalculator> regular_operators;
 
+  // Fused evaluation of the regular metrics by compute(). The metrics are grouped by attribute.
+  // The values of each attribute are extracted once in a scratch buffer reused from one set of
+  // points to another. The moments are computed from these values and all the percentiles of an
+  // attribute are read in a single sort.
+  enum class MetricType { MIN, MAX, MEAN, MEDIAN, SD, CV, SUM, PERCENTILE, ABOVE, COUNT, MODE, SKEW, KURT };
+
+  struct FusedAttribute
+  {
+    std::string name;
+    AttributeAccessor accessor;
+    bool moments = false;   // mean, sd, cv, sum
+    bool higher = false;    // skew, kurt
+    bool mode = false;
+    bool sorted = false;    // median, percentiles
+
+    // Statistics of the values that depend on their order, before the sort
+    double min = 0, max = 0, sum = 0, ss = 0, m2 = 0, m3 = 0, m4 = 0;
+    float modal = 0;
+
+    // State of the streamable metrics: min, max, sum, then the mean and the central moments up to 'order'
+    int offset = 0;
+    int order = 0;
+  };
+
+  struct FusedMetric
+  {
+    int attribute;
+    MetricType type;
+    float param;
+    int offset = 0; // Counter of 'above' in the state
+  };
+
+  void add_fused(const std::string& name);
+  bool build_state();
+  int state_size;
+  std::vector<FusedAttribute> fused_attributes;
+  std::vector<FusedMetric> fused_metrics;
+  std::vector<double> scratch; // One row of values per attribute
+
   // Map of string to metric functions
   std::unordered_map<std::string, MetricComputation> metric_functions = {
-    {"max", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return max(accessor, points, param); }},
-    {"min", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return min(accessor, points, param); }},
-    {"mean", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return mean(accessor, points, param); }},
-    {"median", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return median(accessor, points, param); }},
-    {"sd", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return sd(accessor, points, param); }},
-    {"cv", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return cv(accessor, points, param); }},
-    {"sum", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return sum(accessor, points, param); }},
-    {"above", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return above(accessor, points, param); }},
-    {"mode", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return mode(accessor, points, param); }},
-    {"count", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return count(accessor, points, param); }},
-    {"p", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return percentile(accessor, points, param); }},
-    {"skew", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return skewness(accessor, points, param); }},
-    {"kurt", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return kurtosis(accessor, points, param); }},
+    {"max", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return max(accessor, points, param); }},
+    {"min", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return min(accessor, points, param); }},
+    {"mean", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return mean(accessor, points, param); }},
+    {"median", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return median(accessor, points, param); }},
+    {"sd", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return sd(accessor, points, param); }},
+    {"cv", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return cv(accessor, points, param); }},
+    {"sum", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return sum(accessor, points, param); }},
+    {"above", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return above(accessor, points, param); }},
+    {"mode", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return mode(accessor, points, param); }},
+    {"count", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return count(accessor, points, param); }},
+    {"p", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return percentile(accessor, points, param); }},
+    {"skew", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return skewness(accessor, points, param); }},
+    {"kurt", [this](AttributeAccessor& accessor, const PointSpan& points, float param) { return kurtosis(accessor, points, param); }},
   };
 };
 
@@ -0,0 +1,68 @@
+#ifndef POINTBLOCK_H
+#define POINTBLOCK_H
+
+#include "PointSchema.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+// A PointBlock is a fixed capacity contiguous array of points with the same memory layout than
+// PointCloud. It is the unit of work in streaming mode: a reader fills the block and each stage
+// processes the whole block at once instead of one virtual call per point and per stage.
+class PointBlock
+{
+public:
+  static constexpr size_t default_capacity = 65536;
+
+  PointBlock(size_t capacity = default_capacity) : buffer(nullptr), schema(nullptr), point_size(0), npoints(0), capacity(capacity), eof(false) {}
+  ~PointBlock() { if (buffer) free(buffer); }
+  PointBlock(const PointBlock&) = delete;
+  PointBlock& operator=(const PointBlock&) = delete;
+
+  // (Re)initialize the memory for a given schema. Does nothing if the schema did not change
+  void set_schema(const AttributeSchema* schema)
+  {
+    if (this->schema == schema && point_size == schema->total_point_size && buffer) return;
+
+    this->schema = schema;
+    point_size = schema->total_point_size;
+
+    unsigned char* tmp = (unsigned char*)realloc(buffer, capacity * point_size);
+    if (tmp == NULL) throw std::runtime_error("Memory allocation failed: Insufficient memory"); // # nocov
+    buffer = tmp;
+
+    clear();
+  }
+
+  void clear() { npoints = 0; eof = false; }
+  bool empty() const { return npoints == 0; }
+  bool full() const { return npoints == capacity; }
+  size_t size() const { return npoints; }
+  bool is_initialized() const { return buffer != nullptr; }
+
+  // Raw address of the i-th point
+  inline unsigned char* data(size_t i) const { return buffer + i * point_size; }
+
+  // Set a non owning Point to the i-th point of the block
+  inline void seek(size_t i, Point& p) const { p.schema = schema; p.data = data(i); p.record_size = Point::full_record; }
+
+  // Set a non owning Point to the next free slot of the block. The slot is not zeroed. It becomes
+  // part of the block only after a call to commit(). This allows readers to read directly into the
+  // block and discard filtered points without copy.
+  inline void next(Point& p) const { p.schema = schema; p.data = data(npoints); p.record_size = Point::full_record; }
+  inline void commit() { npoints++; }
+
+  // Copy a point at the end of the block
+  inline void push_back(const Point& p) { memcpy(data(npoints), p.data, point_size); npoints++; }
+
+public:
+  unsigned char* buffer;
+  const AttributeSchema* schema;
+  size_t point_size;
+  size_t npoints;
+  size_t capacity;
+  bool eof; // Set by the source when it read the last point
+};
+
+#endif
@@ -4,17 +4,27 @@
 #include "macros.h"
 #include "error.h"
 #include "print.h"
+#include "openmp.h"
+#include "MemoryBudget.h"
+#include "BufferArena.h"
 
 #include <algorithm>
+#include <chrono>
 
-PointCloud::PointCloud(Header* header)
+PointCloud::PointCloud(Header* header, bool columnar)
 {
   this->header = header;
 
   // Point cloud storage
   buffer = NULL;
+  buffer_size = 0;
   npoints = 0;
   capacity = 0;
+  this->columnar = columnar;
+  column_capacity = 0;
+  pending = nullptr;
+  pending_size = 0;
+  tracked_memory = 0;
 
   current_point = 0;
   next_point = 0;
@@ -23,6 +33,11 @@ PointCloud::PointCloud(Header* header)
   // For spatial indexing
   gridpartition = nullptr;
   kdtree = nullptr;
+  kdtree64 = nullptr;
+  xy_version = 0;
+  z_version = 0;
+  kdtree_version[0] = kdtree_version[1] = 0;
+  partition_version = 0;
   current_interval = 0;
   shape = nullptr;
   inside = false;
@@ -36,8 +51,14 @@ PointCloud::PointCloud(const Raster& raster)
 {
   // Point cloud storage
   buffer = NULL;
+  buffer_size = 0;
   npoints = 0;
   capacity = 0;
+  columnar = false;
+  column_capacity = 0;
+  pending = nullptr;
+  pending_size = 0;
+  tracked_memory = 0;
 
   current_point = 0;
   next_point = 0;
@@ -68,6 +89,11 @@ PointCloud::PointCloud(const Raster& raster)
   inside = false;
   gridpartition = nullptr;
   kdtree = nullptr;
+  kdtree64 = nullptr;
+  xy_version = 0;
+  z_version = 0;
+  kdtree_version[0] = kdtree_version[1] = 0;
+  partition_version = 0;
   Point p(&header->schema);
   point.set_schema(&header->schema);
 
@@ -87,6 +113,7 @@ PointCloud::PointCloud(const Raster& raster)
     add_point(p);
   }
 
+  shrink_to_fit();
   header->number_of_point_records = npoints;
 }
 #endif
@@ -111,47 +138,82 @@ PointCloud::~PointCloud()
 
   if (buffer)
   {
-    free(buffer);
+    BufferArena::release(buffer, buffer_size);
     buffer = NULL;
+    buffer_size = 0;
   }
 
+  if (pending)
+  {
+    free(pending);
+    pending = nullptr;
+  }
+
+  track_memory();
   clean_spatialindex();
 }
 
 bool PointCloud::add_point(const Point& p)
 {
+  // New points need complete records
+  if (pending_size > 0 && !merge_pending()) return false;
+
+  // The number of points in the header is an upper bound of the number of points added (the
+  // readers add the number of points of the files used as buffer). The buffer is allocated once
+  // and shrunk with shrink_to_fit() once all the points are added. Otherwise it grows by doubling.
   if (buffer == NULL)
   {
-    capacity = 100000 * header->schema.total_point_size;
+    size_t n = get_true_number_of_points();
+    if (n <= npoints) n = MAX(npoints + 1, 100000);
+    capacity = n * header->schema.total_point_size;
+    if (columnar) column_capacity = n;
     if (!alloc_buffer()) return false;
   }
 
-  if (npoints == std::numeric_limits<int>::max())
-  {
-    last_error = "LASR cannot stores more than 2147483647 points"; // # nocov
-    return false;                                                  // # nocov
-  }
-
   // Realloc memory and increase buffer size if needed
   size_t required_capacity = npoints*header->schema.total_point_size;
-  if (required_capacity == capacity)
+  bool full = (columnar) ? npoints == column_capacity : required_capacity + header->schema.total_point_size > capacity;
+  if (full)
   {
+    size_t new_capacity = (columnar) ? required_capacity : capacity;
     size_t capacity_max = get_true_number_of_points()*header->schema.total_point_size;
 
     // This may happens if the header is not properly populated
     if (required_capacity >= capacity_max)
-      capacity_max = capacity*2; // # nocov
+      capacity_max = new_capacity*2; // # nocov
 
-    if (capacity_max < capacity*2)
-      capacity = capacity_max;
+    if (capacity_max < new_capacity*2)
+      new_capacity = capacity_max;
     else
-      capacity *= 2;
+      new_capacity *= 2;
 
-    if (!realloc_buffer()) return false;
+    if (columnar)
+    {
+      if (!resize_columns(new_capacity/header->schema.total_point_size)) return false;
+    }
+    else
+    {
+      capacity = new_capacity;
+      if (!realloc_buffer()) return false;
+    }
+  }
+
+  if (!columnar && p.is_record())
+  {
+    memcpy(buffer + npoints * header->schema.total_point_size, p.data, header->schema.total_point_size);
+  }
+  else
+  {
+    // Scatter (or gather) the point attribute by attribute
+    Point dst;
+    dst.schema = &header->schema;
+    locate(dst, npoints);
+    for (const auto& attr : header->schema.attributes)
+      memcpy(dst.address(attr), p.address(attr), attr.size);
   }
 
-  memcpy(buffer + npoints * header->schema.total_point_size, p.data, header->schema.total_point_size);
   npoints++;
+  touch_xyz();
 
   //index->insert(p.get_x(), p.get_y());
 
@@ -169,7 +231,7 @@ bool PointCloud::seek(size_t pos)
   current_point = pos;
   next_point = pos;
   next_point++;
-  point.data = buffer + current_point * header->schema.total_point_size;
+  locate(point, current_point);
   return true;
 }
 
@@ -199,7 +261,7 @@ bool PointCloud::read_point(bool include_withhelded)
     current_interval = 0;
 
     if (!inside)
-      intervals_to_read.push_back({0, (int)npoints-1});
+      intervals_to_read.push_back({0, npoints-1});
     else if (inside && shape)
       gridpartition->query(shape->xmin(), shape->ymin(), shape->xmax(), shape->ymax(), intervals_to_read);
     else
@@ -215,7 +277,7 @@ bool PointCloud::read_point(bool include_withhelded)
   }
 
   // If the interval index is beyond the list of intervals we have read everything
-  if (current_interval >= (int)intervals_to_read.size())
+  if (current_interval >= intervals_to_read.size())
   {
     clean_query();
     return false;
@@ -224,21 +286,21 @@ bool PointCloud::read_point(bool include_withhelded)
   do
   {
     // If the interval index is beyond the list of intervals we have read everything
-    if (current_interval >= (int)intervals_to_read.size())
+    if (current_interval >= intervals_to_read.size())
     {
       clean_query();
       return false;
     }
 
     current_point = next_point;
-    point.data = buffer + current_point * header->schema.total_point_size;
+    locate(point, current_point);
     next_point++;
 
     // If the new current point is not in the current interval we switch to next interval
     if (next_point > intervals_to_read[current_interval].end)
     {
       current_interval++;
-      if (current_interval < (int)intervals_to_read.size())
+      if (current_interval < intervals_to_read.size())
         next_point = intervals_to_read[current_interval].start;
     }
 
@@ -283,14 +345,52 @@ bool PointCloud::delete_deleted()
   // Fix #206 by setting the threshold to 0. Deleted points are always removed from the memory layout
   if (ratio == 0) return true;
 
+  // Compact each column (the columnar buffer or the pending columns). In columnar mode the columns
+  // are processed by decreasing offset so the flags that tell which points are deleted (offset 0)
+  // are compacted last. In interleaved mode the flags are in the records that are compacted after.
+  const Attribute& flag = header->schema.attributes[AttributeCore::FLAG];
+  const unsigned char* flags = (columnar) ? column_address(flag.offset) : buffer + flag.offset;
+  size_t flag_stride = (columnar) ? flag.size : record_size();
+
+  // Nothing to remove: the memory layout and the spatial indexes are still valid
+  size_t first_deleted = 0;
+  while (first_deleted < npoints && (flags[first_deleted * flag_stride] & 1) == 0) first_deleted++;
+  if (first_deleted == npoints) return true;
+
+  auto ranges = column_ranges();
+  size_t j = 0;
+  for (auto it = ranges.rbegin() ; it != ranges.rend() ; ++it)
+  {
+    size_t size = it->second;
+    unsigned char* col = column_address(it->first);
+    j = 0;
+    for (size_t i = 0 ; i < npoints ; i++)
+    {
+      if ((flags[i * flag_stride] & 1) == 0)
+      {
+        if (i != j) memcpy(col + j * size, col + i * size, size);
+        j++;
+      }
+    }
+  }
+
+  if (columnar)
+  {
+    npoints = j;
+    touch_xyz();
+    clean_spatialindex();
+    return resize_columns(npoints);
+  }
+
   // Read all the points and move memory at the beginning of the buffer.
-  int j = 0;
-  for (int i = 0 ; i < npoints ; i++)
+  size_t size = record_size();
+  j = 0;
+  for (size_t i = 0 ; i < npoints ; i++)
   {
     seek(i);
     if (!point.get_deleted())
     {
-      memcpy(buffer + j * header->schema.total_point_size, point.data, header->schema.total_point_size);
+      memcpy(buffer + j * size, point.data, size);
       j++;
     }
   }
@@ -298,11 +398,12 @@ bool PointCloud::delete_deleted()
 
   // Delete spatial index it is invalidated. It will be reconstructed in the
   // next stage that will need it
+  touch_xyz();
   clean_spatialindex();
 
   // We move the point in the buffer, but the memory is still allocated. We recompute the capacity
   // and realloc the memory for this new capacity.
-  capacity = npoints*header->schema.total_point_size;
+  capacity = npoints*size;
   return realloc_buffer();
 }
 
@@ -379,11 +480,27 @@ static int compare_buffers_nogps(const void* a, const void* b, void* context)
 }*/
 
 
-bool PointCloud::sort(const std::vector<int>& order)
+bool PointCloud::sort(const std::vector<uint64_t>& order)
 {
+  // Gather each column (the columnar buffer or the pending columns) in a temporary array and copy it back
+  std::vector<unsigned char> tmp;
+  for (const auto& range : column_ranges())
+  {
+    size_t size = range.second;
+    unsigned char* col = column_address(range.first);
+    tmp.resize(npoints * size);
+    for (size_t i = 0 ; i < npoints ; i++) memcpy(tmp.data() + i * size, col + order[i] * size, size);
+    memcpy(col, tmp.data(), npoints * size);
+  }
+
+  // The indexes of the points changed
+  touch_xyz();
+
+  if (columnar) return true;
+
   std::vector<bool> visited(npoints, false);
-  char* temp = (char*)malloc(header->schema.total_point_size);
-  size_t chunk_size = header->schema.total_point_size;
+  size_t chunk_size = record_size();
+  char* temp = (char*)malloc(chunk_size);
 
   for (size_t i = 0; i < npoints; ++i)
   {
@@ -446,6 +563,72 @@ void PointCloud::update_header()
 
 // Thread safe
 bool PointCloud::query(const Shape* const shape, std::vector<Point>& addr, PointFilter* const filter) const
+{
+  thread_local std::vector<size_t> idx;
+  bool ret = query(shape, idx, filter);
+  to_points(idx, addr);
+  return ret;
+}
+
+template<typename Index>
+bool PointCloud::query(const std::vector<IntervalT<Index>>& intervals, std::vector<Point>& addr, PointFilter* const filter) const
+{
+  thread_local std::vector<size_t> idx;
+  bool ret = query(intervals, idx, filter);
+  to_points(idx, addr);
+  return ret;
+}
+
+template bool PointCloud::query(const std::vector<Interval32>&, std::vector<Point>&, PointFilter* const) const;
+template bool PointCloud::query(const std::vector<Interval>&, std::vector<Point>&, PointFilter* const) const;
+
+bool PointCloud::knn(const Point& xyz, int k, std::vector<Point>& res, PointFilter* const filter) const
+{
+  thread_local std::vector<size_t> idx;
+  bool ret = knn(xyz, k, idx, filter);
+  to_points(idx, res);
+  return ret;
+}
+
+bool PointCloud::rknn(const Point& xyz, int k, double r, std::vector<Point>& res, PointFilter* const filter) const
+{
+  thread_local std::vector<size_t> idx;
+  bool ret = rknn(xyz, k, r, idx, filter);
+  to_points(idx, res);
+  return ret;
+}
+
+bool PointCloud::query_sphere(const Point& xyz, double r, std::vector<Point>& res, PointFilter* const filter) const
+{
+  thread_local std::vector<size_t> idx;
+  bool ret = query_sphere(xyz, r, idx, filter);
+  to_points(idx, res);
+  return ret;
+}
+
+void PointCloud::to_points(const std::vector<size_t>& idx, std::vector<Point>& res) const
+{
+  res.clear();
+  res.reserve(idx.size());
+  Point p;
+  p.set_schema(&header->schema);
+  for (size_t i : idx)
+  {
+    locate(p, i);
+    res.push_back(p);
+  }
+}
+
+PointSpan PointCloud::span(const std::vector<size_t>& idx) const
+{
+  Point origin;
+  origin.set_schema(&header->schema);
+  locate(origin, 0);
+  return PointSpan(origin, idx);
+}
+
+// Thread safe
+bool PointCloud::query(const Shape* const shape, std::vector<size_t>& idx, PointFilter* const filter) const
 {
   if (gridpartition == nullptr)
     throw std::runtime_error("Internal error: GridPartition spatial index not built");
@@ -453,183 +636,276 @@ bool PointCloud::query(const Shape* const shape, std::vector<Point>& addr, Point
   Point p;
   p.set_schema(&header->schema);
 
-  addr.clear();
+  idx.clear();
 
-  std::vector<Interval> intervals;
+  thread_local std::vector<Interval> intervals;
+  intervals.clear();
   gridpartition->query(shape->xmin(), shape->ymin(), shape->xmax(), shape->ymax(), intervals);
 
   if (intervals.size() == 0) return false;
 
   for (const auto& interval : intervals)
   {
-    for (int i = interval.start ; i <= interval.end ; i++)
+    for (uint64_t i = interval.start ; i <= interval.end ; i++)
     {
-      p.data = buffer + i * header->schema.total_point_size;
+      locate(p, i);
 
       if (filter && filter->filter(&p)) continue;
 
       if (!p.get_deleted() && shape->contains(p.get_x(), p.get_y()))
       {
-         addr.push_back(p);
+         idx.push_back(i);
       }
     }
   }
 
-  return addr.size() > 0;
+  return idx.size() > 0;
 }
 
-bool PointCloud::query(const std::vector<Interval>& intervals, std::vector<Point>& addr, PointFilter* const filter) const
+template<typename Index>
+bool PointCloud::query(const std::vector<IntervalT<Index>>& intervals, std::vector<size_t>& idx, PointFilter* const filter) const
 {
   Point p;
   p.set_schema(&header->schema);
 
-  addr.clear();
+  idx.clear();
 
   if (intervals.size() == 0) return false;
 
   for (const auto& interval : intervals)
   {
-    for (int i = interval.start ; i <= interval.end ; i++)
+    for (uint64_t i = interval.start ; i <= interval.end ; i++)
     {
-      p.data = buffer + i * header->schema.total_point_size;
+      locate(p, i);
 
       if (filter && filter->filter(&p)) continue;
 
       if (!p.get_deleted())
       {
-         addr.push_back(p);
+         idx.push_back(i);
       }
     }
   }
 
-  return addr.size() > 0;
+  return idx.size() > 0;
 }
 
+template bool PointCloud::query(const std::vector<Interval32>&, std::vector<size_t>&, PointFilter* const) const;
+template bool PointCloud::query(const std::vector<Interval>&, std::vector<size_t>&, PointFilter* const) const;
+
 // Thread safe
-bool PointCloud::knn(const Point& xyz, int k, std::vector<Point>& res, PointFilter* const filter) const
+bool PointCloud::knn(const Point& xyz, int k, std::vector<size_t>& idx, PointFilter* const filter) const
 {
-  if (kdtree == nullptr)
+  if (kdtree == nullptr && kdtree64 == nullptr)
     throw std::runtime_error("Internal error: KDtree spatial index not built");
 
-  res.clear();
   double query_pt[3] = { xyz.get_x(), xyz.get_y(), xyz.get_z() };
 
-  // Count the actual number of point queried.
-  // kdtree will always find the k-nn but some of these points
-  // may actually be filtered out or be flagged as delete. The query
-  // is thus not actually k points
-  int n = 0;
-
-  // While we do not have actually k points we search with bigger k until we do have the
-  // initial k request
-  int current_k = k;
-  std::vector<KDTree::IndexType> indices(current_k);
-  std::vector<KDTree::DistanceType> dists(current_k);
-  while (n < k && n < get_true_number_of_points())
-  {
-    // Perform knn search (returns the number of valid neighbors found)
-    size_t found = kdtree->knnSearch(query_pt, current_k, indices.data(), dists.data());
+  if (kdtree)
+    knn(kdtree, query_pt, k, idx, filter);
+  else
+    knn(kdtree64, query_pt, k, idx, filter);
 
-    Point p;
-    p.set_schema(&header->schema);
+  return true;
+}
 
-    for (size_t i = 0; i < found; ++i)
-    {
-      size_t idx = indices[i];
-      p.data = buffer + idx * header->schema.total_point_size;
+bool PointCloud::rknn(const Point& xyz, int k, double r, std::vector<size_t>& idx, PointFilter* const filter) const
+{
+  if (kdtree == nullptr && kdtree64 == nullptr)
+    throw std::runtime_error("Internal error: KDtree spatial index not built");
 
-      if (filter && filter->filter(&p)) continue;
+  idx.clear();
+  if (r <= 0.0) return false;
 
-      if (!p.get_deleted())
-      {
-        res.push_back(p);
-        n++;
-        if (n >= k) break;
-      }
-    }
+  double query_pt[3] = { xyz.get_x(), xyz.get_y(), xyz.get_z() };
 
-    if (n < k)
-    {
-      current_k *= 2;
-      indices.resize(current_k);
-      dists.resize(current_k);
-      res.clear();
-    }
-  }
+  if (kdtree)
+    radius_search(kdtree, query_pt, r, k, idx, filter);
+  else
+    radius_search(kdtree64, query_pt, r, k, idx, filter);
 
   return true;
 }
 
-bool PointCloud::rknn(const Point& xyz, int k, double r, std::vector<Point>& res, PointFilter* const filter) const
+bool PointCloud::query_sphere(const Point& xyz, double r, std::vector<size_t>& idx, PointFilter* const filter) const
 {
-  if (kdtree == nullptr)
+  if (kdtree == nullptr && kdtree64 == nullptr)
     throw std::runtime_error("Internal error: KDtree spatial index not built");
 
-  if (r <= 0.0) return false;
+  idx.clear();
+  if (r <= 0.0)  return false;
 
-  res.clear();
   double query_pt[3] = { xyz.get_x(), xyz.get_y(), xyz.get_z() };
 
-  std::vector<nanoflann::ResultItem<KDTree::IndexType, KDTree::DistanceType>> matches;
-  size_t found = kdtree->radiusSearch(query_pt, r, matches);
+  if (kdtree)
+    radius_search(kdtree, query_pt, r, std::numeric_limits<size_t>::max(), idx, filter);
+  else
+    radius_search(kdtree64, query_pt, r, std::numeric_limits<size_t>::max(), idx, filter);
+
+  return true;
+}
+
+bool PointCloud::knn_batch(const std::vector<double>& xyz, int k, double r, std::vector<size_t>& offsets, std::vector<size_t>& idx, PointFilter* const filter, int ncpu) const
+{
+  if (kdtree == nullptr && kdtree64 == nullptr)
+    throw std::runtime_error("Internal error: KDtree spatial index not built");
+
+  if (kdtree)
+    batch(kdtree, xyz, k, r, offsets, idx, filter, ncpu);
+  else
+    batch(kdtree64, xyz, k, r, offsets, idx, filter, ncpu);
+
+  return idx.size() > 0;
+}
+
+bool PointCloud::radius_batch(const std::vector<double>& xyz, double r, std::vector<size_t>& offsets, std::vector<size_t>& idx, PointFilter* const filter, int ncpu) const
+{
+  if (kdtree == nullptr && kdtree64 == nullptr)
+    throw std::runtime_error("Internal error: KDtree spatial index not built");
+
+  if (r <= 0.0)
+  {
+    offsets.assign(xyz.size()/3+1, 0);
+    idx.clear();
+    return false;
+  }
+
+  if (kdtree)
+    batch(kdtree, xyz, 0, r, offsets, idx, filter, ncpu);
+  else
+    batch(kdtree64, xyz, 0, r, offsets, idx, filter, ncpu);
+
+  return idx.size() > 0;
+}
+
+// The buffers of the kd-tree searches are thread local and reused from one query to another
+template<typename Tree>
+void PointCloud::knn(const Tree* tree, const double* xyz, int k, std::vector<size_t>& idx, PointFilter* const filter) const
+{
+  idx.clear();
+
+  // The kd-tree indexes only the points that were neither deleted nor filtered out when it was
+  // built. The k nearest neighbours are thus found in a single search unless the query uses
+  // another filter or if points were deleted since. In this case some neighbours are skipped and
+  // we search again with a bigger k until we have k points.
+  bool check_filter = need_filtering(filter);
+  size_t npoints_indexed = kdtree_data.kdtree_get_point_count();
+  size_t current_k = std::min<size_t>(k, npoints_indexed);
+
+  thread_local std::vector<typename Tree::IndexType> indices;
+  thread_local std::vector<typename Tree::DistanceType> dists;
+
+  Point p;
+  p.set_schema(&header->schema);
+
+  while (current_k > 0)
+  {
+    indices.resize(current_k);
+    dists.resize(current_k);
+    size_t found = tree->knnSearch(xyz, current_k, indices.data(), dists.data());
+
+    for (size_t i = 0; i < found; ++i)
+    {
+      size_t id = kdtree_data.id(indices[i]);
+      locate(p, id);
+
+      if (check_filter && filter->filter(&p)) continue;
+      if (p.get_deleted()) continue;
+
+      idx.push_back(id);
+      if (idx.size() >= (size_t)k) return;
+    }
+
+    // All the indexed points have been visited
+    if (found < current_k || current_k == npoints_indexed) return;
+
+    current_k = std::min<size_t>(current_k*2, npoints_indexed);
+    idx.clear();
+  }
+}
+
+// Returns the points within a radius r. If k is not the max size_t, the matches are sorted by
+// distance and only the k closest are returned.
+template<typename Tree>
+void PointCloud::radius_search(const Tree* tree, const double* xyz, double r, size_t k, std::vector<size_t>& idx, PointFilter* const filter) const
+{
+  idx.clear();
+
+  thread_local std::vector<nanoflann::ResultItem<typename Tree::IndexType, typename Tree::DistanceType>> matches;
+  tree->radiusSearch(xyz, r, matches);
+
+  bool check_filter = need_filtering(filter);
 
   Point p;
   p.set_schema(&header->schema);
 
   // Sort by distance
-  std::sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+  if (k != std::numeric_limits<size_t>::max())
+    std::sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
 
   size_t count = 0;
   for (const auto& match : matches)
   {
-    if (count >= (size_t)k) break;
+    if (count >= k) break;
 
-    size_t idx = match.first;
-    p.data = buffer + idx * header->schema.total_point_size;
+    size_t id = kdtree_data.id(match.first);
+    locate(p, id);
 
-    if (filter && filter->filter(&p)) continue;
+    if (check_filter && filter->filter(&p)) continue;
     if (p.get_deleted()) continue;
 
-    res.push_back(p);
+    idx.push_back(id);
     count++;
   }
-
-  return true;
 }
 
-bool PointCloud::query_sphere(const Point& xyz, double r, std::vector<Point>& res, PointFilter* const filter) const
+// Each thread processes a contiguous range of queries in its own buffers. The buffers are then
+// concatenated in the order of the queries.
+template<typename Tree>
+void PointCloud::batch(const Tree* tree, const std::vector<double>& xyz, int k, double r, std::vector<size_t>& offsets, std::vector<size_t>& idx, PointFilter* const filter, int ncpu) const
 {
-  if (kdtree == nullptr)
-    throw std::runtime_error("Internal error: KDtree spatial index not built");
+  size_t nqueries = xyz.size()/3;
+  int nthreads = std::max(1, std::min<int>(ncpu, (int)(nqueries/64) + 1));
 
-  if (r <= 0.0)  return false;
+  offsets.assign(nqueries+1, 0);
+  std::vector<std::vector<size_t>> buffers(nthreads);
 
-  res.clear();
-  double query_pt[3] = { xyz.get_x(), xyz.get_y(), xyz.get_z() };
+  #pragma omp parallel num_threads(nthreads)
+  {
+    int t = omp_get_thread_num();
+    int nt = omp_get_num_threads();
+    size_t begin = nqueries*t/nt;
+    size_t end = nqueries*(t+1)/nt;
 
-  std::vector<nanoflann::ResultItem<KDTree::IndexType, KDTree::DistanceType>> matches;
-  size_t found = kdtree->radiusSearch(query_pt, r, matches);
+    std::vector<size_t>& buffer = buffers[t];
+    std::vector<size_t> res;
 
-  Point p;
-  p.set_schema(&header->schema);
-
-  for (const auto& match : matches)
-  {
-    size_t idx = match.first;
-    p.data = buffer + idx * header->schema.total_point_size;
+    for (size_t i = begin ; i < end ; i++)
+    {
+      const double* q = xyz.data() + 3*i;
 
-    if (filter && filter->filter(&p)) continue;
-    if (p.get_deleted()) continue;
+      if (k > 0 && r > 0)
+        radius_search(tree, q, r, k, res, filter);
+      else if (k > 0)
+        knn(tree, q, k, res, filter);
+      else
+        radius_search(tree, q, r, std::numeric_limits<size_t>::max(), res, filter);
 
-    res.push_back(p);
+      buffer.insert(buffer.end(), res.begin(), res.end());
+      offsets[i+1] = res.size();
+    }
   }
 
-  return true;
+  for (size_t i = 0 ; i < nqueries ; i++) offsets[i+1] += offsets[i];
+
+  idx.clear();
+  idx.reserve(offsets[nqueries]);
+  for (const auto& buffer : buffers) idx.insert(idx.end(), buffer.begin(), buffer.end());
 }
 
 bool PointCloud::get_point(size_t pos, Point* p, PointFilter* const filter) const
 {
-  p->data = buffer + pos * header->schema.total_point_size;
+  locate(*p, pos);
   if (p->get_deleted()) return false;
   if (filter && filter->filter(p)) return false;
   //pt.copy(&p);
@@ -667,27 +943,8 @@ bool PointCloud::add_attribute(const Attribute& attribute)
   else
   {
     size_t previous_size = header->schema.total_point_size;
-    size_t new_size = previous_size + attribute.size;
-    size_t new_capacity = npoints * new_size;
-
     header->schema.add_attribute(attribute);
-
-    if (new_capacity > capacity)
-    {
-      capacity = new_capacity;
-      if (!realloc_buffer()) return false;
-    }
-
-    for (int i = npoints-1 ; i >= 0 ; --i)
-    {
-      memcpy(buffer + i * new_size, buffer + i * previous_size, previous_size);
-      memset(buffer + i * new_size + previous_size, 0, attribute.size); // zero the new data
-    }
-
-    // We need to reset the underlying memory of the
-    // nanoflann adaptor
-    adaptor.data = buffer;
-    adaptor.schema = &header->schema;
+    if (!widen(previous_size)) return false;
   }
   return true;
 }
@@ -701,6 +958,9 @@ bool PointCloud::remove_attributes(const std::vector<std::string>& names_to_remo
 {
   if (names_to_remove.empty()) return true;
 
+  // The records must be complete to remove bytes from them
+  if (pending_size > 0 && !merge_pending()) return false;
+
   std::vector<std::string> actual_names_to_removes;
 
   struct RemoveInfo
@@ -763,8 +1023,30 @@ bool PointCloud::remove_attributes(const std::vector<std::string>& names_to_remo
   size_t old_point_size = header->schema.total_point_size;
   size_t new_point_size = old_point_size - total_remove_size;
 
+  // Step 3 (columnar): the column of the bytes [a, b) of a record is the block [a, b) * column_capacity
+  // of the buffer. We move each block of columns we want to keep at once.
+  if (columnar)
+  {
+    size_t dst_offset = 0;
+    size_t last_offset = 0;
+    for (const auto& r : to_remove)
+    {
+      size_t chunk_size = r.offset - last_offset;
+      if (chunk_size > 0)
+      {
+        memmove(buffer + dst_offset * column_capacity, buffer + last_offset * column_capacity, chunk_size * column_capacity);
+        dst_offset += chunk_size;
+      }
+      last_offset = r.offset + r.size;
+    }
+
+    size_t tail_size = old_point_size - last_offset;
+    if (tail_size > 0)
+      memmove(buffer + dst_offset * column_capacity, buffer + last_offset * column_capacity, tail_size * column_capacity);
+  }
+
   // Step 3: Copy only the bytes we want to keep
-  for (size_t i = 0; i < npoints; ++i)
+  for (size_t i = 0; i < npoints && !columnar; ++i)
   {
     unsigned char* src = buffer + i * old_point_size;
     unsigned char* dst = buffer + i * new_point_size;
@@ -835,27 +1117,9 @@ bool PointCloud::add_attributes(const std::vector<Attribute>& attributes)
 
   if (added_bytes > 0)
   {
-    size_t new_size = previous_size + added_bytes;
-    size_t new_capacity = npoints * new_size;
-
-    if (new_capacity > capacity)
-    {
-      capacity = new_capacity;
-      if (!realloc_buffer()) return false;
-    }
-
-    for (int i = npoints-1 ; i >= 0 ; --i)
-    {
-      memcpy(buffer + i * new_size, buffer + i * previous_size, previous_size);
-      memset(buffer + i * new_size + previous_size, 0, added_bytes); // zero the new data
-    }
+    if (!widen(previous_size)) return false;
   }
 
-  // We need to reset the underlying memory of the
-  // nanoflann adaptor
-  adaptor.data = buffer;
-  adaptor.schema = &header->schema;
-
   return true;
 }
 
@@ -914,31 +1178,124 @@ bool PointCloud::remove_rgb()
   return remove_attributes({"R","G","B"});
 }
 
-bool PointCloud::build_kdtree()
+bool PointCloud::build_kdtree(PointFilter* const filter, int ncpu)
 {
-  if (kdtree == nullptr)
+  const std::string& signature = (filter) ? filter->get_signature() : std::string();
+  bool valid = kdtree_version[0] == xy_version && kdtree_version[1] == z_version && kdtree_filter == signature;
+  if ((kdtree || kdtree64) && valid)
+  {
+    index_stats.hits++;
+    return true;
+  }
+
+  delete kdtree;
+  delete kdtree64;
+  kdtree = nullptr;
+  kdtree64 = nullptr;
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  // Select the points to index
+  PointMask mask;
+  if (filter) filter->filter(this, mask);
+
+  Column<unsigned char> flags = column<unsigned char>(header->schema.attributes[AttributeCore::FLAG]);
+
+  std::vector<unsigned char> keep(npoints);
+  #pragma omp parallel for num_threads(ncpu)
+  for (size_t i = 0 ; i < npoints ; i++)
   {
-    adaptor = PointCloudAdaptor(buffer, npoints, &header->schema);
-    kdtree = new KDTree(3, adaptor, nanoflann::KDTreeSingleIndexAdaptorParams(10));
-    kdtree->buildIndex();
+    keep[i] = (flags[i] & 1) == 0 && !(filter && !mask.get(i));
   }
 
+  size_t n = 0;
+  for (size_t i = 0 ; i < npoints ; i++) n += keep[i];
+
+  kdtree_data.ids.clear();
+  if (n < npoints)
+  {
+    kdtree_data.ids.reserve(n);
+    for (size_t i = 0 ; i < npoints ; i++) { if (keep[i]) kdtree_data.ids.push_back(i); }
+  }
+  std::vector<unsigned char>().swap(keep);
+
+  // Decode the coordinates
+  kdtree_data.xyz.resize(3*n);
+  scan_xyz([&](const auto&, const auto& X, const auto& Y, const auto& Z)
+  {
+    #pragma omp parallel for num_threads(ncpu)
+    for (size_t i = 0 ; i < n ; i++)
+    {
+      size_t id = kdtree_data.id(i);
+      kdtree_data.xyz[3*i] = X.value(id);
+      kdtree_data.xyz[3*i+1] = Y.value(id);
+      kdtree_data.xyz[3*i+2] = Z.value(id);
+    }
+  });
+
+  kdtree_filter = signature;
+
+  // The constructor builds the tree. Compact 32-bit indexes unless the point cloud is too big
+  nanoflann::KDTreeSingleIndexAdaptorParams params(10, nanoflann::KDTreeSingleIndexAdaptorFlags::None, (unsigned int)std::max(ncpu, 1));
+  if (n <= std::numeric_limits<uint32_t>::max())
+    kdtree = new KDTree(3, kdtree_data, params);
+  else
+    kdtree64 = new KDTree64(3, kdtree_data, params);
+
+  kdtree_version[0] = xy_version;
+  kdtree_version[1] = z_version;
+  index_stats.misses++;
+  index_stats.time += std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+
   return true;
 }
 
-bool PointCloud::build_partition()
+bool PointCloud::build_partition(int ncpu)
 {
-  if (gridpartition == nullptr)
+  if (gridpartition && partition_version == xy_version)
   {
-    double res = GridPartition::guess_resolution_from_density(header->density());
-
-    gridpartition = new GridPartition(header->min_x, header->min_y, header->max_x, header->max_y, res);
-    while (read_point()) gridpartition->insert(point.get_x(), point.get_y());
+    index_stats.hits++;
+    return true;
   }
 
+  delete gridpartition;
+  gridpartition = nullptr;
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  double res = GridPartition::guess_resolution_from_density(header->density());
+
+  gridpartition = GridPartition::create(header->min_x, header->min_y, header->max_x, header->max_y, res, npoints);
+
+  // All the points are indexed, including the deleted ones, so that the intervals returned by the
+  // partition are actual point indexes. Deleted points are skipped by the queries.
+  std::vector<int> cells(npoints);
+  scan_xyz([&](const auto&, const auto& X, const auto& Y, const auto&)
+  {
+    #pragma omp parallel for num_threads(ncpu)
+    for (size_t i = 0 ; i < npoints ; i++)
+    {
+      cells[i] = gridpartition->cell_from_xy(X.value(i), Y.value(i));
+    }
+  });
+
+  gridpartition->build(cells, ncpu);
+
+  partition_version = xy_version;
+  index_stats.misses++;
+  index_stats.time += std::chrono::duration<float>(std::chrono::steady_clock::now() - t0).count();
+
   return true;
 }
 
+void PointCloud::touch_xyz(bool xy)
+{
+  if (xy)
+    xy_version++;
+  else
+    z_version++;
+}
+
 void PointCloud::clean_spatialindex()
 {
   clean_query();
@@ -955,10 +1312,10 @@ void PointCloud::clean_spatialindex()
     kdtree = nullptr;
   }
 
-  if (kdtree)
+  if (kdtree64)
   {
-    delete kdtree;
-    kdtree = nullptr;
+    delete kdtree64;
+    kdtree64 = nullptr;
   }
 }
 
@@ -995,7 +1352,7 @@ bool PointCloud::alloc_buffer()
     return false; // # nocov
   }
 
-  buffer = (unsigned char*)calloc(capacity, sizeof(unsigned char));
+  buffer = BufferArena::allocate(capacity);
   if (buffer == NULL)
   {
     // # nocov start
@@ -1008,6 +1365,8 @@ bool PointCloud::alloc_buffer()
     // # nocov end
   }
 
+  buffer_size = capacity;
+  track_memory();
   return true;
 }
 
@@ -1015,20 +1374,25 @@ bool PointCloud::realloc_buffer()
 {
   if (capacity == 0)
   {
-    free(buffer);
+    BufferArena::release(buffer, buffer_size);
     buffer = 0;
+    buffer_size = 0;
+    track_memory();
     return true;
   }
 
-  unsigned char* tmp = (unsigned char*)realloc((void*)buffer, capacity);
+  unsigned char* tmp = BufferArena::reallocate(buffer, buffer_size, capacity);
 
   if (tmp == NULL)
   {
     // # nocov start
-    free(buffer);
+    int err = errno;
+    BufferArena::release(buffer, buffer_size);
     buffer = 0;
+    buffer_size = 0;
+    track_memory();
 
-    if (errno == ENOMEM)
+    if (err == ENOMEM)
       last_error = "Memory reallocation failed: Insufficient memory";
     else
       last_error = "Memory reallocation failed: Unknown error";
@@ -1038,6 +1402,154 @@ bool PointCloud::realloc_buffer()
   }
 
   buffer = tmp;
+  buffer_size = capacity;
+  track_memory();
+  return true;
+}
+
+// Release the memory allocated but not used by the points
+bool PointCloud::shrink_to_fit()
+{
+  if (buffer == NULL) return true;
+  if (columnar) return (column_capacity > npoints) ? resize_columns(npoints) : true;
+
+  size_t required = npoints * record_size();
+  if (required >= capacity) return true;
+
+  capacity = required;
+  return realloc_buffer();
+}
+
+// Report the changes of the memory allocated for the points to the MemoryTracker
+void PointCloud::track_memory()
+{
+  size_t allocated = buffer_size + ((pending) ? pending_size * column_capacity : 0);
+  MemoryTracker::add((int64_t)allocated - (int64_t)tracked_memory);
+  tracked_memory = allocated;
+}
+
+// Adapt the memory after the addition of attributes in the schema. previous_size is the size of a
+// record before the addition. The new bytes are zeroed.
+bool PointCloud::widen(size_t previous_size)
+{
+  size_t new_size = header->schema.total_point_size;
+  if (new_size == previous_size) return true; // e.g. a bit stored in an existing byte
+
+  size_t added_bytes = new_size - previous_size;
+
+  if (columnar)
+  {
+    // The new columns are appended at the end of the buffer. Nothing moves.
+    size_t new_capacity = column_capacity * new_size;
+    if (new_capacity > capacity)
+    {
+      capacity = new_capacity;
+      if (!realloc_buffer()) return false;
+    }
+
+    if (buffer) memset(buffer + previous_size * column_capacity, 0, added_bytes * column_capacity);
+    return true;
+  }
+
+  // Nothing to move. The next points will be added with the new record size.
+  if (npoints == 0) return true;
+
+  // The new bytes are stored in pending columns. The records are not touched until merge_pending()
+  if (pending_size == 0) column_capacity = npoints;
+  unsigned char* tmp = (unsigned char*)realloc(pending, (pending_size + added_bytes) * column_capacity);
+  if (tmp == NULL)
+  {
+    last_error = "Memory allocation failed: Insufficient memory"; // # nocov
+    return false; // # nocov
+  }
+  pending = tmp;
+  memset(pending + pending_size * column_capacity, 0, added_bytes * column_capacity);
+  pending_size += added_bytes;
+  track_memory();
+
+  return true;
+}
+
+// Merge the pending columns in the records in a single pass, whatever the number of attributes
+// added since the last merge.
+bool PointCloud::merge_pending()
+{
+  if (pending_size == 0) return true;
+
+  auto ranges = column_ranges();
+  size_t old_size = record_size();
+  size_t new_size = header->schema.total_point_size;
+
+  size_t new_capacity = npoints * new_size;
+  if (new_capacity > capacity)
+  {
+    capacity = new_capacity;
+    if (!realloc_buffer()) return false;
+  }
+
+  // Records are moved from the last one so a record never overwrites a record not yet moved
+  for (size_t i = npoints ; i-- > 0 ; )
+  {
+    unsigned char* record = buffer + i * new_size;
+    memmove(record, buffer + i * old_size, old_size);
+    for (const auto& range : ranges)
+      memcpy(record + range.first, column_address(range.first) + i * range.second, range.second);
+  }
+
+  free(pending);
+  pending = nullptr;
+  pending_size = 0;
+  column_capacity = 0;
+  track_memory();
+
+  return true;
+}
+
+// Distinct (offset, size) byte ranges of the record stored as columns sorted by offset. All of
+// them in columnar mode, the pending ones in interleaved mode. Bit attributes share a byte.
+std::vector<std::pair<size_t, size_t>> PointCloud::column_ranges() const
+{
+  std::vector<std::pair<size_t, size_t>> ranges;
+  size_t first = record_size();
+  for (const auto& attr : header->schema.attributes)
+  {
+    if (attr.offset >= first) ranges.push_back({attr.offset, attr.size});
+  }
+  std::sort(ranges.begin(), ranges.end());
+  ranges.erase(std::unique(ranges.begin(), ranges.end()), ranges.end());
+  return ranges;
+}
+
+// Change the number of points each column can hold. Each column is moved to its new location.
+// Columns are moved from the last one when growing and from the first one when shrinking so
+// a column never overwrites another column that has not been moved yet.
+bool PointCloud::resize_columns(size_t new_column_capacity)
+{
+  if (new_column_capacity < npoints)
+  {
+    last_error = "Internal error: column capacity smaller than the number of points"; // # nocov
+    return false; // # nocov
+  }
+
+  auto ranges = column_ranges();
+  size_t old_column_capacity = column_capacity;
+
+  if (new_column_capacity > old_column_capacity)
+  {
+    capacity = new_column_capacity * header->schema.total_point_size;
+    if (!realloc_buffer()) return false;
+    for (auto it = ranges.rbegin() ; it != ranges.rend() ; ++it)
+      memmove(buffer + it->first * new_column_capacity, buffer + it->first * old_column_capacity, npoints * it->second);
+  }
+  else if (new_column_capacity < old_column_capacity)
+  {
+    for (auto it = ranges.begin() ; it != ranges.end() ; ++it)
+      memmove(buffer + it->first * new_column_capacity, buffer + it->first * old_column_capacity, npoints * it->second);
+    capacity = new_column_capacity * header->schema.total_point_size;
+    if (!realloc_buffer()) return false;
+  }
+
+  column_capacity = new_column_capacity;
   return true;
 }
 
@@ -4,8 +4,10 @@
 #include "Interval.h"
 #include "Shape.h"
 #include "PointSchema.h"
+#include "PointSpan.h"
 #include "PointFilter.h"
 #include "Header.h"
+#include "Profiler.h"
 
 #ifdef PI
 #undef PI
@@ -14,47 +16,98 @@
 
 #include <vector>
 #include <string>
+#include <type_traits>
 
 class GridPartition;
 class Raster;
 
-struct PointCloudAdaptor
+// Coordinates of the points indexed by the kd-tree. They are decoded once in a contiguous array so
+// neither the build nor the searches decode the point records. The points deleted or filtered out
+// when the index is built are not indexed: 'ids' maps the positions in the array to the indexes
+// of the points in the PointCloud (empty if all the points are indexed).
+struct KDTreeData
 {
-  const unsigned char* data;
-  size_t npoints;
-  const AttributeSchema* schema;
-  PointCloudAdaptor() = default;
-  PointCloudAdaptor(const unsigned char* data, size_t npoints, const AttributeSchema* schema)
-  {
-    this->data = data;
-    this->npoints = npoints;
-    this->schema = schema;
-  }
+  std::vector<double> xyz;
+  std::vector<size_t> ids;
 
-  inline size_t kdtree_get_point_count() const { return npoints; }
-  inline double kdtree_get_pt(const size_t idx, int dim) const
-  {
-    const unsigned char* ptr = data + idx * schema->total_point_size;
-    const auto& attr = schema->attributes[dim+1];
-    switch(attr.type)
-    {
-      case INT32:{ int value = *((int*)(ptr + attr.offset)); return attr.scale_factor * value + attr.value_offset; }
-      case FLOAT: { return *((float*)(ptr + attr.offset)); }
-      case DOUBLE: { return *((double*)(ptr + attr.offset)); }
-      default: return 0;
-    }
-  }
+  inline size_t id(size_t i) const { return (ids.empty()) ? i : ids[i]; }
+  inline size_t kdtree_get_point_count() const { return xyz.size()/3; }
+  inline double kdtree_get_pt(const size_t idx, int dim) const { return xyz[3*idx+dim]; }
 
   template<class BBOX>
   bool kdtree_get_bbox(BBOX& bb) const { return false; }
 };
 
-using KDTree = nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<double, PointCloudAdaptor>, PointCloudAdaptor, 3>;
+// The KDTree stores compact 32-bit point indexes. KDTree64 is used only for point clouds with more
+// than 2^32 points.
+template<typename Index>
+using KDTreeT = nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<double, KDTreeData>, KDTreeData, 3, Index>;
+using KDTree = KDTreeT<uint32_t>;
+using KDTree64 = KDTreeT<uint64_t>;
 
+// Typed access to the raw (unscaled) values of an attribute. Works with both layouts: values are
+// contiguous in columnar mode and strided by the size of a record in interleaved mode. value()
+// returns the scaled value. Loops over all the points such as the scans of X, Y, Z when building
+// the spatial indexes read through a Column rather than locating a Point for each point.
+template<typename T>
+struct Column
+{
+  unsigned char* data = nullptr;
+  size_t stride = 0;
+  size_t size = 0;
+  double scale_factor = 1;
+  double value_offset = 0;
+  inline T& operator[](size_t i) const { return *reinterpret_cast<T*>(data + i * stride); }
+  inline double value(size_t i) const { return scale_factor * (*this)[i] + value_offset; }
+  inline bool contiguous() const { return stride == sizeof(T); }
+};
+
+// Same interface than Column::value() but reads the value through a Point. Used for the
+// coordinates when X, Y and Z are not stored with the same type.
+struct PointColumn
+{
+  Point point; // located on the first point
+  size_t stride = 0;
+  AttributeCore core = AttributeCore::X;
+  inline double value(size_t i) const
+  {
+    Point p(point.data + i * stride, point.schema);
+    p.record_size = point.record_size;
+    p.columns = point.columns;
+    p.column_capacity = point.column_capacity;
+    p.index = i;
+    return p.get_core_attribute_as_double(core);
+  }
+};
+
+template<typename T> constexpr AttributeType attribute_type()
+{
+  if constexpr (std::is_same<T, uint8_t>::value) return UINT8;
+  else if constexpr (std::is_same<T, int8_t>::value) return INT8;
+  else if constexpr (std::is_same<T, uint16_t>::value) return UINT16;
+  else if constexpr (std::is_same<T, int16_t>::value) return INT16;
+  else if constexpr (std::is_same<T, uint32_t>::value) return UINT32;
+  else if constexpr (std::is_same<T, int32_t>::value) return INT32;
+  else if constexpr (std::is_same<T, uint64_t>::value) return UINT64;
+  else if constexpr (std::is_same<T, int64_t>::value) return INT64;
+  else if constexpr (std::is_same<T, float>::value) return FLOAT;
+  else if constexpr (std::is_same<T, double>::value) return DOUBLE;
+  else return NOTYPE;
+}
+
+// The points are stored in a single buffer either interleaved (one record of total_point_size
+// bytes per point, the default) or columnar (structure of arrays). In columnar mode the buffer
+// holds column_capacity points per attribute and the values of the attribute at record offset
+// 'o' start at buffer + o * column_capacity, so adding an attribute appends a column without
+// moving the existing data. Point objects returned by the PointCloud work with both layouts.
+// In interleaved mode, attributes added to a non empty point cloud are not merged immediately in
+// the records. They are stored in 'pending' columns (same layout as columnar mode) and merged in a
+// single pass only when an operation needs complete records (adding points, removing attributes).
+// Several stages adding attributes thus no longer rewrite the whole buffer each.
 class PointCloud
 {
 public:
-  PointCloud(Header* header);
+  PointCloud(Header* header, bool columnar = false);
   ~PointCloud();
   bool add_attribute(const Attribute&);
   bool add_attributes(const std::vector<Attribute>&);
@@ -71,19 +124,49 @@ public:
   bool is_attribute_loadable(int index);
   void delete_point(Point* p = nullptr);
   bool delete_deleted();
+  bool shrink_to_fit();
   //bool sort();
-  bool sort(const std::vector<int>& order);
+  bool sort(const std::vector<uint64_t>& order);
+
+  // The spatial indexes are cached across stages. They are built on demand and rebuilt only if the
+  // points were added, removed, reordered or moved since. Code that edits the coordinates in place
+  // must call touch_xyz(). Z only edits (xy = false) do not invalidate the 2D grid partition.
+  // The kd-tree indexes only the points not deleted and not filtered out by 'filter', so the
+  // queries made with the same filter do not have to skip any point.
+  bool build_kdtree(PointFilter* const filter = nullptr, int ncpu = 1);
+  bool build_partition(int ncpu = 1);
+  void touch_xyz(bool xy = true);
+  const IndexStats& get_index_stats() const { return index_stats; };
 
   // Thread safe queries
-  bool build_kdtree();
-  bool build_partition();
   bool get_point(size_t pos, Point* p, PointFilter* const filter = nullptr) const;
   bool query(const Shape* const shape, std::vector<Point>& addr, PointFilter* const filter = nullptr) const;
-  bool query(const std::vector<Interval>& intervals, std::vector<Point>& addr, PointFilter* const filter = nullptr) const;
+  template<typename Index> bool query(const std::vector<IntervalT<Index>>& intervals, std::vector<Point>& addr, PointFilter* const filter = nullptr) const;
   bool query_sphere(const Point& xyz, double r, std::vector<Point>& res, PointFilter* const filter = nullptr) const;
   bool knn(const Point& xyz, int k, std::vector<Point>& res, PointFilter* const filter = nullptr) const;
   bool rknn(const Point& xyz, int k, double r, std::vector<Point>& res, PointFilter* const filter = nullptr) const;
-  int get_index(Point* p) { size_t index = (size_t)(p->data - buffer); return(index/header->schema.total_point_size); }
+
+  // Thread safe queries returning the indexes of the points. The vector of indexes can be reused
+  // from one query to another and the points are accessed without copy with span()
+  bool query(const Shape* const shape, std::vector<size_t>& idx, PointFilter* const filter = nullptr) const;
+  template<typename Index> bool query(const std::vector<IntervalT<Index>>& intervals, std::vector<size_t>& idx, PointFilter* const filter = nullptr) const;
+  bool query_sphere(const Point& xyz, double r, std::vector<size_t>& idx, PointFilter* const filter = nullptr) const;
+  bool knn(const Point& xyz, int k, std::vector<size_t>& idx, PointFilter* const filter = nullptr) const;
+  bool rknn(const Point& xyz, int k, double r, std::vector<size_t>& idx, PointFilter* const filter = nullptr) const;
+  PointSpan span(const std::vector<size_t>& idx) const;
+
+  // Batched queries. 'xyz' contains the coordinates of the query points (x0,y0,z0,x1,y1,z1,...).
+  // The queries are processed in parallel and the indexes of the neighbours of the query i are
+  // idx[offsets[i]] to idx[offsets[i+1]-1]. r = 0 means no radius limit for knn_batch().
+  bool knn_batch(const std::vector<double>& xyz, int k, double r, std::vector<size_t>& offsets, std::vector<size_t>& idx, PointFilter* const filter = nullptr, int ncpu = 1) const;
+  bool radius_batch(const std::vector<double>& xyz, double r, std::vector<size_t>& offsets, std::vector<size_t>& idx, PointFilter* const filter = nullptr, int ncpu = 1) const;
+  size_t get_index(const Point* p) const { if (columnar) return p->index; size_t index = (size_t)(p->data - buffer); return(index/record_size()); }
+  bool is_columnar() const { return columnar; };
+  template<typename Type> bool get_column(const std::string& name, Column<Type>& col) const;
+
+  // Calls f(flags, X, Y, Z) with views on the flags and the coordinates of all the points (the
+  // deleted ones included). The coordinates are read with X.value(i) whatever their type.
+  template<typename F> void scan_xyz(F&& f) const;
 
   // Spatial queries
   void set_inside(Shape* shape);
@@ -101,7 +184,29 @@ private:
   void clean_query();
   bool alloc_buffer();
   bool realloc_buffer();
+  void track_memory();
+  bool widen(size_t previous_size);
+  bool merge_pending();
+  bool resize_columns(size_t new_column_capacity);
+  std::vector<std::pair<size_t, size_t>> column_ranges() const;
+  template<typename Type> Column<Type> column(const Attribute& attr) const;
+  template<typename Type> Column<Type> raw_column(const Attribute& attr) const { Column<Type> col = column<Type>(attr); col.scale_factor = 1; col.value_offset = 0; return col; }
+  inline size_t record_size() const { return (columnar) ? 0 : header->schema.total_point_size - pending_size; }
+  inline unsigned char* column_address(size_t offset) const { return (columnar) ? buffer + offset * column_capacity : pending + (offset - record_size()) * column_capacity; }
+  inline void locate(Point& p, size_t pos) const
+  {
+    p.record_size = record_size();
+    p.data = buffer + pos * p.record_size;
+    p.columns = (columnar) ? buffer : pending;
+    p.column_capacity = column_capacity;
+    p.index = pos;
+  }
   uint64_t get_true_number_of_points() const;
+  void to_points(const std::vector<size_t>& idx, std::vector<Point>& res) const;
+  bool need_filtering(const PointFilter* filter) const { return filter && filter->get_signature() != kdtree_filter; };
+  template<typename Tree> void knn(const Tree* tree, const double* xyz, int k, std::vector<size_t>& idx, PointFilter* const filter) const;
+  template<typename Tree> void radius_search(const Tree* tree, const double* xyz, double r, size_t k, std::vector<size_t>& idx, PointFilter* const filter) const;
+  template<typename Tree> void batch(const Tree* tree, const std::vector<double>& xyz, int k, double r, std::vector<size_t>& offsets, std::vector<size_t>& idx, PointFilter* const filter, int ncpu) const;
 
 public:
   Header* header;
@@ -111,14 +216,27 @@ public:
 
 private:
   unsigned char* buffer;
+  size_t buffer_size; // bytes allocated for the buffer (see BufferArena)
   size_t capacity; // capacity of the buffer in bytes
-  int next_point;
+  bool columnar;
+  size_t column_capacity; // capacity of the columns in number of points (columnar or pending)
+  unsigned char* pending; // columns of the attributes not yet merged in the records (interleaved only)
+  size_t pending_size;    // number of bytes of the schema stored in 'pending'
+  size_t tracked_memory;  // bytes reported to the MemoryTracker
+  size_t next_point;
 
   // For spatial indexed search
-  PointCloudAdaptor adaptor;
   GridPartition* gridpartition;
+  KDTreeData kdtree_data;
+  std::string kdtree_filter;  // Signature of the filter used to build the kd-tree
   KDTree* kdtree;
-  int current_interval;
+  KDTree64* kdtree64;
+  uint64_t xy_version;        // Incremented when the points are added, removed, reordered or moved in XY
+  uint64_t z_version;         // Incremented when the Z coordinates change
+  uint64_t kdtree_version[2]; // Versions at which the kdtree was built
+  uint64_t partition_version; // Version at which the grid partition was built
+  IndexStats index_stats;
+  size_t current_interval;
   std::vector<Interval> intervals_to_read;
   bool read_started;
   bool inside;
@@ -129,4 +247,70 @@ public:
   enum attributes{X, Y, Z, I, T, RN, NOR, SDF, EoF, CLASS, SYNT, KEYP, WITH, OVER, UD, SA, PSID, R, G, B, NIR, CHAN, BUFF};
 };
 
+template<typename Type>
+Column<Type> PointCloud::column(const Attribute& attr) const
+{
+  Column<Type> col;
+
+  if (attr.offset >= record_size())
+  {
+    col.data = column_address(attr.offset);
+    col.stride = attr.size;
+  }
+  else
+  {
+    col.data = buffer + attr.offset;
+    col.stride = record_size();
+  }
+
+  col.size = npoints;
+  col.scale_factor = attr.scale_factor;
+  col.value_offset = attr.value_offset;
+  return col;
+}
+
+template<typename Type>
+bool PointCloud::get_column(const std::string& name, Column<Type>& col) const
+{
+  const Attribute* attr = header->schema.find_attribute(name);
+  if (attr == nullptr || attr->type != attribute_type<Type>()) return false;
+  col = column<Type>(*attr);
+  return true;
+}
+
+template<typename F>
+void PointCloud::scan_xyz(F&& f) const
+{
+  const auto& attributes = header->schema.attributes;
+  const Attribute& flag = attributes[AttributeCore::FLAG];
+  const Attribute& x = attributes[AttributeCore::X];
+  const Attribute& y = attributes[AttributeCore::Y];
+  const Attribute& z = attributes[AttributeCore::Z];
+
+  // The flags are a byte signed or not depending on the reader. Like Point::get_x() the floating
+  // point coordinates are not scaled
+  Column<unsigned char> flags = column<unsigned char>(flag);
+
+  if (x.type == y.type && x.type == z.type)
+  {
+    switch (x.type)
+    {
+      case INT32: f(flags, column<int32_t>(x), column<int32_t>(y), column<int32_t>(z)); return;
+      case FLOAT: f(flags, raw_column<float>(x), raw_column<float>(y), raw_column<float>(z)); return;
+      case DOUBLE: f(flags, raw_column<double>(x), raw_column<double>(y), raw_column<double>(z)); return;
+      default: break;
+    }
+  }
+
+  PointColumn first;
+  first.point.set_schema(&header->schema);
+  locate(first.point, 0);
+  first.stride = record_size();
+  PointColumn X = first, Y = first, Z = first;
+  X.core = AttributeCore::X;
+  Y.core = AttributeCore::Y;
+  Z.core = AttributeCore::Z;
+  f(flags, X, Y, Z);
+}
+
 #endif
\ No newline at end of file
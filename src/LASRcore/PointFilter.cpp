@@ -1,14 +1,169 @@
 #include "PointFilter.h"
+#include "PointBlock.h"
+#include "PointCloud.h"
 
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <stdexcept>
 #include <iterator>
+#include <cstdio>
+
+// The predicates are evaluated on contiguous arrays of doubles 4 (AVX) or 2 (SSE2) at a time
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_WIDTH 4
+typedef __m256d simd_double;
+static inline simd_double simd_set(double x) { return _mm256_set1_pd(x); }
+static inline simd_double simd_load(const double* x) { return _mm256_loadu_pd(x); }
+static inline simd_double simd_or(simd_double x, simd_double y) { return _mm256_or_pd(x, y); }
+static inline uint64_t simd_movemask(simd_double x) { return (uint64_t)_mm256_movemask_pd(x); }
+#define SIMD_CMP(x, y, avx, sse) _mm256_cmp_pd(x, y, avx)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 2
+typedef __m128d simd_double;
+static inline simd_double simd_set(double x) { return _mm_set1_pd(x); }
+static inline simd_double simd_load(const double* x) { return _mm_loadu_pd(x); }
+static inline simd_double simd_or(simd_double x, simd_double y) { return _mm_or_pd(x, y); }
+static inline uint64_t simd_movemask(simd_double x) { return (uint64_t)_mm_movemask_pd(x); }
+#define SIMD_CMP(x, y, avx, sse) sse(x, y)
+#endif
+
+// Removal tests of the predicates. Comparisons with NaN behave like the scalar operators
+#ifdef SIMD_WIDTH
+#define SIMD_OP(expr) static inline simd_double simd(simd_double v, simd_double a, simd_double b) { return expr; }
+#else
+#define SIMD_OP(expr)
+#endif
+
+struct OpLT { static inline bool scalar(double v, double a, double b) { return v < a; }  SIMD_OP(SIMD_CMP(v, a, _CMP_LT_OQ, _mm_cmplt_pd)) };
+struct OpLE { static inline bool scalar(double v, double a, double b) { return v <= a; } SIMD_OP(SIMD_CMP(v, a, _CMP_LE_OQ, _mm_cmple_pd)) };
+struct OpGT { static inline bool scalar(double v, double a, double b) { return v > a; }  SIMD_OP(SIMD_CMP(v, a, _CMP_GT_OQ, _mm_cmpgt_pd)) };
+struct OpGE { static inline bool scalar(double v, double a, double b) { return v >= a; } SIMD_OP(SIMD_CMP(v, a, _CMP_GE_OQ, _mm_cmpge_pd)) };
+struct OpEQ { static inline bool scalar(double v, double a, double b) { return v == a; } SIMD_OP(SIMD_CMP(v, a, _CMP_EQ_OQ, _mm_cmpeq_pd)) };
+struct OpNE { static inline bool scalar(double v, double a, double b) { return v != a; } SIMD_OP(SIMD_CMP(v, a, _CMP_NEQ_UQ, _mm_cmpneq_pd)) };
+struct OpOutside { static inline bool scalar(double v, double a, double b) { return (v < a) || (v >= b); } SIMD_OP(simd_or(SIMD_CMP(v, a, _CMP_LT_OQ, _mm_cmplt_pd), SIMD_CMP(v, b, _CMP_GE_OQ, _mm_cmpge_pd))) };
+struct OpOutsideClosed { static inline bool scalar(double v, double a, double b) { return (v < a) || (v > b); } SIMD_OP(simd_or(SIMD_CMP(v, a, _CMP_LT_OQ, _mm_cmplt_pd), SIMD_CMP(v, b, _CMP_GT_OQ, _mm_cmpgt_pd))) };
+
+// Set the bit i of 'bits' if the removal test is true for values[i]. Bits beyond n are zero.
+template<typename Op>
+static void compare(const double* values, size_t n, double a, double b, uint64_t* bits)
+{
+  size_t nwords = n / 64;
+
+#ifdef SIMD_WIDTH
+  simd_double va = simd_set(a);
+  simd_double vb = simd_set(b);
+  for (size_t w = 0 ; w < nwords ; w++)
+  {
+    const double* v = values + w * 64;
+    uint64_t word = 0;
+    for (int k = 0 ; k < 64 ; k += SIMD_WIDTH)
+      word |= simd_movemask(Op::simd(simd_load(v + k), va, vb)) << k;
+    bits[w] = word;
+  }
+#else
+  for (size_t w = 0 ; w < nwords ; w++)
+  {
+    const double* v = values + w * 64;
+    uint64_t word = 0;
+    for (int k = 0 ; k < 64 ; k++)
+      word |= (uint64_t)Op::scalar(v[k], a, b) << k;
+    bits[w] = word;
+  }
+#endif
+
+  if (n % 64)
+  {
+    const double* v = values + nwords * 64;
+    uint64_t word = 0;
+    for (size_t k = 0 ; k < n % 64 ; k++)
+      word |= (uint64_t)Op::scalar(v[k], a, b) << k;
+    bits[nwords] = word;
+  }
+}
+
+// Convert n values of type T stored every 'stride' bytes like AttributeAccessor does
+template<typename T>
+static void gather(const unsigned char* pointer, size_t stride, size_t n, const Attribute* attribute, double* values)
+{
+  double scale = attribute->scale_factor;
+  double offset = attribute->value_offset;
+  for (size_t i = 0 ; i < n ; i++)
+    values[i] = offset + scale * static_cast<double>(*reinterpret_cast<const T*>(pointer + i * stride));
+}
+
+static void gather(const Predicate& predicate, const Point& first, size_t n, double* values)
+{
+  const Attribute* attribute = predicate.attribute;
+  if (attribute == nullptr)
+  {
+    std::fill(values, values + n, predicate.default_value);
+    return;
+  }
+
+  // Same addressing than Point::address() for consecutive points
+  const unsigned char* pointer = first.address(*attribute);
+  size_t stride = attribute->size;
+  if (attribute->offset < first.record_size)
+    stride = (first.record_size == Point::full_record) ? first.schema->total_point_size : first.record_size;
+
+  switch (attribute->type)
+  {
+  case BIT:
+  {
+    double scale = attribute->scale_factor;
+    double offset = attribute->value_offset;
+    for (size_t i = 0 ; i < n ; i++)
+      values[i] = offset + scale * static_cast<double>((pointer[i * stride] >> attribute->bit_pos) & 1);
+    break;
+  }
+  case UINT8: gather<uint8_t>(pointer, stride, n, attribute, values); break;
+  case INT8: gather<int8_t>(pointer, stride, n, attribute, values); break;
+  case UINT16: gather<uint16_t>(pointer, stride, n, attribute, values); break;
+  case INT16: gather<int16_t>(pointer, stride, n, attribute, values); break;
+  case UINT32: gather<uint32_t>(pointer, stride, n, attribute, values); break;
+  case INT32: gather<int32_t>(pointer, stride, n, attribute, values); break;
+  case UINT64: gather<uint64_t>(pointer, stride, n, attribute, values); break;
+  case INT64: gather<int64_t>(pointer, stride, n, attribute, values); break;
+  case FLOAT: gather<float>(pointer, stride, n, attribute, values); break;
+  case DOUBLE: gather<double>(pointer, stride, n, attribute, values); break;
+  default: std::fill(values, values + n, predicate.default_value); return;
+  }
+
+  if (predicate.absolute)
+  {
+    for (size_t i = 0 ; i < n ; i++) values[i] = std::abs(values[i]);
+  }
+}
+
+void Condition::compile(const AttributeSchema* schema, std::vector<Predicate>& program)
+{
+  Predicate p = predicate(schema, Predicate::CONDITION);
+  p.condition = this;
+  program.push_back(p);
+}
+
+Predicate Condition::predicate(const AttributeSchema* schema, Predicate::Op op, double a, double b) const
+{
+  Predicate p;
+  p.op = op;
+  p.attribute = name.empty() ? nullptr : schema->find_attribute(name);
+  p.absolute = absolute;
+  p.a = a;
+  p.b = b;
+  p.default_value = default_value;
+  p.condition = nullptr;
+  return p;
+}
 
 class ConditionKeepBelow : public Condition
 {
 public:
   ConditionKeepBelow(const std::string& attribute_name, double threshold) : Condition(attribute_name) { this->threshold = threshold; }
   inline bool filter(const Point* point) { return read(point) >= threshold; }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program) { program.push_back(predicate(schema, Predicate::GE, threshold)); }
 private:
   double threshold;
 };
@@ -18,6 +173,7 @@ class ConditionKeepBelowEqual : public Condition
 public:
   ConditionKeepBelowEqual(const std::string& attribute_name, double threshold) : Condition(attribute_name) { this->threshold = threshold; }
   inline bool filter(const Point* point) { return read(point) > threshold; }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program) { program.push_back(predicate(schema, Predicate::GT, threshold)); }
 private:
   double threshold;
 };
@@ -27,6 +183,7 @@ class ConditionKeepAbove : public Condition
 public:
   ConditionKeepAbove(const std::string& attribute_name, double threshold) : Condition(attribute_name) { this->threshold = threshold; }
   inline bool filter(const Point* point) { return read(point) <= threshold; }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program) { program.push_back(predicate(schema, Predicate::LE, threshold)); }
 private:
   double threshold;
 };
@@ -36,6 +193,7 @@ class ConditionKeepAboveEqual : public Condition
 public:
   ConditionKeepAboveEqual(const std::string& attribute_name, double threshold) : Condition(attribute_name) { this->threshold = threshold; }
   inline bool filter(const Point* point) { return read(point) < threshold; }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program) { program.push_back(predicate(schema, Predicate::LT, threshold)); }
 private:
   double threshold;
 };
@@ -57,6 +215,7 @@ public:
     }
   }
   inline bool filter(const Point* point) { double v = read(point); return (v < below) || (v >= above);  }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program) { program.push_back(predicate(schema, Predicate::OUTSIDE, below, above)); }
 private:
   double below;
   double above;
@@ -67,6 +226,7 @@ class ConditionKeepEqual : public Condition
 public:
   ConditionKeepEqual(const std::string& attribute_name, double value) : Condition(attribute_name) { this->value = value; }
   inline bool filter(const Point* point) { return read(point) != value; }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program) { program.push_back(predicate(schema, Predicate::NE, value)); }
 private:
   double value;
 };
@@ -76,6 +236,7 @@ class ConditionKeepDifferent : public Condition
 public:
   ConditionKeepDifferent(const std::string& attribute_name, double value) : Condition(attribute_name) { this->value = value; }
   inline bool filter(const Point* point) { return read(point) == value; }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program) { program.push_back(predicate(schema, Predicate::EQ, value)); }
 private:
   double value;
 };
@@ -97,6 +258,12 @@ public:
     }
     return true;
   }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program)
+  {
+    Predicate p = predicate(schema, Predicate::IN);
+    p.values = values;
+    program.push_back(p);
+  }
 private:
   std::vector<double> values;
 };
@@ -118,6 +285,12 @@ public:
     }
     return false;
   }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program)
+  {
+    Predicate p = predicate(schema, Predicate::OUT);
+    p.values = values;
+    program.push_back(p);
+  }
 private:
   std::vector<double> values;
 };
@@ -145,6 +318,30 @@ public:
 
     return false;
   }
+  void compile(const AttributeSchema* schema, std::vector<Predicate>& program)
+  {
+    // The circle and the coordinates not stored as scaled integers are tested point by point
+    if (circle || schema->num_attributes() <= AttributeCore::Z ||
+        schema->attributes[AttributeCore::X].type != INT32 ||
+        schema->attributes[AttributeCore::Y].type != INT32)
+    {
+      Condition::compile(schema, program);
+      return;
+    }
+
+    Predicate px = predicate(schema, Predicate::OUTSIDE_CLOSED, xmin, xmax);
+    px.attribute = &schema->attributes[AttributeCore::X];
+    program.push_back(px);
+
+    Predicate py = predicate(schema, Predicate::OUTSIDE_CLOSED, ymin, ymax);
+    py.attribute = &schema->attributes[AttributeCore::Y];
+    program.push_back(py);
+  }
+  void get_attributes(std::vector<std::string>& attributes) const
+  {
+    attributes.push_back("X");
+    attributes.push_back("Y");
+  }
 private:
   double xmin, ymin, xmax, ymax;
   bool circle;
@@ -173,9 +370,113 @@ bool PointFilter::filter(const Point* point) {
   return false; // point survived
 }
 
+void PointFilter::filter(const Point& first, size_t n, PointMask& mask)
+{
+  mask.reset(n);
+  if (n == 0 || conditions.empty()) return;
+
+  compile(first.schema);
+
+  // The predicates are evaluated in the order of the conditions so a condition evaluated point by
+  // point only sees the points that passed the previous conditions, like filter(Point*)
+  for (const auto& predicate : program)
+    evaluate(predicate, first, n, mask);
+}
+
+void PointFilter::filter(const PointBlock& block, PointMask& mask)
+{
+  Point first;
+  if (block.size() > 0) block.seek(0, first);
+  filter(first, block.size(), mask);
+}
+
+void PointFilter::filter(const PointCloud* las, PointMask& mask)
+{
+  Point first;
+  first.schema = &las->header->schema;
+  if (las->npoints > 0) las->get_point(0, &first);
+  filter(first, las->npoints, mask);
+}
+
+void PointFilter::compile(const AttributeSchema* schema)
+{
+  if (schema == compiled_schema && schema->total_point_size == compiled_size) return;
+
+  program.clear();
+  for (const auto condition : conditions)
+    condition->compile(schema, program);
+
+  compiled_schema = schema;
+  compiled_size = schema->total_point_size;
+}
+
+void PointFilter::evaluate(const Predicate& predicate, const Point& first, size_t n, PointMask& mask)
+{
+  size_t nwords = mask.words.size();
+
+  if (predicate.op == Predicate::CONDITION)
+  {
+    Point p(first.data, first.schema);
+    p.record_size = first.record_size;
+    p.columns = first.columns;
+    p.column_capacity = first.column_capacity;
+    size_t stride = (first.record_size == Point::full_record) ? first.schema->total_point_size : first.record_size;
+    for (size_t i = 0 ; i < n ; i++)
+    {
+      if (!mask.get(i)) continue;
+      p.data = first.data + i * stride;
+      p.index = first.index + i;
+      if (predicate.condition->filter(&p)) mask.clear(i);
+    }
+    return;
+  }
+
+  values.resize(n);
+  bits.resize(nwords);
+  gather(predicate, first, n, values.data());
+
+  double a = predicate.a;
+  double b = predicate.b;
+  switch (predicate.op)
+  {
+  case Predicate::LT: compare<OpLT>(values.data(), n, a, b, bits.data()); break;
+  case Predicate::LE: compare<OpLE>(values.data(), n, a, b, bits.data()); break;
+  case Predicate::GT: compare<OpGT>(values.data(), n, a, b, bits.data()); break;
+  case Predicate::GE: compare<OpGE>(values.data(), n, a, b, bits.data()); break;
+  case Predicate::EQ: compare<OpEQ>(values.data(), n, a, b, bits.data()); break;
+  case Predicate::NE: compare<OpNE>(values.data(), n, a, b, bits.data()); break;
+  case Predicate::OUTSIDE: compare<OpOutside>(values.data(), n, a, b, bits.data()); break;
+  case Predicate::OUTSIDE_CLOSED: compare<OpOutsideClosed>(values.data(), n, a, b, bits.data()); break;
+  case Predicate::IN:
+  case Predicate::OUT:
+  {
+    // 'any' flags the points equal to one of the values. %in% removes the others, %out% removes them
+    any.assign(nwords, 0);
+    for (const auto val : predicate.values)
+    {
+      compare<OpEQ>(values.data(), n, val, 0, bits.data());
+      for (size_t w = 0 ; w < nwords ; w++) any[w] |= bits[w];
+    }
+    for (size_t w = 0 ; w < nwords ; w++) bits[w] = (predicate.op == Predicate::IN) ? ~any[w] : any[w];
+    break;
+  }
+  default: return;
+  }
+
+  for (size_t w = 0 ; w < nwords ; w++) mask.words[w] &= ~bits[w];
+}
+
+void PointFilter::get_attributes(std::vector<std::string>& attributes) const
+{
+  for (const auto condition : conditions)
+    condition->get_attributes(attributes);
+}
+
 void PointFilter::reset() {
   for (const auto condition : conditions)
     condition->reset();
+
+  compiled_schema = nullptr;
 }
 
 PointFilter::~PointFilter() {
@@ -186,18 +487,32 @@ void PointFilter::add_condition(Condition* condition)
 {
   if (condition == nullptr) return;
   conditions.push_back(condition);
+  compiled_schema = nullptr;
+
+  // Unknown condition: identified by its address
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%p;", (void*)condition);
+  signature += buf;
 }
 
 void PointFilter::add_condition(const std::string& x)
 {
   FilterParser fp;
   Condition* cond = fp.parse(x);
-  add_condition(cond);
+  if (cond == nullptr) return;
+  conditions.push_back(cond);
+  compiled_schema = nullptr;
+  signature += x + ";";
 }
 
 void PointFilter::add_clip(double xmin, double ymin, double xmax, double ymax, bool circle)
 {
-  add_condition(new ConditionKeepInside(xmin, ymin, xmax, ymax, circle));
+  conditions.push_back(new ConditionKeepInside(xmin, ymin, xmax, ymax, circle));
+  compiled_schema = nullptr;
+
+  char buf[128];
+  snprintf(buf, sizeof(buf), "clip(%.17g,%.17g,%.17g,%.17g,%d);", xmin, ymin, xmax, ymax, (int)circle);
+  signature += buf;
 }
 
 Condition* FilterParser::parse(const std::string& condition) const
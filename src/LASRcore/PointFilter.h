@@ -3,16 +3,63 @@
 
 #include "PointSchema.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
+class PointBlock;
+class PointCloud;
+class Condition;
+
+// A condition compiled against a schema. It describes the test that removes a point as a typed
+// comparison on the column of an attribute so it can be evaluated on many points at once. The
+// conditions that cannot be expressed this way are evaluated point by point with 'condition'.
+struct Predicate
+{
+  enum Op { LT, LE, GT, GE, EQ, NE, OUTSIDE, OUTSIDE_CLOSED, IN, OUT, CONDITION };
+  Op op;
+  const Attribute* attribute; // nullptr if the attribute does not exist in the schema
+  bool absolute;
+  double a;                   // Threshold, value or lower bound
+  double b;                   // Upper bound
+  double default_value;       // Value of the attribute if it does not exist
+  std::vector<double> values; // Values of %in% and %out%
+  Condition* condition;
+};
+
+// Selection of points produced by PointFilter. One bit per point set if the point passes the filter
+class PointMask
+{
+public:
+  void reset(size_t n)
+  {
+    this->n = n;
+    words.assign((n + 63) / 64, ~uint64_t(0));
+    if (n % 64) words.back() = (uint64_t(1) << (n % 64)) - 1;
+  }
+  inline bool get(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+  inline void clear(size_t i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+  size_t size() const { return n; }
+
+public:
+  std::vector<uint64_t> words;
+
+private:
+  size_t n = 0;
+};
+
 class Condition : public AttributeAccessor
 {
 public:
   Condition() : AttributeAccessor() {};
   Condition(const std::string& attribute_name) : AttributeAccessor(attribute_name) {};
   virtual bool filter(const Point* point) = 0;
+  virtual void compile(const AttributeSchema* schema, std::vector<Predicate>& program);
+  virtual void get_attributes(std::vector<std::string>& attributes) const { if (!name.empty()) attributes.push_back(name); };
   virtual ~Condition(){};
+
+protected:
+  Predicate predicate(const AttributeSchema* schema, Predicate::Op op, double a = 0, double b = 0) const;
 };
 
 class FilterParser
@@ -31,16 +78,42 @@ class PointFilter
 {
 public:
   bool filter(const Point* point);
+
+  // Evaluate the filter on 'n' consecutive points starting at 'first' and set the bits of the
+  // points that pass the filter in 'mask'. The conditions are compiled once against the schema
+  // and evaluated attribute by attribute with SIMD instructions when available.
+  void filter(const Point& first, size_t n, PointMask& mask);
+  void filter(const PointBlock& block, PointMask& mask);
+  void filter(const PointCloud* las, PointMask& mask);
+
   void add_condition(const std::string& x);
   void add_condition(Condition* condition);
   void add_clip(double xmin, double ymin, double xmax, double ymax, bool circle = false);
   void reset();
+  bool empty() const { return conditions.empty(); };
+  void get_attributes(std::vector<std::string>& attributes) const;
+
+  // Two filters with the same signature filter the same points. Used to reuse data computed with
+  // a filter, such as a spatial index of the points that are not filtered out.
+  const std::string& get_signature() const { return signature; };
 
   PointFilter() = default;
   ~PointFilter();
 
 private:
+  void compile(const AttributeSchema* schema);
+  void evaluate(const Predicate& predicate, const Point& first, size_t n, PointMask& mask);
+
   std::vector<Condition*> conditions;
+  std::string signature;
+
+  // Conditions compiled for a given schema
+  std::vector<Predicate> program;
+  const AttributeSchema* compiled_schema = nullptr;
+  size_t compiled_size = 0;
+  std::vector<double> values;
+  std::vector<uint64_t> bits;
+  std::vector<uint64_t> any;
 };
 
 
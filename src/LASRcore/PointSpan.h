@@ -0,0 +1,58 @@
+#ifndef POINTSPAN_H
+#define POINTSPAN_H
+
+#include "PointSchema.h"
+
+#include <vector>
+#include <cstddef>
+
+// A PointSpan is a non owning view of a subset of the points of a PointCloud given by their
+// indexes. Neighbourhood queries fill a vector of indexes that the caller can reuse from one query
+// to another instead of a std::vector<Point>. The points are read straight from the buffer of the
+// PointCloud through a single Point proxy relocated on each access. Consequently the reference
+// returned by operator[] or by the iterator is valid only until the next access.
+class PointSpan
+{
+public:
+  class iterator
+  {
+  public:
+    iterator(const PointSpan* span, size_t pos) : span(span), pos(pos) {}
+    inline const Point& operator*() const { return (*span)[pos]; }
+    inline iterator& operator++() { pos++; return *this; }
+    inline bool operator!=(const iterator& other) const { return pos != other.pos; }
+    inline bool operator==(const iterator& other) const { return pos == other.pos; }
+
+  private:
+    const PointSpan* span;
+    size_t pos;
+  };
+
+  PointSpan() : indexes(nullptr), n(0), base(nullptr) {}
+
+  // 'origin' must be a Point of the PointCloud located at index 0. It carries the layout.
+  PointSpan(const Point& origin, const size_t* indexes, size_t n) : proxy(origin), indexes(indexes), n(n), base(origin.data) {}
+  PointSpan(const Point& origin, const std::vector<size_t>& indexes) : PointSpan(origin, indexes.data(), indexes.size()) {}
+
+  inline size_t size() const { return n; }
+  inline bool empty() const { return n == 0; }
+  inline size_t index(size_t i) const { return indexes[i]; }
+  inline const Point& operator[](size_t i) const
+  {
+    size_t idx = indexes[i];
+    proxy.data = base + idx * proxy.record_size;
+    proxy.index = idx;
+    return proxy;
+  }
+
+  inline iterator begin() const { return iterator(this, 0); }
+  inline iterator end() const { return iterator(this, n); }
+
+private:
+  mutable Point proxy;
+  const size_t* indexes;
+  size_t n;
+  unsigned char* base;
+};
+
+#endif
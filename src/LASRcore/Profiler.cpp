@@ -11,8 +11,8 @@ Profiler::Profiler()
 float Profiler::elapsed() const
 {
   auto time = std::chrono::high_resolution_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(time - t0);
-  return (float)duration.count()/1000.0f;
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(time - t0);
+  return (float)((double)duration.count()/1000000.0);
 }
 
 void Profiler::tic()
@@ -25,18 +25,31 @@ void Profiler::toc()
   end = elapsed();
 }
 
-void Profiler::insert(const std::string& name)
+void Profiler::insert(const std::string& name, uint64_t npoints, float busy)
 {
-  Profile pr(name, start, end, omp_get_thread_num());
+  if (busy < 0) busy = end - start;
+  Profile pr(name, start, end, omp_get_thread_num(), npoints, busy);
   profiles.push_back(pr);
 }
 
+void Profiler::insert(const std::string& name, uint64_t npoints, const IndexStats& index)
+{
+  insert(name, npoints);
+  profiles.back().index = index;
+}
+
+float Profile::throughput() const
+{
+  if (npoints == 0 || busy <= 0) return 0;
+  return (float)npoints/busy;
+}
+
 void Profiler::write(const std::string& path) const
 {
   if (path.empty()) return;
   FILE* fp = fopen(path.c_str(), "w");
   if (fp == NULL) return;
-  fprintf(fp, "name, start, end, thread\n");
-  for (const auto& profile : profiles) fprintf(fp, "%s, %.2f, %.2f, %d\n", profile.name.c_str(), profile.start, profile.end, profile.thread);
+  fprintf(fp, "name, start, end, thread, npoints, points_per_sec, index_hits, index_misses, index_time, memory_mb\n");
+  for (const auto& profile : profiles) fprintf(fp, "%s, %.2f, %.2f, %d, %llu, %.0f, %u, %u, %.2f, %.1f\n", profile.name.c_str(), profile.start, profile.end, profile.thread, (unsigned long long)profile.npoints, profile.throughput(), profile.index.hits, profile.index.misses, profile.index.time, profile.memory/1024.0/1024.0);
   fclose(fp);
 }
\ No newline at end of file
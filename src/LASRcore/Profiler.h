@@ -4,15 +4,31 @@
 #include <vector>
 #include <chrono>
 #include <string>
+#include <cstdint>
+
+// Usage of the spatial indexes cached in a PointCloud
+struct IndexStats
+{
+  IndexStats() : hits(0), misses(0), time(0) {};
+  IndexStats operator-(const IndexStats& other) const { IndexStats s; s.hits = hits - other.hits; s.misses = misses - other.misses; s.time = time - other.time; return s; };
+  uint32_t hits;   // Number of requests of an index already built
+  uint32_t misses; // Number of indexes built
+  float time;      // Time spent building the indexes
+};
 
 struct Profile
 {
-  Profile() : start(0), end(0), thread(0) {};
-  Profile(std::string name, float start, float end, int thread) : name(name), start(start), end(end), thread(thread) {};
+  Profile() : start(0), end(0), thread(0), npoints(0), busy(0), memory(0) {};
+  Profile(std::string name, float start, float end, int thread, uint64_t npoints = 0, float busy = 0) : name(name), start(start), end(end), thread(thread), npoints(npoints), busy(busy), memory(0) {};
+  float throughput() const;
   std::string name;
   float start;
   float end;
   int thread;
+  uint64_t npoints; // Number of points processed
+  float busy;       // Time actually spent in the stage. In streaming mode stages are interleaved and end-start is not meaningful
+  IndexStats index; // Spatial indexes requested by the stage
+  uint64_t memory;  // Peak memory of the points in bytes (chunks only)
 };
 
 struct Profiler
@@ -21,7 +37,8 @@ struct Profiler
   void tic();
   void toc();
   float elapsed() const;
-  void insert(const std::string& name);
+  void insert(const std::string& name, uint64_t npoints = 0, float busy = -1);
+  void insert(const std::string& name, uint64_t npoints, const IndexStats& index);
   void write(const std::string& path) const;
 
   std::chrono::time_point<std::chrono::high_resolution_clock> t0;
@@ -0,0 +1,73 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include "openmp.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Stable LSD radix sort of integer 'keys' carrying the 'values' along. Only the 'bits' lowest bits of
+// the keys are sorted. Each pass processes 8 bits: the threads count the digits of a contiguous range
+// of the input then scatter their range at offsets computed from the counts of all the threads. The
+// order of equal keys is thus preserved whatever the number of threads.
+template<typename Key, typename Value>
+void radix_sort(std::vector<Key>& keys, std::vector<Value>& values, int bits = sizeof(Key)*8, int ncpu = 1)
+{
+  const size_t n = keys.size();
+  if (n < 2) return;
+
+  // Small arrays are not worth the synchronisation of the threads
+  int nthreads = (int)std::min<size_t>(ncpu, n/65536 + 1);
+  if (nthreads < 1) nthreads = 1;
+
+  std::vector<Key> tmp_keys(n);
+  std::vector<Value> tmp_values(n);
+  std::vector<size_t> counts((size_t)nthreads*256);
+
+  for (int shift = 0 ; shift < bits ; shift += 8)
+  {
+    std::fill(counts.begin(), counts.end(), 0);
+    int nt = 1;
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+      #pragma omp single
+      nt = omp_get_num_threads();
+
+      int t = omp_get_thread_num();
+      size_t begin = n*t/nt;
+      size_t end = n*(t+1)/nt;
+      size_t* count = &counts[(size_t)t*256];
+
+      for (size_t i = begin ; i < end ; i++) count[(keys[i] >> shift) & 0xFF]++;
+
+      #pragma omp barrier
+      #pragma omp single
+      {
+        size_t sum = 0;
+        for (int d = 0 ; d < 256 ; d++)
+        {
+          for (int k = 0 ; k < nt ; k++)
+          {
+            size_t c = counts[(size_t)k*256+d];
+            counts[(size_t)k*256+d] = sum;
+            sum += c;
+          }
+        }
+      }
+
+      for (size_t i = begin ; i < end ; i++)
+      {
+        size_t pos = count[(keys[i] >> shift) & 0xFF]++;
+        tmp_keys[pos] = keys[i];
+        tmp_values[pos] = values[i];
+      }
+    }
+
+    keys.swap(tmp_keys);
+    values.swap(tmp_values);
+  }
+}
+
+#endif
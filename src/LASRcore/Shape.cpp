@@ -45,7 +45,7 @@ bool PointXY::operator==(const PointXY& other) const
 
 PointXYI::PointXYI() : PointXY(), i(0) {}
 PointXYI::PointXYI(double x, double y) : PointXY(x,y), i(0) {}
-PointXYI::PointXYI(double x, double y, unsigned int i) : PointXY(x,y), i(i) {}
+PointXYI::PointXYI(double x, double y, uint64_t i) : PointXY(x,y), i(i) {}
 
 PointXYZ::PointXYZ() : PointXY(), z(0) {}
 PointXYZ::PointXYZ(double x, double y) : PointXY(x,y), z(0) {}
@@ -27,8 +27,8 @@ struct PointXYI : public PointXY
 {
   PointXYI();
   PointXYI(double x, double y);
-  PointXYI(double x, double y, unsigned int i);
-  unsigned int i;
+  PointXYI(double x, double y, uint64_t i);
+  uint64_t i;
 };
 
 struct PointXYZ : public PointXY
@@ -1,5 +1,7 @@
 #include "Stage.h"
 
+#include <algorithm>
+
 /* ==============
  *  VIRTUAL
  *  ============= */
@@ -11,8 +13,10 @@ Stage::Stage()
   xmax = 0;
   ymax = 0;
   verbose = false;
+  columnar = false;
   circular = false;
   progress = nullptr;
+  strip_cache = nullptr;
   ncpu = 1;
   ncpu_concurrent_files = 1;
 
@@ -31,9 +35,11 @@ Stage::Stage(const Stage& other)
   ymax = other.ymax;
   circular = other.circular;
   verbose = other.verbose;
+  columnar = other.columnar;
   ifile = other.ifile;
   uid = other.uid;
   progress = other.progress;
+  strip_cache = other.strip_cache;
   connections = other.connections;
   crs = other.crs;
   set_filter(other.filters);
@@ -58,6 +64,47 @@ bool Stage::set_chunk(Chunk& chunk)
   return true;
 }
 
+// Default adaptor for stages that do not have a native block implementation. It loops over the
+// block and calls the per-point process(Point*&). An empty block means that the stage is the
+// source of the pipeline (a reader): the block is filled with successive calls to process(Point*&)
+// until it is full or the reader returns nullptr meaning that there are no more points.
+bool Stage::process(PointBlock& block)
+{
+  if (block.empty())
+  {
+    Point* p = nullptr;
+    while (!block.full())
+    {
+      if (!process(p))
+      {
+        delete p;
+        return false;
+      }
+
+      if (p == nullptr)
+      {
+        block.eof = true;
+        break;
+      }
+
+      block.push_back(*p);
+    }
+
+    delete p;
+    return true;
+  }
+
+  Point point;
+  for (size_t i = 0 ; i < block.size() ; ++i)
+  {
+    block.seek(i, point);
+    Point* p = &point;
+    if (!process(p)) return false;
+  }
+
+  return true;
+}
+
 void Stage::set_filter(const std::vector<std::string>& f)
 {
   filters = f;
@@ -67,6 +114,13 @@ void Stage::set_filter(const std::vector<std::string>& f)
 
 }
 
+void Stage::push_filter(const std::string& condition)
+{
+  if (std::find(filters.begin(), filters.end(), condition) != filters.end()) return;
+  filters.push_back(condition);
+  pointfilter.add_condition(condition);
+}
+
 /*void Stage::set_filter(const std::string& f)
 {
   filter = f;
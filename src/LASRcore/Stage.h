@@ -15,6 +15,7 @@
 
 // lasR
 #include "PointCloud.h"
+#include "PointBlock.h"
 #include "FileCollection.h"
 #include "Raster.h"
 #include "Vector.h"
@@ -23,6 +24,7 @@
 #include "error.h"
 #include "print.h"
 #include "PointFilter.h"
+#include "StripCache.h"
 
 // JSON parser
 #include "nlohmann/json.hpp"
@@ -41,6 +43,7 @@
  *  9. get_crs()
  *  10. set_filter()
  *  11. set_output_file()
+ *      need_attributes() then push_filter(), set_decoded_attributes() and set_projected_attributes() on the reader
  * In the copy constructor of a Pipeline
  *  12. clone()
  * In Pipeline::set_chunk()
@@ -52,7 +55,7 @@
  *  17. process()
  *  18. process(LASheader)
  *  19. set_header()
- *  20. process(LAS)
+ *  20. process(LAS) or process(PointBlock) in streaming mode
  *  21. write()
  *  22. reset_filter()
  *  23. clear()
@@ -76,6 +79,7 @@ public:
   virtual bool process() { return true; };
   virtual bool process(Header*& header) { return true; };
   virtual bool process(Point*& p) { return true; };
+  virtual bool process(PointBlock& block);
   virtual bool process(PointCloud*& las) { return true; };
   virtual bool process(FileCollection*& las) { return true; };
   virtual bool break_pipeline() { return false; };
@@ -93,6 +97,23 @@ public:
   virtual bool use_rcapi() const { return false; };
   virtual double need_buffer() const { return 0; };
   virtual bool need_points() const { return true; };
+
+  // Predicate pushdown (see Engine::push_down()). need_attributes() appends the attributes the stage
+  // reads, not counting its filter, and returns false if the stage may read any attribute.
+  // written_attributes() appends the attributes the stage modifies in place and that must exist.
+  // keep_only_attributes() returns true if the stage removes all the attributes but the ones it
+  // appends. is_filter_pushable() returns false if the points that do not pass the filter of the
+  // stage can change its output. The reader receives the conditions shared by all the stages, the
+  // attributes that it must decode and the attributes that it must load.
+  virtual bool need_attributes(std::vector<std::string>& attributes) const { return false; };
+  virtual void written_attributes(std::vector<std::string>& attributes) const { return; };
+  virtual bool keep_only_attributes(std::vector<std::string>& attributes) const { return false; };
+  virtual bool is_filter_pushable() const { return true; };
+  virtual void set_decoded_attributes(const std::vector<std::string>& attributes) { return; };
+  virtual void set_projected_attributes(const std::vector<std::string>& attributes) { return; };
+  void push_filter(const std::string& condition);
+  void get_filter_attributes(std::vector<std::string>& attributes) const { pointfilter.get_attributes(attributes); };
+  const std::vector<std::string>& get_filters() const { return filters; };
   virtual void get_extent(double& xmin, double& ymin, double& xmax, double& ymax) { return; };
 
   virtual bool connect(const std::list<std::unique_ptr<Stage>>&, const std::string& uid) { return true; };
@@ -105,10 +126,12 @@ public:
   void set_ncpu(int ncpu) { this->ncpu = ncpu; }
   void set_ncpu_concurrent_files(int ncpu) { this->ncpu_concurrent_files = ncpu; }
   void set_verbose(bool verbose) { this->verbose = verbose; };
+  void set_columnar(bool columnar) { this->columnar = columnar; };
   void set_uid(std::string s) { uid = s; };
   void set_filter(const std::vector<std::string>& f);
   //void set_filter(const std::string& f);
   void set_progress(Progress* progress) { this->progress = progress; };
+  void set_strip_cache(StripCache* cache) { this->strip_cache = cache; };
   void set_chunk(double xmin, double ymin, double xmax, double ymax) { this->xmin = xmin; this->ymin = ymin; this->xmax = xmax; this->ymax = ymax; };
   void reset_filter() { pointfilter.reset(); };
 
@@ -153,13 +176,16 @@ protected:
   double buffer;
   bool circular;
   bool verbose;
+  bool columnar; // Memory layout of the point clouds created by readers
   CRS crs;
   std::string ifile;
   std::string ofile;
   std::string uid;
   std::vector<std::string> filters;
   PointFilter pointfilter;
+  PointMask pointmask; // Points of a block or a point cloud that pass 'pointfilter'
   Progress* progress;
+  StripCache* strip_cache; // Shared by all the pipelines of the run. Can be nullptr
   std::map<std::string, Stage*> connections;
 
 #ifdef USING_R
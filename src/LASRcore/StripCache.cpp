@@ -0,0 +1,123 @@
+#include "StripCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Tolerance on the width of the band so that a chunk buffered by 'buffer' (plus the epsilon used
+// by the queries) is entirely covered by the strips of its neighbours.
+static constexpr double MARGIN_TOLERANCE = 1e-6;
+
+Strip::Strip(const AttributeSchema& schema, double xmin, double ymin, double xmax, double ymax, double buffer) : schema(schema)
+{
+  point_size = schema.total_point_size;
+  npoints = 0;
+  file_npoints = 0;
+  this->xmin = xmin;
+  this->ymin = ymin;
+  this->xmax = xmax;
+  this->ymax = ymax;
+  margin = buffer + MARGIN_TOLERANCE;
+}
+
+bool Strip::in_band(double x, double y) const
+{
+  return x < xmin + margin || x > xmax - margin || y < ymin + margin || y > ymax - margin;
+}
+
+bool Strip::covers(double xmin, double ymin, double xmax, double ymax) const
+{
+  // The bbox does not intersect the inner part of the file that is not in the band
+  return xmax <= this->xmin + margin || xmin > this->xmax - margin || ymax <= this->ymin + margin || ymin > this->ymax - margin;
+}
+
+void Strip::push_back(const Point* p)
+{
+  if (!in_band(p->get_x(), p->get_y())) return;
+
+  size_t n = records.size();
+  records.resize(n + point_size);
+  memcpy(records.data() + n, p->data, point_size);
+  npoints++;
+}
+
+StripCache::StripCache(uint64_t capacity) : capacity(capacity)
+{
+}
+
+std::shared_ptr<const Strip> StripCache::get(const std::string& key)
+{
+  std::shared_ptr<const Strip> strip;
+
+  #pragma omp critical (stripcache)
+  {
+    auto it = map.find(key);
+    if (it != map.end())
+    {
+      lru.splice(lru.begin(), lru, it->second);
+      strip = it->second->second;
+      stats.hits++;
+    }
+    else
+    {
+      stats.misses++;
+    }
+  }
+
+  return strip;
+}
+
+bool StripCache::contains(const std::string& key)
+{
+  bool found;
+
+  #pragma omp critical (stripcache)
+  {
+    found = map.find(key) != map.end();
+  }
+
+  return found;
+}
+
+void StripCache::insert(const std::string& key, std::shared_ptr<const Strip> strip)
+{
+  #pragma omp critical (stripcache)
+  {
+    if (strip->memory() > capacity)
+    {
+      stats.rejections++;
+    }
+    else if (map.find(key) == map.end()) // Another thread may have inserted the same strip
+    {
+      while (!lru.empty() && stats.memory + strip->memory() > capacity)
+      {
+        stats.memory -= lru.back().second->memory();
+        map.erase(lru.back().first);
+        lru.pop_back();
+        stats.evictions++;
+      }
+
+      lru.emplace_front(key, strip);
+      map[key] = lru.begin();
+      stats.memory += strip->memory();
+      stats.peak_memory = std::max(stats.peak_memory, stats.memory);
+      stats.insertions++;
+    }
+  }
+}
+
+void StripCache::clear()
+{
+  #pragma omp critical (stripcache)
+  {
+    lru.clear();
+    map.clear();
+    stats.memory = 0;
+  }
+}
+
+std::string StripCache::make_key(const std::string& file, double buffer, const std::vector<std::string>& filters)
+{
+  std::string key = file + "|" + std::to_string(buffer);
+  for (const auto& filter : filters) key += "|" + filter;
+  return key;
+}
@@ -0,0 +1,71 @@
+#ifndef STRIPCACHE_H
+#define STRIPCACHE_H
+
+#include "PointSchema.h"
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+// The points of a file that are within 'buffer' of the edges of its bounding box, stored as raw
+// records of 'schema'. A strip is all what the neighbouring chunks need from this file to build
+// their buffer. A strip is immutable once inserted in the StripCache.
+struct Strip
+{
+  Strip(const AttributeSchema& schema, double xmin, double ymin, double xmax, double ymax, double buffer);
+  bool in_band(double x, double y) const;
+  bool covers(double xmin, double ymin, double xmax, double ymax) const; // All the points of the file in this bbox are in the strip
+  void push_back(const Point* p); // Copies the point if it is in the band
+  inline const unsigned char* record(size_t i) const { return records.data() + i * point_size; }
+  inline size_t size() const { return npoints; }
+  inline uint64_t memory() const { return records.capacity(); }
+
+  AttributeSchema schema;
+  size_t point_size;
+  size_t npoints;
+  uint64_t file_npoints;    // Number of points in the file
+  double xmin, ymin, xmax, ymax; // Bounding box of the file
+  double margin;            // Width of the band
+  std::vector<unsigned char> records;
+};
+
+// Memory bounded cache of the Strips shared by all the pipelines of a run. Without the cache a
+// LAZ file is decompressed once as the main file of its chunk plus once for each adjacent chunk
+// that needs it as a buffer. Strips are evicted in least recently used order when the memory
+// used exceeds the capacity. Thread safe.
+class StripCache
+{
+public:
+  struct Stats
+  {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t insertions = 0;
+    uint64_t evictions = 0;
+    uint64_t rejections = 0; // Strips larger than the capacity
+    uint64_t memory = 0;
+    uint64_t peak_memory = 0;
+  };
+
+  StripCache(uint64_t capacity = 0);
+  void set_capacity(uint64_t bytes) { capacity = bytes; };
+  bool enabled() const { return capacity > 0; };
+  std::shared_ptr<const Strip> get(const std::string& key);
+  bool contains(const std::string& key);
+  void insert(const std::string& key, std::shared_ptr<const Strip> strip);
+  void clear();
+  Stats get_stats() const { return stats; };
+  static std::string make_key(const std::string& file, double buffer, const std::vector<std::string>& filters);
+
+private:
+  typedef std::list<std::pair<std::string, std::shared_ptr<const Strip>>> LRU;
+  uint64_t capacity;
+  LRU lru; // Most recently used first
+  std::unordered_map<std::string, LRU::iterator> map;
+  Stats stats;
+};
+
+#endif
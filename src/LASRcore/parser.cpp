@@ -175,6 +175,8 @@ bool Engine::parse(const nlohmann::json& json, bool progress)
           std::vector<std::string> files = get_vector<std::string>(stage["files"]);
 
           catalog = std::make_shared<FileCollection>();
+          catalog->set_ncpu(stage.value("ncpu", 1));
+          catalog->set_header_cache(stage.value("header_cache", ""));
           if (!catalog->read(files, progress))
           {
             last_error = "In the parser while reading the file collection: " + last_error; // # nocov
@@ -547,6 +549,8 @@ bool Engine::parse(const nlohmann::json& json, bool progress)
         it++;
       }
 
+      push_down();
+
       // Write lax is the very first stage. Even before read_las. It is called
       // only if needed.
       if (!catalog->check_spatial_index() && !indexer && catalog->get_format() == LASFILE)
@@ -6,6 +6,9 @@
 #include "lasindex.hpp"
 #include "lasquadtree.hpp"
 
+#include <algorithm>
+#include <fstream>
+
 #define EPSILON 1e-9
 
 LASio::LASio()
@@ -37,6 +40,9 @@ LASio::LASio()
   keypoint_bit = AttributeAccessor("Keypoint");
   overlap_bit = AttributeAccessor("Overlap");
 
+  laz_chunk_size = 0;
+  decompress_selective = LASZIP_DECOMPRESS_SELECTIVE_ALL;
+
   copc_depth = -1;
   copc_density = 256;
 }
@@ -86,6 +92,9 @@ bool LASio::query(const std::vector<std::string>& main_files, const std::vector<
   lasreadopener->parse_str(filtercpy);
   lasreadopener->set_copc_stream_ordered_by_chunk();
 
+  // Must be set after the filters that add the layers they need
+  if (decompress_selective != LASZIP_DECOMPRESS_SELECTIVE_ALL) lasreadopener->set_decompress_selective(decompress_selective);
+
   free(filtercpy);
 
   for (auto& file : main_files) lasreadopener->add_file_name(file.c_str(), TRUE);
@@ -117,6 +126,15 @@ bool LASio::query(const std::vector<std::string>& main_files, const std::vector<
     lasreader->header.clean_lasoriginal();
   }
 
+  // Read in place when LASlib would read the whole file sequentially (see open_raw())
+  if (main_files.size() == 1 && neighbour_files.empty() && sfilter.empty() && !circle)
+    open_raw(main_files[0], xmin - buffer - EPSILON, ymin - buffer - EPSILON, xmax + buffer + EPSILON, ymax + buffer + EPSILON);
+
+  // Same condition for a LAZ file to be decompressed chunk by chunk (see find_laz_chunk_size())
+  laz_chunk_size = 0;
+  if (main_files.size() == 1 && neighbour_files.empty() && sfilter.empty() && !circle)
+    laz_chunk_size = find_laz_chunk_size(main_files[0], xmin - buffer - EPSILON, ymin - buffer - EPSILON, xmax + buffer + EPSILON, ymax + buffer + EPSILON);
+
   lasheader = &lasreader->header;
 
   // We did not use LASreaderBuffered so we build a LASvlr_lasoriginal by hand.
@@ -143,6 +161,7 @@ void LASio::open(const std::string& file)
 
   lasreadopener = new LASreadOpener;
   lasreadopener->add_file_name(file.c_str());
+  if (decompress_selective != LASZIP_DECOMPRESS_SELECTIVE_ALL) lasreadopener->set_decompress_selective(decompress_selective);
   lasreader = lasreadopener->open();
 
   if (!lasreader)
@@ -264,7 +283,6 @@ void LASio::populate_header(Header* header, bool read_first_point)
     double scale = lasreader->header.attributes[i].scale[0];
     double offset = lasreader->header.attributes[i].offset[0];
     header->schema.add_attribute(name, type, scale, offset, description);
-    extrabytes.push_back(AttributeAccessor(name));
   }
 
   header->schema.add_attribute("EdgeOfFlightline", AttributeType::BIT, 1, 0, "Set when the point is at the end of a scan");
@@ -479,7 +497,7 @@ void LASio::init(const Header* header)
 
   reset_accessor();
 
-  extrabytes_offsets.clear();
+  extrabytes_index.clear();
   for (size_t i = 0 ; i < header->schema.attributes.size() ; i++)
   {
     const Attribute& attribute = header->schema.attributes[i];
@@ -490,7 +508,7 @@ void LASio::init(const Header* header)
       attr.set_scale(attribute.scale_factor);
       attr.set_offset(attribute.value_offset);
       lasheader->add_attribute(attr);
-      extrabytes_offsets.push_back(attribute.offset);
+      extrabytes_index.push_back(i);
     }
   }
 
@@ -514,8 +532,260 @@ void LASio::init(const Header* header)
 
 bool LASio::read_point(Point* p)
 {
+  if (raw.map.is_open()) return read_raw_point(p);
   if (!lasreader->read_point()) return false;
+  if (decoder.schema != p->schema) compile_decoder(p->schema);
+  (this->*decoder.kernel)(p);
+  return true;
+}
+
+bool LASio::write_point(Point* p)
+{
+  if (encoder.schema != p->schema) compile_encoder(p->schema);
+  (this->*encoder.kernel)(p);
+  laswriter->write_point(point);
+  laswriter->update_inventory(point);
+  return true;
+}
+
+namespace
+{
+  // Checks that an attribute is in the schema with the given type and without scale and offset
+  const Attribute* find_native(const AttributeSchema* schema, const char* name, AttributeType type, bool& native)
+  {
+    const Attribute* attribute = schema->find_attribute(name);
+    if (attribute == nullptr || attribute->type != type || attribute->scale_factor != 1 || attribute->value_offset != 0) native = false;
+    return attribute;
+  }
+
+  // Same but an attribute that is not in the schema is allowed: it is not decoded
+  const Attribute* find_decoded(const AttributeSchema* schema, const char* name, AttributeType type, bool& native)
+  {
+    const Attribute* attribute = schema->find_attribute(name);
+    if (attribute && (attribute->type != type || attribute->scale_factor != 1 || attribute->value_offset != 0)) native = false;
+    return attribute;
+  }
+
+  // The decoders skip the attributes that are not in the schema (see find_decoded())
+  template<typename T> inline void store(Point* p, const Attribute* attribute, T value) { if (attribute) memcpy(p->address(*attribute), &value, sizeof(T)); }
+  template<typename T> inline T load(const Point* p, const Attribute* attribute) { T value; memcpy(&value, p->address(*attribute), sizeof(T)); return value; }
+  inline void store_bit(Point* p, const Attribute* attribute, bool value) { if (attribute) *p->address(*attribute) |= (value << attribute->bit_pos); }
+  inline bool load_bit(const Point* p, const Attribute* attribute) { return (*p->address(*attribute) >> attribute->bit_pos) & 1; }
+}
+
+void LASio::compile_decoder(const AttributeSchema* schema)
+{
+  const LASpoint& q = lasreader->point;
+  const LASheader& h = lasreader->header;
+  bool extended = q.extended_point_type;
+  bool gps = q.have_gps_time;
+  bool rgb = q.have_rgb;
+  bool nir = q.have_nir;
+
+  Codec& c = decoder;
+  c = Codec();
+  c.schema = schema;
+  c.native = true;
+  c.intensity = find_decoded(schema, "Intensity", AttributeType::UINT16, c.native);
+  c.returnnumber = find_decoded(schema, "ReturnNumber", AttributeType::UINT8, c.native);
+  c.numberofreturns = find_decoded(schema, "NumberOfReturns", AttributeType::UINT8, c.native);
+  c.classification = find_decoded(schema, "Classification", AttributeType::UINT8, c.native);
+  c.userdata = find_decoded(schema, "UserData", AttributeType::UINT8, c.native);
+  c.psid = find_decoded(schema, "PointSourceID", AttributeType::INT16, c.native);
+  c.scanangle = find_decoded(schema, "ScanAngle", extended ? AttributeType::FLOAT : AttributeType::INT8, c.native);
+  c.eof_bit = find_decoded(schema, "EdgeOfFlightline", AttributeType::BIT, c.native);
+  c.scandirection_bit = find_decoded(schema, "ScanDirectionFlag", AttributeType::BIT, c.native);
+  c.synthetic_bit = find_decoded(schema, "Synthetic", AttributeType::BIT, c.native);
+  c.keypoint_bit = find_decoded(schema, "Keypoint", AttributeType::BIT, c.native);
+  c.withheld_bit = find_decoded(schema, "Withheld", AttributeType::BIT, c.native);
+  if (extended) c.scannerchannel = find_decoded(schema, "ScannerChannel", AttributeType::UINT8, c.native);
+  if (extended) c.overlap_bit = find_decoded(schema, "Overlap", AttributeType::BIT, c.native);
+  if (gps) c.gpstime = find_decoded(schema, "gpstime", AttributeType::DOUBLE, c.native);
+  if (rgb) c.red = find_decoded(schema, "R", AttributeType::UINT16, c.native);
+  if (rgb) c.green = find_decoded(schema, "G", AttributeType::UINT16, c.native);
+  if (rgb) c.blue = find_decoded(schema, "B", AttributeType::UINT16, c.native);
+  if (nir) c.nir = find_decoded(schema, "NIR", AttributeType::UINT16, c.native);
+
+  // A core attribute that the file does not have (e.g. a schema merged from files of different
+  // formats) is handled by the generic path that writes the value returned by LASlib. Attributes
+  // of the file that are not in the schema (see LASRlasreader::set_projected_attributes()) are
+  // not decoded by the native kernels.
+  std::vector<std::string> absent = {"ScanAngleRank"};
+  if (!extended) absent.insert(absent.end(), {"ScannerChannel", "Overlap"});
+  if (!gps) absent.push_back("gpstime");
+  if (!rgb) absent.insert(absent.end(), {"R", "G", "B"});
+  if (!nir) absent.push_back("NIR");
+  for (const auto& attribute : schema->attributes)
+  {
+    if (std::find(absent.begin(), absent.end(), attribute.name) != absent.end()) c.native = false;
+  }
+
+  for (int i = 0 ; i < h.number_attributes ; i++)
+  {
+    const LASattribute& attr = h.attributes[i];
+    if (attr.data_type > 10) continue; // Don't read deprecated types
+
+    Extrabyte e;
+    e.index = i;
+    e.attribute = schema->find_attribute(attr.name);
+    e.start = h.attribute_starts[i];
+    e.size = h.attribute_sizes[i];
+    // #117: skip extra-byte attributes that the point record does not actually back
+    // (malformed Extra Bytes VLR, see populate_header) to avoid a null/OOB dereference.
+    e.backed = q.extra_bytes != nullptr && e.start + e.size <= q.extra_bytes_number;
+    e.raw = e.attribute && e.attribute->type == (AttributeType)attr.data_type && (int)e.attribute->size == e.size && e.attribute->scale_factor == attr.scale[0] && e.attribute->value_offset == attr.offset[0];
+    e.accessor = AttributeAccessor(attr.name);
+    if (e.attribute && e.backed) c.extrabytes.push_back(e);
+  }
+
+  typedef void (LASio::*Kernel)(Point*);
+  static const Kernel kernels[16] = {
+    &LASio::decode<false, false, false, false>, &LASio::decode<false, false, false, true>,
+    &LASio::decode<false, false, true,  false>, &LASio::decode<false, false, true,  true>,
+    &LASio::decode<false, true,  false, false>, &LASio::decode<false, true,  false, true>,
+    &LASio::decode<false, true,  true,  false>, &LASio::decode<false, true,  true,  true>,
+    &LASio::decode<true,  false, false, false>, &LASio::decode<true,  false, false, true>,
+    &LASio::decode<true,  false, true,  false>, &LASio::decode<true,  false, true,  true>,
+    &LASio::decode<true,  true,  false, false>, &LASio::decode<true,  true,  false, true>,
+    &LASio::decode<true,  true,  true,  false>, &LASio::decode<true,  true,  true,  true>
+  };
+
+  c.kernel = (c.native) ? kernels[8*extended + 4*gps + 2*rgb + nir] : &LASio::decode_generic;
+}
+
+void LASio::compile_encoder(const AttributeSchema* schema)
+{
+  Codec& c = encoder;
+  c = Codec();
+  c.schema = schema;
+  c.native = true;
+  c.intensity = find_native(schema, "Intensity", AttributeType::UINT16, c.native);
+  c.returnnumber = find_native(schema, "ReturnNumber", AttributeType::UINT8, c.native);
+  c.numberofreturns = find_native(schema, "NumberOfReturns", AttributeType::UINT8, c.native);
+  c.classification = find_native(schema, "Classification", AttributeType::UINT8, c.native);
+  c.userdata = find_native(schema, "UserData", AttributeType::UINT8, c.native);
+  c.psid = find_native(schema, "PointSourceID", AttributeType::INT16, c.native);
+  c.eof_bit = find_native(schema, "EdgeOfFlightline", AttributeType::BIT, c.native);
+  c.scandirection_bit = find_native(schema, "ScanDirectionFlag", AttributeType::BIT, c.native);
+  c.synthetic_bit = find_native(schema, "Synthetic", AttributeType::BIT, c.native);
+  c.keypoint_bit = find_native(schema, "Keypoint", AttributeType::BIT, c.native);
+  c.withheld_bit = find_native(schema, "Withheld", AttributeType::BIT, c.native);
+
+  // ScanAngle is a float in extended formats and an integer in legacy formats. Both are written in any format.
+  bool native_float = true;
+  bool native_int = true;
+  c.scanangle = find_native(schema, "ScanAngle", AttributeType::FLOAT, native_float);
+  find_native(schema, "ScanAngle", AttributeType::INT8, native_int);
+  c.scanangle_float = native_float;
+  if (!native_float && !native_int) c.native = false;
+
+  // Optional attributes: absent means 0 like with an AttributeAccessor
+  bool gps = false;
+  bool rgb = false;
+  bool nir = false;
+  if (schema->has_attribute("ScannerChannel")) c.scannerchannel = find_native(schema, "ScannerChannel", AttributeType::UINT8, c.native);
+  if (schema->has_attribute("Overlap")) c.overlap_bit = find_native(schema, "Overlap", AttributeType::BIT, c.native);
+  if (point->have_gps_time && schema->has_attribute("gpstime"))
+  {
+    c.gpstime = find_native(schema, "gpstime", AttributeType::DOUBLE, c.native);
+    gps = true;
+  }
+  if (point->have_rgb && (schema->has_attribute("R") || schema->has_attribute("G") || schema->has_attribute("B")))
+  {
+    c.red = find_native(schema, "R", AttributeType::UINT16, c.native);
+    c.green = find_native(schema, "G", AttributeType::UINT16, c.native);
+    c.blue = find_native(schema, "B", AttributeType::UINT16, c.native);
+    rgb = true;
+  }
+  if (point->have_nir && schema->has_attribute("NIR"))
+  {
+    c.nir = find_native(schema, "NIR", AttributeType::UINT16, c.native);
+    nir = true;
+  }
+
+  // The fields that the kernel does not write must not keep the values of a previous schema
+  point->set_gps_time(0);
+  point->set_R(0);
+  point->set_G(0);
+  point->set_B(0);
+  point->set_NIR(0);
+
+  // The integer coordinates can be copied if the quantization is the same
+  const Attribute& x = schema->attributes[AttributeCore::X];
+  const Attribute& y = schema->attributes[AttributeCore::Y];
+  const Attribute& z = schema->attributes[AttributeCore::Z];
+  c.requantize = x.type != AttributeType::INT32 || y.type != AttributeType::INT32 || z.type != AttributeType::INT32 ||
+                 x.scale_factor != lasheader->x_scale_factor || y.scale_factor != lasheader->y_scale_factor || z.scale_factor != lasheader->z_scale_factor ||
+                 x.value_offset != lasheader->x_offset || y.value_offset != lasheader->y_offset || z.value_offset != lasheader->z_offset;
+
+  for (size_t i = 0 ; i < extrabytes_index.size() ; i++)
+  {
+    Extrabyte e;
+    e.index = i;
+    e.attribute = &schema->attributes[extrabytes_index[i]];
+    e.start = 0;
+    e.size = e.attribute->size;
+    e.backed = true;
+    e.raw = true;
+    c.extrabytes.push_back(e);
+  }
+
+  typedef void (LASio::*Kernel)(Point*);
+  static const Kernel kernels[8] = {
+    &LASio::encode<false, false, false>, &LASio::encode<false, false, true>,
+    &LASio::encode<false, true,  false>, &LASio::encode<false, true,  true>,
+    &LASio::encode<true,  false, false>, &LASio::encode<true,  false, true>,
+    &LASio::encode<true,  true,  false>, &LASio::encode<true,  true,  true>
+  };
+
+  c.kernel = (c.native) ? kernels[4*gps + 2*rgb + nir] : &LASio::encode_generic;
+}
+
+template<bool EXTENDED, bool GPS, bool RGB, bool NIR>
+void LASio::decode(Point* p)
+{
+  const LASpoint& q = lasreader->point;
+  const Codec& c = decoder;
+
+  p->zero();
+  p->set_X(q.get_X());
+  p->set_Y(q.get_Y());
+  p->set_Z(q.get_Z());
+  store<uint16_t>(p, c.intensity, q.get_intensity());
+  store<uint8_t>(p, c.returnnumber, q.get_return_number());
+  store<uint8_t>(p, c.numberofreturns, q.get_number_of_returns());
+  store<uint8_t>(p, c.classification, q.get_classification());
+  store<uint8_t>(p, c.userdata, q.get_user_data());
+  store<int16_t>(p, c.psid, (int16_t)std::min<int>(q.get_point_source_ID(), std::numeric_limits<int16_t>::max()));
+
+  if constexpr (EXTENDED)
+  {
+    store<float>(p, c.scanangle, q.get_scan_angle());
+    store<uint8_t>(p, c.scannerchannel, q.get_extended_scanner_channel());
+  }
+  else
+  {
+    store<int8_t>(p, c.scanangle, q.get_scan_angle_rank());
+  }
+
+  if constexpr (GPS) store<double>(p, c.gpstime, q.get_gps_time());
+  if constexpr (RGB) store<uint16_t>(p, c.red, q.get_R());
+  if constexpr (RGB) store<uint16_t>(p, c.green, q.get_G());
+  if constexpr (RGB) store<uint16_t>(p, c.blue, q.get_B());
+  if constexpr (NIR) store<uint16_t>(p, c.nir, q.get_NIR());
+
+  decode_extrabytes(p);
+
+  store_bit(p, c.eof_bit, q.get_edge_of_flight_line());
+  store_bit(p, c.scandirection_bit, q.get_scan_direction_flag());
+  store_bit(p, c.withheld_bit, q.get_withheld_flag());
+  store_bit(p, c.synthetic_bit, q.get_synthetic_flag());
+  store_bit(p, c.keypoint_bit, q.get_keypoint_flag());
+  if constexpr (EXTENDED) store_bit(p, c.overlap_bit, q.get_extended_overlap_flag());
+}
 
+void LASio::decode_generic(Point* p)
+{
   p->zero();
   p->set_X(lasreader->point.get_X());
   p->set_Y(lasreader->point.get_Y());
@@ -533,26 +803,344 @@ bool LASio::read_point(Point* p)
   green(p, lasreader->point.get_G());
   blue(p, lasreader->point.get_B());
   nir(p, lasreader->point.get_NIR());
-  for (int i = 0 ; i < lasreader->header.number_attributes ; i++)
-  {
-    if (lasreader->header.attributes[i].data_type > 10) continue; // Don't read deprecated types
-    // #117: skip extra-byte attributes that the point record does not actually back
-    // (malformed Extra Bytes VLR, see populate_header) to avoid a null/OOB dereference.
-    if (lasreader->point.extra_bytes == nullptr ||
-        lasreader->header.attribute_starts[i] + lasreader->header.attribute_sizes[i] > lasreader->point.extra_bytes_number)
-      continue;
-    extrabytes[i](p, lasreader->point.get_attribute_as_float(i));
-  }
+  decode_extrabytes(p);
   eof_bit(p, lasreader->point.get_edge_of_flight_line());
   scandirection_bit(p, lasreader->point.get_scan_direction_flag());
   withheld_bit(p, lasreader->point.get_withheld_flag());
   synthetic_bit(p, lasreader->point.get_synthetic_flag());
   keypoint_bit(p, lasreader->point.get_keypoint_flag());
   overlap_bit(p, lasreader->point.get_extended_overlap_flag());
+}
+
+void LASio::decode_extrabytes(Point* p)
+{
+  for (auto& e : decoder.extrabytes)
+  {
+    if (e.raw)
+      memcpy(p->address(*e.attribute), lasreader->point.extra_bytes + e.start, e.size);
+    else
+      e.accessor(p, lasreader->point.get_attribute_as_float(e.index));
+  }
+}
+
+bool LASio::open_raw(const std::string& file, double xmin, double ymin, double xmax, double ymax)
+{
+  close_raw();
+
+  // A spatial index changes the order in which LASlib reads the points
+  const LASheader& h = lasreader->header;
+  if (lasreader->get_index() || lasreader->get_copcindex() || h.laszip) return false;
+
+  int format = h.point_data_format;
+  if (format > 10) return false;
+
+  static const int record_length[] = {20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67};
+  if (h.point_data_record_length < record_length[format]) return false;
+
+  if (!raw.map.open(file)) return false;
+
+  // The layout of the records is read in the file itself because LASlib adjusts some fields of
+  // its header (e.g. the offset to the point data of LAS 1.0 files). Bits 6 and 7 of the point
+  // data format are set in LAZ files.
+  const unsigned char* data = raw.map.begin();
+  if (raw.map.get_size() < 227 || memcmp(data, "LASF", 4) != 0 || (data[104] & 0xC0) != 0 || data[104] != format)
+  {
+    close_raw();
+    return false;
+  }
+
+  uint32_t start;
+  uint16_t length;
+  uint32_t legacy_npoints;
+  uint64_t npoints = 0;
+  memcpy(&start, data + 96, 4);
+  memcpy(&length, data + 105, 2);
+  memcpy(&legacy_npoints, data + 107, 4);
+  if (data[25] >= 4 && raw.map.get_size() >= 255) memcpy(&npoints, data + 247, 8);
+  npoints = std::max<uint64_t>(npoints, legacy_npoints);
+
+  if (start > raw.map.get_size() || length != h.point_data_record_length)
+  {
+    close_raw();
+    return false;
+  }
+
+  bool extended = format >= 6;
+  bool gps = format != 0 && format != 2;
+  bool rgb = format == 2 || format == 3 || format == 5 || format == 7 || format == 8 || format == 10;
+  bool nir = format == 8 || format == 10;
+
+  raw.record_length = length;
+  raw.extrabytes_start = record_length[format];
+  raw.gps = (extended) ? 22 : 20;
+  raw.rgb = (extended) ? 30 : 20 + 8*gps;
+  raw.nir = 36;
+  raw.next = data + start;
+  raw.end = raw.next + std::min<uint64_t>(npoints, (raw.map.get_size() - start) / length) * length;
+  raw.xmin = xmin;
+  raw.ymin = ymin;
+  raw.xmax = xmax;
+  raw.ymax = ymax;
+  raw.count = 0;
+
+  typedef void (LASio::*Kernel)(Point*, const unsigned char*);
+  static const Kernel kernels[16] = {
+    &LASio::decode_raw<false, false, false, false>, &LASio::decode_raw<false, false, false, true>,
+    &LASio::decode_raw<false, false, true,  false>, &LASio::decode_raw<false, false, true,  true>,
+    &LASio::decode_raw<false, true,  false, false>, &LASio::decode_raw<false, true,  false, true>,
+    &LASio::decode_raw<false, true,  true,  false>, &LASio::decode_raw<false, true,  true,  true>,
+    &LASio::decode_raw<true,  false, false, false>, &LASio::decode_raw<true,  false, false, true>,
+    &LASio::decode_raw<true,  false, true,  false>, &LASio::decode_raw<true,  false, true,  true>,
+    &LASio::decode_raw<true,  true,  false, false>, &LASio::decode_raw<true,  true,  false, true>,
+    &LASio::decode_raw<true,  true,  true,  false>, &LASio::decode_raw<true,  true,  true,  true>
+  };
+  raw.kernel = kernels[8*extended + 4*gps + 2*rgb + nir];
+
   return true;
 }
 
-bool LASio::write_point(Point* p)
+// LAZ files with point formats 6 to 10 store the attributes in separate layers. The layers of the
+// attributes that are not in 'names' are not decompressed and these attributes are read as 0. The
+// coordinates, the returns and the flags are always decoded. The extra bytes are all decoded or
+// not at all because their layout is only known once the file is opened. Must be called before
+// query() or open().
+void LASio::set_decoded_attributes(const std::vector<std::string>& names)
+{
+  static const std::unordered_map<std::string, uint32_t> layers = {
+    {"Classification", LASZIP_DECOMPRESS_SELECTIVE_CLASSIFICATION},
+    {"Intensity", LASZIP_DECOMPRESS_SELECTIVE_INTENSITY},
+    {"ScanAngle", LASZIP_DECOMPRESS_SELECTIVE_SCAN_ANGLE},
+    {"UserData", LASZIP_DECOMPRESS_SELECTIVE_USER_DATA},
+    {"PointSourceID", LASZIP_DECOMPRESS_SELECTIVE_POINT_SOURCE},
+    {"gpstime", LASZIP_DECOMPRESS_SELECTIVE_GPS_TIME},
+    {"R", LASZIP_DECOMPRESS_SELECTIVE_RGB},
+    {"G", LASZIP_DECOMPRESS_SELECTIVE_RGB},
+    {"B", LASZIP_DECOMPRESS_SELECTIVE_RGB},
+    {"NIR", LASZIP_DECOMPRESS_SELECTIVE_NIR}
+  };
+
+  decompress_selective = LASZIP_DECOMPRESS_SELECTIVE_CHANNEL_RETURNS_XY | LASZIP_DECOMPRESS_SELECTIVE_Z | LASZIP_DECOMPRESS_SELECTIVE_FLAGS;
+
+  for (std::string name : names)
+  {
+    if (name.size() >= 2 && name.front() == '|' && name.back() == '|') name = name.substr(1, name.size() - 2);
+    name = map_attribute(name);
+
+    auto it = layers.find(name);
+    if (it != layers.end())
+      decompress_selective |= it->second;
+    else if (lascoreattributes.count(name) == 0)
+      decompress_selective |= LASZIP_DECOMPRESS_SELECTIVE_EXTRA_BYTES;
+  }
+}
+
+void LASio::close_raw()
+{
+  raw.map.close();
+  raw.next = nullptr;
+  raw.end = nullptr;
+}
+
+// The chunks of a LAZ file are compressed independently and the chunk table gives their position
+// in the file. A file with chunks of fixed size can thus be decompressed by several readers that
+// seek to the first point of a chunk. The points read sequentially and tested against the query
+// rectangle are the same and in the same order than with LASlib. With a spatial index LASlib reads
+// the intervals of the cells in the order of the file, so this is only worth it if the query
+// contains the whole file. COPC files are read by hierarchy, not by chunk.
+uint32_t LASio::find_laz_chunk_size(const std::string& file, double xmin, double ymin, double xmax, double ymax)
+{
+  const LASheader& h = lasreader->header;
+  if (h.laszip == nullptr) return 0;
+  if (h.laszip->compressor != LASZIP_COMPRESSOR_POINTWISE_CHUNKED && h.laszip->compressor != LASZIP_COMPRESSOR_LAYERED_CHUNKED) return 0;
+  if (h.laszip->chunk_size == 0 || h.laszip->chunk_size == U32_MAX) return 0; // Variable chunks
+  if (lasreader->get_copcindex()) return 0;
+
+  if (lasreader->get_index())
+  {
+    // LASlib replaced the bounding box of its header by the query rectangle. It is read in the file.
+    double bbox[4]; // max x, min x, max y, min y
+    std::ifstream f(file, std::ios::binary);
+    if (!f.seekg(179) || !f.read((char*)bbox, sizeof(bbox))) return 0;
+    if (bbox[1] < xmin || bbox[3] < ymin || bbox[0] >= xmax || bbox[2] >= ymax) return 0;
+  }
+
+  return h.laszip->chunk_size;
+}
+
+int64_t LASio::get_npoints() const
+{
+  if (lasreader == nullptr)
+    throw std::logic_error("Internal error. LASreader not initialized."); // # nocov
+
+  return lasreader->npoints;
+}
+
+// Next point read is the point 'index' of the file
+bool LASio::seek(int64_t index)
+{
+  if (lasreader == nullptr)
+    throw std::logic_error("Internal error. LASreader not initialized."); // # nocov
+
+  if (raw.map.is_open()) return false;
+  return lasreader->seek(index);
+}
+
+bool LASio::read_raw_point(Point* p)
+{
+  if (decoder.schema != p->schema)
+  {
+    compile_decoder(p->schema);
+
+    // Only the native kernels have a raw counterpart. Otherwise LASlib continues from here.
+    bool supported = decoder.native;
+    for (const auto& e : decoder.extrabytes) supported &= e.raw && raw.extrabytes_start + e.start + e.size <= raw.record_length;
+    if (!supported)
+    {
+      lasreader->seek(raw.count);
+      close_raw();
+      return read_point(p);
+    }
+  }
+
+  const LASheader& h = lasreader->header;
+
+  while (raw.next < raw.end)
+  {
+    const unsigned char* r = raw.next;
+    raw.next += raw.record_length;
+    raw.count++;
+
+    // Same test as LASreader::read_point_inside_rectangle()
+    int32_t X, Y;
+    memcpy(&X, r, 4);
+    memcpy(&Y, r + 4, 4);
+    double x = h.x_scale_factor * X + h.x_offset;
+    double y = h.y_scale_factor * Y + h.y_offset;
+    if (x < raw.xmin || x >= raw.xmax || y < raw.ymin || y >= raw.ymax) continue;
+
+    (this->*raw.kernel)(p, r);
+    return true;
+  }
+
+  return false;
+}
+
+// Same values as LASio::decode() with the fields read from the LAS record instead of the LASpoint
+template<bool EXTENDED, bool GPS, bool RGB, bool NIR>
+void LASio::decode_raw(Point* p, const unsigned char* r)
+{
+  const Codec& c = decoder;
+
+  auto read16 = [](const unsigned char* b) { uint16_t v; memcpy(&v, b, 2); return v; };
+  int32_t X, Y, Z;
+  memcpy(&X, r, 4);
+  memcpy(&Y, r + 4, 4);
+  memcpy(&Z, r + 8, 4);
+
+  p->zero();
+  p->set_X(X);
+  p->set_Y(Y);
+  p->set_Z(Z);
+  store<uint16_t>(p, c.intensity, read16(r + 12));
+  store<uint8_t>(p, c.userdata, r[17]);
+
+  bool synthetic, keypoint, withheld, scandirection, eof;
+  if constexpr (EXTENDED)
+  {
+    uint8_t flags = r[15] & 0x0F;
+    store<uint8_t>(p, c.returnnumber, r[14] & 0x0F);
+    store<uint8_t>(p, c.numberofreturns, r[14] >> 4);
+    store<uint8_t>(p, c.classification, r[16]);
+    store<float>(p, c.scanangle, 0.006f * (int16_t)read16(r + 18));
+    store<uint8_t>(p, c.scannerchannel, (r[15] >> 4) & 0x03);
+    store<int16_t>(p, c.psid, (int16_t)std::min<int>(read16(r + 20), std::numeric_limits<int16_t>::max()));
+    synthetic = flags & 1;
+    keypoint = (flags >> 1) & 1;
+    withheld = (flags >> 2) & 1;
+    scandirection = (r[15] >> 6) & 1;
+    eof = r[15] >> 7;
+    store_bit(p, c.overlap_bit, (flags >> 3) & 1);
+  }
+  else
+  {
+    store<uint8_t>(p, c.returnnumber, r[14] & 0x07);
+    store<uint8_t>(p, c.numberofreturns, (r[14] >> 3) & 0x07);
+    store<uint8_t>(p, c.classification, r[15] & 0x1F);
+    store<int8_t>(p, c.scanangle, (int8_t)r[16]);
+    store<int16_t>(p, c.psid, (int16_t)std::min<int>(read16(r + 18), std::numeric_limits<int16_t>::max()));
+    synthetic = (r[15] >> 5) & 1;
+    keypoint = (r[15] >> 6) & 1;
+    withheld = r[15] >> 7;
+    scandirection = (r[14] >> 6) & 1;
+    eof = r[14] >> 7;
+  }
+
+  if constexpr (GPS) { double t; memcpy(&t, r + raw.gps, 8); store<double>(p, c.gpstime, t); }
+  if constexpr (RGB) store<uint16_t>(p, c.red, read16(r + raw.rgb));
+  if constexpr (RGB) store<uint16_t>(p, c.green, read16(r + raw.rgb + 2));
+  if constexpr (RGB) store<uint16_t>(p, c.blue, read16(r + raw.rgb + 4));
+  if constexpr (NIR) store<uint16_t>(p, c.nir, read16(r + raw.nir));
+
+  for (const auto& e : c.extrabytes)
+    memcpy(p->address(*e.attribute), r + raw.extrabytes_start + e.start, e.size);
+
+  store_bit(p, c.eof_bit, eof);
+  store_bit(p, c.scandirection_bit, scandirection);
+  store_bit(p, c.withheld_bit, withheld);
+  store_bit(p, c.synthetic_bit, synthetic);
+  store_bit(p, c.keypoint_bit, keypoint);
+}
+
+template<bool GPS, bool RGB, bool NIR>
+void LASio::encode(Point* p)
+{
+  const Codec& c = encoder;
+
+  if (c.requantize)
+  {
+    point->set_x(p->get_x());
+    point->set_y(p->get_y());
+    point->set_z(p->get_z());
+  }
+  else
+  {
+    point->set_X(p->get_X());
+    point->set_Y(p->get_Y());
+    point->set_Z(p->get_Z());
+  }
+
+  uint8_t rn = load<uint8_t>(p, c.returnnumber);
+  uint8_t nr = load<uint8_t>(p, c.numberofreturns);
+  uint8_t cl = load<uint8_t>(p, c.classification);
+  point->set_intensity(load<uint16_t>(p, c.intensity));
+  point->set_return_number(rn);
+  point->set_number_of_returns(nr);
+  point->set_user_data(load<uint8_t>(p, c.userdata));
+  point->set_point_source_ID((uint16_t)load<int16_t>(p, c.psid));
+  point->set_classification(cl);
+  point->set_scan_angle((c.scanangle_float) ? load<float>(p, c.scanangle) : (float)load<int8_t>(p, c.scanangle));
+  if constexpr (GPS) point->set_gps_time(load<double>(p, c.gpstime));
+  if constexpr (RGB) point->set_R(load<uint16_t>(p, c.red));
+  if constexpr (RGB) point->set_G(load<uint16_t>(p, c.green));
+  if constexpr (RGB) point->set_B(load<uint16_t>(p, c.blue));
+  if constexpr (NIR) point->set_NIR(load<uint16_t>(p, c.nir));
+  point->set_edge_of_flight_line(load_bit(p, c.eof_bit));
+  point->set_scan_direction_flag(load_bit(p, c.scandirection_bit));
+  point->set_synthetic_flag(load_bit(p, c.synthetic_bit));
+  point->set_withheld_flag(load_bit(p, c.withheld_bit));
+  point->set_keypoint_flag(load_bit(p, c.keypoint_bit));
+
+  point->set_extended_overlap_flag((c.overlap_bit) ? load_bit(p, c.overlap_bit) : 0);
+  point->set_extended_scanner_channel((c.scannerchannel) ? load<uint8_t>(p, c.scannerchannel) : 0);
+  point->set_extended_return_number(rn);
+  point->set_extended_number_of_returns(nr);
+  point->set_extended_classification(cl);
+
+  for (const auto& e : c.extrabytes)
+    point->set_attribute(e.index, p->address(*e.attribute));
+}
+
+void LASio::encode_generic(Point* p)
 {
   point->set_x(p->get_x());
   point->set_y(p->get_y());
@@ -581,13 +1169,8 @@ bool LASio::write_point(Point* p)
   point->set_extended_number_of_returns(numberofreturns(p));
   point->set_extended_classification(classification(p));
 
-  for (size_t i = 0 ; i < extrabytes_offsets.size() ; i++)
-    point->set_attribute(i, p->data + extrabytes_offsets[i]);
-
-  laswriter->write_point(point);
-  laswriter->update_inventory(point);
-
-  return true;
+  for (const auto& e : encoder.extrabytes)
+    point->set_attribute(e.index, p->address(*e.attribute));
 }
 
 void LASio::write_lax(const std::string& file, bool overwrite, bool embedded, IProgress* progress)
@@ -688,11 +1271,15 @@ bool LASio::is_opened()
 
 int64_t LASio::p_count()
 {
+  if (raw.map.is_open()) return raw.count;
   return lasreader->p_count;
 }
 
 void LASio::close()
 {
+  close_raw();
+  laz_chunk_size = 0;
+
   if (lasreader)
   {
     lasreader->close();
@@ -752,8 +1339,8 @@ void LASio::reset_accessor()
   synthetic_bit.reset();
   keypoint_bit.reset();
   overlap_bit.reset();
-  for (auto& accessor : extrabytes)
-    accessor.reset();
+  decoder = Codec();
+  encoder = Codec();
 }
 
 
@@ -4,6 +4,7 @@
 #include "Fileio.h"
 #include "Header.h"
 #include "PointSchema.h"
+#include "MappedFile.h"
 
 #include <string>
 #include <vector>
@@ -34,6 +35,7 @@ public:
   void reset_accessor() override;
   void set_copc_max_depth(int depth);
   void set_copc_density(int density);
+  void set_decoded_attributes(const std::vector<std::string>& names);
   int64_t p_count() override;
 
   // Tools
@@ -52,6 +54,12 @@ public:
              bool circle,
              std::vector<std::string> filters);
 
+  // LAZ files that LASlib would read entirely and sequentially can be decompressed chunk by chunk
+  // by several LASio opened on the same file. The size of the chunks is 0 if the points must be
+  // read with read_point() (see query()).
+  uint32_t get_laz_chunk_size() const { return laz_chunk_size; }
+  int64_t get_npoints() const;
+  bool seek(int64_t index);
 
 private:
   LASreadOpener* lasreadopener;
@@ -80,8 +88,92 @@ private:
   AttributeAccessor synthetic_bit;
   AttributeAccessor keypoint_bit;
   AttributeAccessor overlap_bit;
-  std::vector<AttributeAccessor> extrabytes;
-  std::vector<size_t> extrabytes_offsets;
+  std::vector<size_t> extrabytes_index; // Index of the extrabytes attributes in the schema
+
+  // The attributes of the LAS point record resolved once in the schema of the points read or
+  // written. If the schema stores every LAS field with its native type (always true for the
+  // schema created by populate_header()) the points are decoded and encoded by a kernel
+  // specialised on the content of the point data format with typed loads and stores at fixed
+  // addresses. Otherwise the generic AttributeAccessor path is used. Compiled on the first point
+  // of a schema and invalidated by reset_accessor().
+  struct Extrabyte
+  {
+    int index;                   // Index of the attribute in the LAS header
+    const Attribute* attribute;  // nullptr if not in the schema
+    int start;                   // Position in the extra bytes of the LAS point
+    int size;
+    bool backed;                 // #117: the point record actually holds the attribute
+    bool raw;                    // Same storage in LAS and in the schema: copy the bytes
+    AttributeAccessor accessor;
+  };
+
+  struct Codec
+  {
+    const AttributeSchema* schema = nullptr;
+    bool native = false;
+    bool requantize = false;         // Encoder: X Y Z of the schema and of the file are not quantized the same way
+    bool scanangle_float = false;    // Encoder: ScanAngle is stored as a float
+    const Attribute* intensity = nullptr;
+    const Attribute* returnnumber = nullptr;
+    const Attribute* numberofreturns = nullptr;
+    const Attribute* classification = nullptr;
+    const Attribute* userdata = nullptr;
+    const Attribute* psid = nullptr;
+    const Attribute* scanangle = nullptr;
+    const Attribute* scannerchannel = nullptr;
+    const Attribute* gpstime = nullptr;
+    const Attribute* red = nullptr;
+    const Attribute* green = nullptr;
+    const Attribute* blue = nullptr;
+    const Attribute* nir = nullptr;
+    const Attribute* eof_bit = nullptr;
+    const Attribute* scandirection_bit = nullptr;
+    const Attribute* synthetic_bit = nullptr;
+    const Attribute* keypoint_bit = nullptr;
+    const Attribute* withheld_bit = nullptr;
+    const Attribute* overlap_bit = nullptr;
+    std::vector<Extrabyte> extrabytes;
+    void (LASio::*kernel)(Point*) = nullptr;
+  };
+
+  void compile_decoder(const AttributeSchema* schema);
+  void compile_encoder(const AttributeSchema* schema);
+  void decode_generic(Point* p);
+  void encode_generic(Point* p);
+  template<bool EXTENDED, bool GPS, bool RGB, bool NIR> void decode(Point* p);
+  template<bool GPS, bool RGB, bool NIR> void encode(Point* p);
+  void decode_extrabytes(Point* p);
+
+  // Uncompressed LAS files without spatial index nor LASlib filter are mapped in memory and the
+  // point records are decoded in place by a kernel that reads the LAS record layout directly. The
+  // points inside the query rectangle are the same and in the same order than with LASlib.
+  bool open_raw(const std::string& file, double xmin, double ymin, double xmax, double ymax);
+  bool read_raw_point(Point* p);
+  void close_raw();
+  template<bool EXTENDED, bool GPS, bool RGB, bool NIR> void decode_raw(Point* p, const unsigned char* r);
+
+  uint32_t find_laz_chunk_size(const std::string& file, double xmin, double ymin, double xmax, double ymax);
+
+  struct RawReader
+  {
+    MappedFile map;
+    const unsigned char* next = nullptr;  // Next record
+    const unsigned char* end = nullptr;   // End of the records
+    size_t record_length = 0;
+    size_t extrabytes_start = 0;          // Size of the standard record of the point data format
+    int gps = 0;                          // Offsets of the optional fields in the record
+    int rgb = 0;
+    int nir = 0;
+    double xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+    int64_t count = 0;                    // Records consumed, same as LASreader::p_count
+    void (LASio::*kernel)(Point*, const unsigned char*) = nullptr;
+  };
+
+  Codec decoder;
+  Codec encoder;
+  RawReader raw;
+  uint32_t laz_chunk_size;
+  uint32_t decompress_selective;
 
   int copc_depth;
   int copc_density;
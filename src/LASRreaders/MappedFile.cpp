@@ -0,0 +1,60 @@
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+  data = nullptr;
+  size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+bool MappedFile::open(const std::string& file)
+{
+  close();
+
+  #ifdef _WIN32
+  (void)file;
+  return false;
+  #else
+  int fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // The mapping keeps a reference to the file
+  if (p == MAP_FAILED) return false;
+
+  #ifdef MADV_SEQUENTIAL
+  madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+  #endif
+
+  data = (const unsigned char*)p;
+  size = (size_t)st.st_size;
+  return true;
+  #endif
+}
+
+void MappedFile::close()
+{
+  #ifndef _WIN32
+  if (data) munmap((void*)data, size);
+  #endif
+  data = nullptr;
+  size = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Read only memory mapping of a file used by the readers of uncompressed formats to decode the
+// point records in place instead of copying them through a stream. The pages are read ahead by
+// the kernel (sequential access advice). Not available on Windows: open() returns false and the
+// readers use their regular path.
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  bool open(const std::string& file);
+  void close();
+  bool is_open() const { return data != nullptr; };
+  const unsigned char* begin() const { return data; };
+  const unsigned char* end() const { return data + size; };
+  size_t get_size() const { return size; };
+
+private:
+  const unsigned char* data;
+  size_t size;
+};
+
+#endif
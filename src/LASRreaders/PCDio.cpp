@@ -2,6 +2,7 @@
 #include "Header.h"
 #include "PointSchema.h"
 
+#include <cstring>
 #include <limits>
 #include <iomanip> // For std::setprecision
 #include <sstream>
@@ -14,6 +15,7 @@ PCDio::PCDio()
   preread_bbox = true;
   is_binary = false;
   npoints = 0;
+  cursor = nullptr;
 }
 
 PCDio::~PCDio()
@@ -164,6 +166,11 @@ void PCDio::populate_header(Header* header, bool read_first_point)
   {
     is_binary = true;
     read = &PCDio::read_binary_point;
+
+    // The records are copied from the mapped file rather than read from the stream
+    std::streamoff payload = istream.tellg();
+    if (payload > 0 && map.open(file))
+      cursor = map.begin() + payload;
   }
   else
   {
@@ -254,6 +261,7 @@ void PCDio::populate_header(Header* header, bool read_first_point)
 
     istream.clear();
     istream.seekg(payload_start);
+    if (map.is_open()) cursor = map.begin() + (std::streamoff)payload_start;
 
     // Write the bounding box to the .bbox file
     write_bbox(header, bbox_filename);
@@ -269,6 +277,17 @@ bool PCDio::read_point(Point* p)
 bool PCDio::read_binary_point(Point* p)
 {
   p->zero();
+
+  if (map.is_open())
+  {
+    size_t size = header->schema.total_point_size-1; // + 1 byte because of the flags used by lasR
+    if ((size_t)(map.end() - cursor) < size) return false;
+    memcpy(p->data + 1, cursor, size);
+    cursor += size;
+    npoints++;
+    return true;
+  }
+
   istream.read(reinterpret_cast<char*>(p->data + 1), p->schema->total_point_size-1);  // + 1 byte because of the flags used by lasR
   if (istream.gcount() != (long)header->schema.total_point_size-1) return false;      // Check if the correct number of bytes were read
   npoints++;
@@ -299,7 +318,7 @@ bool PCDio::read_ascii_point(Point* p)
   for (int i = 1; i < header->schema.num_attributes(); ++i)
   {
     const auto& attr = header->schema.attributes[i];
-    unsigned char* dest = p->data + attr.offset;
+    unsigned char* dest = p->address(attr);
     double value = numbers[i - 1];
 
     switch (attr.type)
@@ -340,7 +359,7 @@ bool PCDio::write_ascii_point(Point* p)
   {
     ostream << " ";
     const Attribute& attr = p->schema->attributes[i];
-    void* ptr = (void*)(p->data + attr.offset);
+    void* ptr = (void*)p->address(attr);
 
     if (p->schema->attributes[i].type == AttributeType::BIT)
       continue;
@@ -414,7 +433,7 @@ bool PCDio::write_binary_point(Point* p)
   for (int i = 4; i < p->schema->num_attributes(); ++i)
   {
     const Attribute& attr = p->schema->attributes[i];
-    void* ptr = (void*)(p->data + attr.offset);
+    void* ptr = (void*)p->address(attr);
 
     if (attr.type == AttributeType::BIT)
       continue;
@@ -456,6 +475,8 @@ void PCDio::close()
   if (istream.is_open())
   {
     istream.close();
+    map.close();
+    cursor = nullptr;
     header = nullptr;
   }
 
@@ -3,6 +3,7 @@
 
 #include "Fileio.h"
 #include "PointSchema.h" // For AttributeType
+#include "MappedFile.h"
 
 #include <string>
 #include <vector>
@@ -52,6 +53,8 @@ private:
 private:
   const Header* header;
   std::ifstream istream;
+  MappedFile map;                 // Binary payload read in place when the file can be mapped
+  const unsigned char* cursor;    // Next record in 'map'
   std::ofstream ostream;
   std::string line;
   std::string file;
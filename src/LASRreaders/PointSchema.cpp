@@ -185,7 +185,7 @@ double AttributeAccessor::read(const Point* point)
   }
   if (!attribute) return default_value;
 
-  unsigned char* pointer = point->data + attribute->offset;
+  unsigned char* pointer = point->address(*attribute);
   double cast_value = 0;
   switch (attribute->type) {
   case BIT: cast_value = static_cast<double>(((*pointer >> attribute->bit_pos) & 1)); break;
@@ -216,7 +216,7 @@ void AttributeAccessor::write(Point* point, double value)
   }
   if (!attribute) return;
 
-  unsigned char* pointer = point->data + attribute->offset;
+  unsigned char* pointer = point->address(*attribute);
   double scaled_value = (value - attribute->value_offset) / attribute->scale_factor;
   if (absolute) scaled_value = std::abs(scaled_value);
 
@@ -10,6 +10,7 @@
 #include <unordered_map>
 #include <algorithm> // std::find
 #include <cstdint>
+#include <limits>
 
 static const std::set<std::string> lascoreattributes = {
   "X", "Y", "Z", "Intensity", "ReturnNumber",
@@ -148,15 +149,27 @@ struct AttributeSchema
   //void dump(bool verbose = false) const;
 };
 
+// A Point is either a record of total_point_size bytes (owned or not) or a non owning proxy to the
+// i-th point of a PointCloud. The attributes whose record offset is below record_size are stored in
+// the record at 'data'. The others are stored in columns: the values of the attribute at record
+// offset 'o' are stored contiguously from columns + (o - record_size) * column_capacity. A columnar
+// PointCloud has a record_size of 0, an interleaved PointCloud with pending attributes has a few
+// trailing columns. Every read and write must go through address() to support all the layouts.
 struct Point
 {
   bool own_data;
-  unsigned char* data;                 // Pointer to raw point data
+  unsigned char* data;                 // Pointer to raw point data (record)
   const AttributeSchema* schema;       // Reference to the attribute schema
+  size_t record_size;                  // Number of bytes of the schema stored in the record
+  unsigned char* columns;              // Pointer to the columns of the attributes not stored in the record
+  size_t column_capacity;              // Number of points per column
+  size_t index;                        // Index of the point in the columns
 
-  Point() : own_data(false), data(nullptr), schema(nullptr) {}
-  Point(AttributeSchema* schema) : own_data(true), data(new unsigned char[schema->total_point_size]), schema(schema) { zero(); }
-  Point(unsigned char* ptr, const AttributeSchema* schema) : own_data(false), data(ptr), schema(schema) {}
+  static constexpr size_t full_record = std::numeric_limits<size_t>::max();
+
+  Point() : own_data(false), data(nullptr), schema(nullptr), record_size(full_record), columns(nullptr), column_capacity(0), index(0) {}
+  Point(AttributeSchema* schema) : own_data(true), data(new unsigned char[schema->total_point_size]), schema(schema), record_size(full_record), columns(nullptr), column_capacity(0), index(0) { zero(); }
+  Point(unsigned char* ptr, const AttributeSchema* schema) : own_data(false), data(ptr), schema(schema), record_size(full_record), columns(nullptr), column_capacity(0), index(0) {}
   ~Point() {if (own_data && data) { delete[] data; data = nullptr; }; }
   /*void dump() const
   {
@@ -166,7 +179,7 @@ struct Point
     }
   };*/
 
-  Point(const Point& other) : own_data(other.own_data), data(other.own_data ? new unsigned char[other.schema->total_point_size] : other.data), schema(other.schema)
+  Point(const Point& other) : own_data(other.own_data), data(other.own_data ? new unsigned char[other.schema->total_point_size] : other.data), schema(other.schema), record_size(other.record_size), columns(other.columns), column_capacity(other.column_capacity), index(other.index)
   {
     if (own_data) std::copy(other.data, other.data + other.schema->total_point_size, data);
   }
@@ -183,6 +196,10 @@ struct Point
 
       schema = other.schema;
       own_data = other.own_data;
+      record_size = other.record_size;
+      columns = other.columns;
+      column_capacity = other.column_capacity;
+      index = other.index;
       data = other.own_data ? new unsigned char[other.schema->total_point_size] : other.data;
       if (own_data) std::copy(other.data, other.data + other.schema->total_point_size, data);
     }
@@ -190,7 +207,7 @@ struct Point
   }
 
   // Move constructor
-  Point(Point&& other) noexcept : own_data(other.own_data), data(other.data), schema(other.schema)
+  Point(Point&& other) noexcept : own_data(other.own_data), data(other.data), schema(other.schema), record_size(other.record_size), columns(other.columns), column_capacity(other.column_capacity), index(other.index)
   {
     other.data = nullptr;
     other.schema = nullptr;
@@ -212,6 +229,10 @@ struct Point
       data = other.data;
       schema = other.schema;
       own_data = other.own_data;
+      record_size = other.record_size;
+      columns = other.columns;
+      column_capacity = other.column_capacity;
+      index = other.index;
 
       // Nullify the other object
       other.data = nullptr;
@@ -226,42 +247,55 @@ struct Point
     this->schema = schema;
     if (own_data && data) delete[] data;
     data = nullptr;
+    record_size = full_record;
+    columns = nullptr;
+    column_capacity = 0;
+    index = 0;
+  }
+
+  inline unsigned char* address(const Attribute& attr) const
+  {
+    if (attr.offset < record_size) return data + attr.offset;
+    return columns + (attr.offset - record_size) * column_capacity + index * attr.size;
   }
 
+  // True if the whole point is stored in a record of total_point_size bytes
+  inline bool is_record() const { return record_size >= schema->total_point_size; }
+
   inline int get_core_attribute_as_int(AttributeCore i) const {
     const auto& attr = schema->attributes[i];
-    return *((int*)(data + attr.offset));
+    return *((int*)address(attr));
   }
   inline double get_core_attribute_as_double(AttributeCore i) const {
     const auto& attr = schema->attributes[i];
     switch(attr.type)
     {
-      case INT32: { int value = *((int*)(data + attr.offset));return attr.scale_factor * value + attr.value_offset; }
-      case FLOAT: { return *((float*)(data + attr.offset)); }
-      case DOUBLE: { return *((double*)(data + attr.offset)); }
+      case INT32: { int value = *((int*)address(attr));return attr.scale_factor * value + attr.value_offset; }
+      case FLOAT: { return *((float*)address(attr)); }
+      case DOUBLE: { return *((double*)address(attr)); }
       default: return 0;
     }
   }
   inline void set_core_attribute_as_int(AttributeCore i, int value) {
     const auto& attr = schema->attributes[i];
-    unsigned char* pointer = data + attr.offset;
+    unsigned char* pointer = address(attr);
     *reinterpret_cast<int*>(pointer) = static_cast<int>(value);
   }
 
   inline void set_core_attribute_as_double(AttributeCore i, double value) {
     const auto& attr = schema->attributes[i];
-    unsigned char* pointer = data + attr.offset;
+    unsigned char* pointer = address(attr);
     double scaled_value = (value - attr.value_offset) / attr.scale_factor;
     *reinterpret_cast<int*>(pointer) = static_cast<int>(scaled_value);
   }
   inline bool get_flag(int i) const {
     const auto& attr = schema->attributes[AttributeCore::FLAG];
-    unsigned int flag = *((unsigned int*)(data + attr.offset));
+    unsigned char flag = *address(attr);
     return ((flag & (1 << i)) == 0) ? false : true;
   }
   inline void set_flag(int i, bool value = true) {
     auto& attr = schema->attributes[AttributeCore::FLAG];
-    unsigned int& flag = *((unsigned int*)(data + attr.offset));
+    unsigned char& flag = *address(attr);
     if (value) {
       flag |= (1 << i); // Set the ith bit to 1
     } else {
@@ -285,12 +319,16 @@ struct Point
   inline void set_z(double value) { set_core_attribute_as_double(AttributeCore::Z, value); }
   inline void set_deleted(bool value = true) { set_flag(0, value); }
   inline void set_buffered(bool value = true) { set_flag(1, value); }
-  inline void zero() { memset(data, 0, schema->total_point_size); }
+  inline void zero()
+  {
+    if (is_record()) { memset(data, 0, schema->total_point_size); return; }
+    for (const auto& attr : schema->attributes) memset(address(attr), 0, attr.size);
+  }
 
-  inline double get_attribute_as_double(int index) const
+  inline double get_attribute_as_double(int i) const
   {
-    const auto& attr = schema->attributes[index];
-    unsigned char* pointer = data + attr.offset;
+    const auto& attr = schema->attributes[i];
+    unsigned char* pointer = address(attr);
     double cast_value = 0;
     switch (attr.type) {
     case UINT8: cast_value = static_cast<double>(*reinterpret_cast<const uint8_t*>(pointer)); break;
@@ -90,6 +90,13 @@ bool LASRremoveattributes::set_parameters(const nlohmann::json& stage)
   return true;
 }
 
+bool LASRremoveattributes::keep_only_attributes(std::vector<std::string>& attributes) const
+{
+  if (op_type != AttributeOpType::Keep) return false;
+  attributes.insert(attributes.end(), names.begin(), names.end());
+  return true;
+}
+
 bool LASRremoveattributes::process(PointCloud*& las)
 {
   switch(op_type)
@@ -36,6 +36,8 @@ public:
   bool process(PointCloud*& las) override;
   bool set_parameters(const nlohmann::json&) override;
   std::string get_name() const override { return "remove_attributes"; };
+  bool need_attributes(std::vector<std::string>&) const override { return true; };
+  bool keep_only_attributes(std::vector<std::string>& attributes) const override;
 
   // multi-threading
   LASRremoveattributes* clone() const override { return new LASRremoveattributes(*this); };
@@ -84,9 +84,11 @@ bool LASRaggregate::process(PointCloud*& las)
     cells.clear();
   }
 
+  grouper.build(ncpu);
+
   int error = 0;  // Error handling
   int nattr = las->header->schema.attributes.size();
-  int nalloc = grouper.largest_group_size();   // Size of the largest group (i.e. the pixel with most numerous points)
+  R_xlen_t nalloc = grouper.largest_group_size();   // Size of the largest group (i.e. the pixel with most numerous points)
 
   #pragma omp critical (RAPI)
   {
@@ -127,20 +129,23 @@ bool LASRaggregate::process(PointCloud*& las)
     Rf_defineVar(Rf_install(CHAR(STRING_ELT(list_names, i))), value, env);
   }
 
-  // Loop through each group on which we want to apply the call
-  auto map = grouper.map;
+  // Loop through each non empty group on which we want to apply the call
+  std::vector<int> groups;
+  std::vector<Interval> intervals;
+  grouper.groups(groups);
 
   progress->reset();
   progress->set_prefix("Rasterize");
-  progress->set_total(map.size());
+  progress->set_total(groups.size());
 
-  for (const auto& pair : map)
+  for (int group : groups)
   {
-    int group = pair.first;
-    las->set_intervals_to_read(pair.second);
+    intervals.clear();
+    grouper.intervals(group, intervals);
+    las->set_intervals_to_read(intervals);
 
     // Read the points of the query and populate the list
-    int j = 0;
+    R_xlen_t j = 0;
     while (las->read_point())
     {
       if (pointfilter.filter(&las->point)) continue;
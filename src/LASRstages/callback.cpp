@@ -342,6 +342,10 @@ bool LASRcallback::process(PointCloud*& las)
         }
 
         accessors.push_back(name);
+
+        // The spatial indexes must be rebuilt if the coordinates are modified
+        if (name == "X" || name == "Y") las->touch_xyz();
+        if (name == "Z") las->touch_xyz(false);
       }
     }
 
@@ -735,6 +739,10 @@ bool LASRcallback::process(PointCloud*& las)
         if (!column.values)
           throw std::runtime_error("callback column '" + name + "' cannot be converted to a numeric array");
         output_columns.push_back(column);
+
+        // The spatial indexes must be rebuilt if the coordinates are modified
+        if (name == "X" || name == "Y") las->touch_xyz();
+        if (name == "Z") las->touch_xyz(false);
       }
     }
 
@@ -25,12 +25,42 @@ bool LASRedit::process(Point*& p)
   return true;
 }
 
+bool LASRedit::process(PointBlock& block)
+{
+  if (block.empty()) return true;
+
+  if (first)
+  {
+    if (block.schema->find_attribute(attribute) == nullptr)
+    {
+      last_error = "No attribute '" + attribute + "' found";
+      return false;
+    }
+
+    first = false;
+  }
+
+  pointfilter.filter(block, pointmask);
+
+  Point p;
+  for (size_t i = 0 ; i < block.size() ; i++)
+  {
+    if (!pointmask.get(i)) continue;
+    block.seek(i, p);
+    accessor(&p, value);
+  }
+
+  return true;
+}
+
 bool LASRedit::process(PointCloud*& las)
 {
+  pointfilter.filter(las, pointmask);
+
   while(las->read_point())
   {
-    Point* p = &las->point;
-    process(p);
+    if (pointmask.get(las->current_point))
+      accessor(&las->point, value);
   }
 
   return true;
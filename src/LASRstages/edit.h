@@ -8,11 +8,14 @@ class LASRedit: public Stage
 public:
   LASRedit();
   bool process(Point*& p) override;
+  bool process(PointBlock& block) override;
   bool process(PointCloud*& las) override;
   bool set_parameters(const nlohmann::json&) override;
   bool is_streamable() const override { return true; };
   void clear(bool last) override;
   std::string get_name() const override { return "edit"; };
+  bool need_attributes(std::vector<std::string>&) const override { return true; };
+  void written_attributes(std::vector<std::string>& attributes) const override { attributes.push_back(attribute); };
 
   // multi-threading
   LASRedit* clone() const override { return new LASRedit(*this); };
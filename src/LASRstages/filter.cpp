@@ -8,13 +8,29 @@ bool LASRfilter::process(Point*& p)
   return true;
 }
 
+bool LASRfilter::process(PointBlock& block)
+{
+  pointfilter.filter(block, pointmask);
+
+  Point p;
+  for (size_t i = 0 ; i < block.size() ; i++)
+  {
+    if (!pointmask.get(i)) continue;
+    block.seek(i, p);
+    p.set_deleted();
+  }
+
+  return true;
+}
+
 bool LASRfilter::process(PointCloud*& las)
 {
-  Point* p;
+  pointfilter.filter(las, pointmask);
+
   while (las->read_point())
   {
-    p = &las->point;
-    process(p);
+    if (pointmask.get(las->current_point))
+      las->point.set_deleted();
   }
 
   las->update_header();
@@ -23,6 +39,12 @@ bool LASRfilter::process(PointCloud*& las)
   return true;
 }
 
+bool LASRfiltergrid::need_attributes(std::vector<std::string>& attributes) const
+{
+  attributes.insert(attributes.end(), {"X", "Y", "Z"});
+  return true;
+}
+
 bool LASRfiltergrid::set_parameters(const nlohmann::json& stage)
 {
   res = stage.at("res");
@@ -7,9 +7,11 @@ class LASRfilter : public Stage
 {
 public:
   bool process(Point*& p) override;
+  bool process(PointBlock& block) override;
   bool process(PointCloud*& las) override;
   bool is_streamable() const override { return true; };
   std::string get_name() const override { return "filter"; };
+  bool need_attributes(std::vector<std::string>&) const override { return true; };
 
   // multi-threading
   LASRfilter* clone() const override { return new LASRfilter(*this); };
@@ -20,6 +22,7 @@ class LASRfiltergrid : public Stage
 public:
   bool process(PointCloud*& las) override;
   double need_buffer() const override { return res; };
+  bool need_attributes(std::vector<std::string>& attributes) const override;
   bool set_parameters(const nlohmann::json&) override;
   std::string get_name() const override { return "grid filter"; };
 
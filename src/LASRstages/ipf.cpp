@@ -16,10 +16,12 @@ bool LASRipf::process(PointCloud*& las)
   bool main_thread = omp_get_thread_num() == 0;
 
   if (verbose) print("Building KDtree spatial index\n");
-  las->build_kdtree();
+  las->build_kdtree(&pointfilter, ncpu);
 
-  #pragma omp parallel for num_threads(ncpu)
-  for (unsigned int i = 0 ; i < las->npoints ; i++)
+  std::vector<size_t> idx;
+
+  #pragma omp parallel for num_threads(ncpu) firstprivate(idx)
+  for (size_t i = 0 ; i < las->npoints ; i++)
   {
     if (progress->interrupted()) continue;
 
@@ -28,10 +30,9 @@ bool LASRipf::process(PointCloud*& las)
 
     if (!las->get_point(i, &p)) continue;
 
-    std::vector<Point> pts;
-    las->query_sphere(p, radius, pts, &pointfilter);
+    las->query_sphere(p, radius, idx, &pointfilter);
 
-    n_neighbors[i] = pts.size();
+    n_neighbors[i] = idx.size();
 
     #pragma omp critical (ipf)
     {
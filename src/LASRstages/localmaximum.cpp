@@ -12,6 +12,13 @@ LASRlocalmaximum::LASRlocalmaximum()
   this->attribute = "";
 }
 
+bool LASRlocalmaximum::need_attributes(std::vector<std::string>& attributes) const
+{
+  attributes.insert(attributes.end(), {"X", "Y", "Z", use_attribute});
+  if (record_attributes) attributes.insert(attributes.end(), {"Intensity", "gpstime", "ReturnNumber", "Classification", "ScanAngle"});
+  return true;
+}
+
 bool LASRlocalmaximum::set_parameters(const nlohmann::json& stage)
 {
   ws = stage.at("ws");
@@ -125,10 +132,12 @@ bool LASRlocalmaximum::process(PointCloud*& las)
   bool main_thread = omp_get_thread_num() == 0;
 
   if (verbose) print("Building grid partition spatial index\n");
-  las->build_partition();
+  las->build_partition(ncpu);
+
 
+  std::vector<size_t> idx;
 
-  #pragma omp parallel for num_threads(ncpu)
+  #pragma omp parallel for num_threads(ncpu) firstprivate(idx)
   for (size_t i = 0 ; i < las->npoints ; ++i)
   {
     if (progress->interrupted()) continue;
@@ -152,14 +161,15 @@ bool LASRlocalmaximum::process(PointCloud*& las)
     if (status[i] == NLM) continue;
 
     Circle windows(pp.get_x(), pp.get_y(), hws);
-    std::vector<Point> points;
-    las->query(&windows, points, &pointfilter);
+    las->query(&windows, idx, &pointfilter);
+    PointSpan points = las->span(idx);
 
     // It seems there is a data race here but no. In the worst case updating status[pt.FID]
     // is non-synchronized with other iterations and it will simply prevent skipping one computation early
-    for (auto& pt : points)
+    for (size_t j = 0 ; j < points.size() ; j++)
     {
-      int fid = las->get_index(&pt);
+      const Point& pt = points[j];
+      size_t fid = points.index(j);
       if (accessor(&pt) == accessor(&pp) && (pt.get_x() != pp.get_x() || pt.get_y() != pp.get_y()) && status[fid] == LMX) status[i] = NLM; // Handle duplicated height for different points
       if (accessor(&pt) > accessor(&pp)) status[i] = NLM;  // If the point is above the central one, the central one is not a LM
       if (accessor(&pt) < accessor(&pp)) status[fid] = NLM; // If the point is below the central we can pretag it as not a LM (no data race)
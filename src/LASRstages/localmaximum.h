@@ -19,6 +19,8 @@ public:
   void clear(bool last) override;
   double need_buffer() const override { return ws; }
   bool need_points() const override { return !use_raster; }
+  bool need_attributes(std::vector<std::string>& attributes) const override;
+  void written_attributes(std::vector<std::string>& attributes) const override { if (!attribute.empty()) attributes.push_back(attribute); };
   bool connect(const std::list<std::unique_ptr<Stage>>&, const std::string& uuid) override;
   bool set_parameters(const nlohmann::json&) override;
   std::string get_name() const override { return "local_maximum"; }
@@ -56,9 +56,12 @@ bool LASRnnmetrics::process(PointCloud*& las)
   lm.resize(maxima.size());
 
   if (verbose) print("Building KDtree spatial index\n");
-  las->build_kdtree();
+  las->build_kdtree(nullptr, ncpu);
 
-  #pragma omp parallel for num_threads(ncpu) firstprivate(metrics)
+  std::vector<size_t> idx;
+  std::vector<float> values;
+
+  #pragma omp parallel for num_threads(ncpu) firstprivate(metrics, idx, values)
   for (size_t i = 0 ; i < maxima.size() ; i++)
   {
     if (progress->interrupted()) continue;
@@ -70,22 +73,19 @@ bool LASRnnmetrics::process(PointCloud*& las)
     pp.set_y(p.y);
     pp.set_z(p.z);
 
-    std::vector<Point> pts;
+    idx.clear();
     switch (mode)
     {
-      case PURERADIUS: { las->query_sphere(pp, r, pts, nullptr); break; }
-      case PUREKNN:    { las->knn(pp, k, pts, nullptr); break; }
-      case KNNRADIUS:  { las->rknn(pp, k, r, pts, nullptr); break; }
+      case PURERADIUS: { las->query_sphere(pp, r, idx, nullptr); break; }
+      case PUREKNN:    { las->knn(pp, k, idx, nullptr); break; }
+      case KNNRADIUS:  { las->rknn(pp, k, r, idx, nullptr); break; }
       default: { break; }
     }
+    PointSpan pts = las->span(idx);
 
     PointXYZAttrs pt(p.x, p.y, p.z);
-    pt.vals.reserve(metrics.size());
-    for (int i = 0 ; i < metrics.size() ; i++)
-    {
-      float val = metrics.get_metric(i, pts);
-      pt.vals.push_back(val);
-    }
+    metrics.compute(pts, values);
+    pt.vals.assign(values.begin(), values.end());
 
     lm[i] = pt;
 
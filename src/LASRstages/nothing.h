@@ -12,6 +12,7 @@ public:
   bool process(PointCloud*& las) override;
   bool is_streamable() const override { return streamable; };
   bool need_points() const override { return read_points; };
+  bool need_attributes(std::vector<std::string>&) const override { return true; };
 
   // multi-threading
   LASRnothing* clone() const override { return new LASRnothing(*this); };
@@ -46,27 +46,104 @@ bool LASRrasterize::process(Point*& p)
   if (p->get_deleted() != 0) return true;
   if (pointfilter.filter(p)) return true;
 
+  std::vector<int> cells;
+  rasterize_point(p, cells);
+
+  return true;
+}
+
+bool LASRrasterize::process(PointBlock& block)
+{
+  if (!metric_engine.is_streamable())  return true;
+
+  pointfilter.filter(block, pointmask);
+
+  Point p;
+  std::vector<int> cells;
+  for (size_t i = 0 ; i < block.size() ; i++)
+  {
+    if (!pointmask.get(i)) continue;
+    block.seek(i, p);
+    if (p.get_deleted() != 0) continue;
+    rasterize_point(&p, cells);
+  }
+
+  return true;
+}
+
+void LASRrasterize::rasterize_point(const Point* p, std::vector<int>& cells)
+{
   double x = p->get_x();
   double y = p->get_y();
   double z = p->get_z();
 
-  std::vector<int> cells;
+  cells.clear();
   if (window)
     raster.get_cells(x-window,y-window, x+window,y+window, cells);
   else
     cells.push_back(raster.cell_from_xy(x,y));
 
-  for (int i = 0 ; i < metric_engine.size() ; ++i)
+  if (metric_engine.is_stateless())
   {
-    for (int cell : cells)
+    for (int i = 0 ; i < metric_engine.size() ; ++i)
     {
-      float v = raster.get_value(cell, i+1);
-      float res = metric_engine.get_metric(i, v, z);
-      raster.set_value(cell, res, i+1);
+      for (int cell : cells)
+      {
+        float v = raster.get_value(cell, i+1);
+        float res = metric_engine.get_metric(i, v, z);
+        raster.set_value(cell, res, i+1);
+      }
     }
+
+    return;
   }
 
-  return true;
+  size_t size = metric_engine.get_state_size();
+
+  if (states.empty())
+  {
+    states.resize(raster.get_ncells() * size);
+    for (size_t i = 0 ; i < states.size() ; i += size) metric_engine.init_state(&states[i]);
+  }
+
+  for (int cell : cells)
+  {
+    if (cell < 0) continue;
+    metric_engine.accumulate(&states[cell * size], p);
+  }
+}
+
+void LASRrasterize::finalize_states()
+{
+  if (states.empty()) return;
+
+  size_t size = metric_engine.get_state_size();
+  std::vector<float> values(metric_engine.size());
+
+  for (size_t cell = 0 ; cell < states.size() / size ; cell++)
+  {
+    if (!metric_engine.finalize(&states[cell * size], values.data())) continue; // No point in the cell
+
+    for (int i = 0 ; i < metric_engine.size() ; i++)
+      raster.set_value(cell, values[i], i+1);
+  }
+
+  states.clear();
+  states.shrink_to_fit();
+}
+
+bool LASRrasterize::set_chunk(Chunk& chunk)
+{
+  states.clear();
+  metric_engine.reset();
+  return StageRaster::set_chunk(chunk);
+}
+
+bool LASRrasterize::write()
+{
+  // Streamed pipeline: the last point of the chunk has been processed
+  finalize_states();
+  return StageRaster::write();
 }
 
 bool LASRrasterize::process(PointCloud*& las)
@@ -82,6 +159,9 @@ bool LASRrasterize::process(PointCloud*& las)
       if (!process(p))
         return false; // # nocov
     }
+
+    // The next stages may use the raster before it is written
+    finalize_states();
     return true;
   }
 
@@ -104,43 +184,43 @@ bool LASRrasterize::process(PointCloud*& las)
   }
 
   // Last option:
-  // we rasterize metrics that are not streamable  (code partially from aggregate)
-  Grouper grouper;
+  // we rasterize metrics that are not streamable  (code partially from aggregate).
+  // Point indexes are stored on 32 bits unless the point cloud is too big.
+  if (Grouper32::fits(las->npoints))
+    return rasterize_groups<uint32_t>(las);
+  else
+    return rasterize_groups<uint64_t>(las);
+}
+
+template<typename Index>
+bool LASRrasterize::rasterize_groups(PointCloud* las)
+{
+  GrouperT<Index> grouper;
   std::vector<int> cells;
-  while (las->read_point(true)) // Need to include withheld points to do not mess grouper indexes
+  las->scan_xyz([&](const auto&, const auto& X, const auto& Y, const auto&)
   {
-    double x = las->point.get_x();
-    double y = las->point.get_y();
-
-    if (window)
-      raster.get_cells(x-window,y-window, x+window,y+window, cells);
-    else
-      cells.push_back(raster.cell_from_xy(x,y));
+    // All the points including the withheld ones to do not mess grouper indexes
+    for (size_t i = 0 ; i < las->npoints ; i++)
+    {
+      double x = X.value(i);
+      double y = Y.value(i);
 
-    grouper.insert(cells);
-    cells.clear();
-  }
+      if (window)
+        raster.get_cells(x-window,y-window, x+window,y+window, cells);
+      else
+        cells.push_back(raster.cell_from_xy(x,y));
 
-  // Loop through each group on which we want to apply the call
-  auto map = grouper.map;
+      grouper.insert(cells);
+      cells.clear();
+    }
+  });
 
-  progress->reset();
-  progress->set_prefix("Rasterize");
-  progress->set_total(map.size());
-  progress->set_ncpu(ncpu);
-  progress->show();
+  // Loop through each non empty group on which we want to apply the call
+  grouper.build(ncpu);
 
-  // OpenMP cannot parallelize on a map. Create vectors to hold keys and references to corresponding vectors
-  size_t n = grouper.map.size();
   std::vector<int> keys;
-  std::vector<std::vector<Interval>*> intervals;
-  keys.reserve(n);
-  intervals.reserve(n);
-  for (auto& pair : grouper.map)
-  {
-    keys.push_back(pair.first);
-    intervals.push_back(&pair.second);
-  }
+  grouper.groups(keys);
+  size_t n = keys.size();
 
   progress->reset();
   progress->set_total(n);
@@ -155,20 +235,24 @@ bool LASRrasterize::process(PointCloud*& las)
   // Next calls, all touch a different cell and are thus thread safe
   raster.set_value(0, NA_F32_RASTER, 1);
 
-  #pragma omp parallel for num_threads(ncpu) firstprivate(metric_engine)
+  std::vector<size_t> idx;
+  std::vector<IntervalT<Index>> intervals;
+  std::vector<float> values;
+
+  #pragma omp parallel for num_threads(ncpu) firstprivate(metric_engine, idx, intervals, values)
   for (size_t i = 0; i < n; ++i)
   {
     if (progress->interrupted()) continue;
 
-    std::vector<Point> pts;
     int cell = keys[i];
-    las->query(*intervals[i], pts, &pointfilter);
+    intervals.clear();
+    grouper.intervals(cell, intervals);
+    las->query(intervals, idx, &pointfilter);
+    PointSpan pts = las->span(idx);
 
+    metric_engine.compute(pts, values);
     for (int i = 0 ; i < metric_engine.size() ; i++)
-    {
-      float val = metric_engine.get_metric(i, pts);
-      raster.set_value(cell, val, i+1);
-    }
+      raster.set_value(cell, values[i], i+1);
 
     if (main_thread)
     {
@@ -186,6 +270,16 @@ bool LASRrasterize::process(PointCloud*& las)
   return true;
 }
 
+bool LASRrasterize::need_attributes(std::vector<std::string>& attributes) const
+{
+  // A triangulation is rasterized without reading the points
+  if (connections.size() > 0) return true;
+
+  attributes.insert(attributes.end(), {"X", "Y"});
+  metric_engine.get_attributes(attributes);
+  return true;
+}
+
 bool LASRrasterize::connect(const std::list<std::unique_ptr<Stage>>& pipeline, const std::string& uid)
 {
   Stage* s = search_connection(pipeline, uid);
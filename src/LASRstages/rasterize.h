@@ -10,22 +10,35 @@ class LASRrasterize : public StageRaster
 public:
   LASRrasterize() = default;
   bool process(Point*& p) override;
+  bool process(PointBlock& block) override;
   bool process(PointCloud*& las) override;
   double need_buffer() const override { return MAX(raster.get_xres(), window); };
   bool is_streamable() const override { return streamable; };
   bool is_parallelized() const override { return !streamable; };
   bool set_parameters(const nlohmann::json&) override;
+  bool set_chunk(Chunk& chunk) override;
+  bool write() override;
   bool connect(const std::list<std::unique_ptr<Stage>>&, const std::string& uuid) override;
+  bool need_attributes(std::vector<std::string>& attributes) const override;
   std::string get_name() const override { return "rasterize"; };
 
   // multi-threading
   LASRrasterize* clone() const override { return new LASRrasterize(*this); };
 
+private:
+  void rasterize_point(const Point* p, std::vector<int>& cells);
+  void finalize_states();
+  template<typename Index> bool rasterize_groups(PointCloud* las);
+
 private:
   std::vector<std::string> methods;
   bool streamable;
   double window;
   MetricManager metric_engine;
+
+  // State of the streamable metrics of each cell (e.g. the moments of z_sd). Allocated on the
+  // first point of a chunk and converted into the values of the raster at the end of the chunk.
+  std::vector<double> states;
 };
 
 #endif
@@ -350,7 +350,7 @@ bool LASRdataframereader::process(PointCloud*& las)
   }
 
   if (las == nullptr)
-    las = new PointCloud(header);
+    las = new PointCloud(header, columnar);
 
   Point* p = nullptr;
   while (process(p))
@@ -359,6 +359,8 @@ bool LASRdataframereader::process(PointCloud*& las)
     las->add_point(*p);
   }
 
+  if (!las->shrink_to_fit()) return false;
+
   if (verbose) print("Building a spatial index\n");
   las->update_header();
 
@@ -92,7 +92,7 @@ bool LASReptreader::process(Point*& point)
 bool LASReptreader::process(PointCloud*& las)
 {
   if (las != nullptr) { delete las; las = nullptr; }
-  if (las == nullptr) las = new PointCloud(header);
+  if (las == nullptr) las = new PointCloud(header, columnar);
 
   streaming = false;
 
@@ -116,6 +116,8 @@ bool LASReptreader::process(PointCloud*& las)
   progress->done();
   if (verbose) print(" Number of point read %d\n", las->npoints);
 
+  if (!las->shrink_to_fit()) return false;
+
   if (verbose) print("Building a spatial index\n");
   las->update_header();
 
@@ -2,11 +2,33 @@
 
 #include "LASio.h"
 
+#include <algorithm>
+#include <atomic>
+
+static constexpr double QUERY_EPSILON = 1e-9; // Same as LASio::query()
+
+static bool same_layout(const AttributeSchema& a, const AttributeSchema& b)
+{
+  if (a.total_point_size != b.total_point_size || a.attributes.size() != b.attributes.size()) return false;
+
+  for (size_t i = 0 ; i < a.attributes.size() ; i++)
+  {
+    const Attribute& u = a.attributes[i];
+    const Attribute& v = b.attributes[i];
+    if (u != v || u.offset != v.offset || u.bit_pos != v.bit_pos) return false;
+  }
+
+  return true;
+}
+
 LASRlasreader::LASRlasreader()
 {
   header = nullptr;
   lasio = nullptr;
   streaming = true;
+  main_read = false;
+  strip_index = 0;
+  record_index = 0;
 }
 
 bool LASRlasreader::set_chunk(Chunk& chunk)
@@ -21,30 +43,158 @@ bool LASRlasreader::set_chunk(Chunk& chunk)
     lasio = nullptr;
   }
 
-  lasio = new LASio();
+  this->chunk = chunk;
+  strips.clear();
+  main_read = false;
+  strip_index = 0;
+  record_index = 0;
+  pending.reset();
 
   try
   {
-    lasio->query(
-        chunk.main_files,
-        chunk.neighbour_files,
-        chunk.xmin,
-        chunk.ymin,
-        chunk.xmax,
-        chunk.ymax,
-        chunk.buffer,
-        chunk.shape == ShapeType::CIRCLE,
-        filters);
+    // The neighbouring files come from the cache of edge strips if possible. Otherwise LASlib
+    // reads the main and the neighbouring files together.
+    bool cached = open_strips(chunk);
+    return query(chunk, !cached);
   }
   catch (const std::exception& e)
   {
     last_error = e.what();
     return false;
   }
+}
+
+bool LASRlasreader::query(const Chunk& chunk, bool neighbours)
+{
+  if (lasio)
+  {
+    lasio->close();
+    delete lasio;
+  }
+
+  lasio = new LASio();
+  if (!decoded_attributes.empty()) lasio->set_decoded_attributes(decoded_attributes);
+  lasio->query(
+      chunk.main_files,
+      (neighbours) ? chunk.neighbour_files : std::vector<std::string>(),
+      chunk.xmin,
+      chunk.ymin,
+      chunk.xmax,
+      chunk.ymax,
+      chunk.buffer,
+      chunk.shape == ShapeType::CIRCLE,
+      filters);
+
+  return true;
+}
+
+bool LASRlasreader::open_strips(const Chunk& chunk)
+{
+  // Only for chunks made of one whole file with rectangular buffered neighbours
+  if (strip_cache == nullptr || !strip_cache->enabled()) return false;
+  if (chunk.buffer <= 0 || chunk.shape == ShapeType::CIRCLE) return false;
+  if (chunk.main_files.size() != 1 || chunk.main_bboxes.size() != 1) return false;
+  if (chunk.neighbour_files.empty() || chunk.neighbour_bboxes.size() != chunk.neighbour_files.size()) return false;
+
+  double rxmin = chunk.xmin - chunk.buffer - QUERY_EPSILON;
+  double rymin = chunk.ymin - chunk.buffer - QUERY_EPSILON;
+  double rxmax = chunk.xmax + chunk.buffer + QUERY_EPSILON;
+  double rymax = chunk.ymax + chunk.buffer + QUERY_EPSILON;
+
+  for (size_t i = 0 ; i < chunk.neighbour_files.size() ; i++)
+  {
+    const std::string& file = chunk.neighbour_files[i];
+    std::string key = strip_key(file);
+
+    std::shared_ptr<const Strip> strip = strip_cache->get(key);
+    if (!strip) strip = fill_strip(file, chunk.neighbour_bboxes[i], key);
+
+    // The buffered chunk reaches the inner part of the neighbour (e.g. overlapping files)
+    if (!strip->covers(rxmin, rymin, rxmax, rymax))
+    {
+      strips.clear();
+      return false;
+    }
+
+    strips.push_back(strip);
+  }
 
   return true;
 }
 
+// Reads the points of a file that are close to its edges and inserts them in the cache. The file
+// is decompressed once here instead of once for each chunk it is a neighbour of.
+std::shared_ptr<const Strip> LASRlasreader::fill_strip(const std::string& file, const Rectangle& bbox, const std::string& key)
+{
+  LASio io;
+  if (!decoded_attributes.empty()) io.set_decoded_attributes(decoded_attributes);
+  io.query({file}, {}, bbox.xmin(), bbox.ymin(), bbox.xmax(), bbox.ymax(), chunk.buffer, false, filters);
+
+  Header h;
+  io.populate_header(&h);
+  project(h.schema);
+
+  auto strip = std::make_shared<Strip>(h.schema, bbox.xmin(), bbox.ymin(), bbox.xmax(), bbox.ymax(), chunk.buffer);
+  strip->file_npoints = h.number_of_point_records;
+
+  Point p(&strip->schema);
+  while (io.read_point(&p)) strip->push_back(&p);
+  io.close();
+
+  strip->records.shrink_to_fit();
+  strip_cache->insert(key, strip);
+  return strip;
+}
+
+// The strips store the points decoded with the filters and the attributes of this pipeline
+std::string LASRlasreader::strip_key(const std::string& file) const
+{
+  std::string key = StripCache::make_key(file, chunk.buffer, filters);
+  for (const auto& attribute : decoded_attributes) key += "|" + attribute;
+  for (const auto& attribute : projected_attributes) key += "#" + attribute;
+  return key;
+}
+
+void LASRlasreader::set_decoded_attributes(const std::vector<std::string>& attributes)
+{
+  // Always non empty: the coordinates are read by the reader itself
+  decoded_attributes = {"X", "Y", "Z"};
+  for (const auto& attribute : attributes)
+  {
+    if (std::find(decoded_attributes.begin(), decoded_attributes.end(), attribute) == decoded_attributes.end())
+      decoded_attributes.push_back(attribute);
+  }
+}
+
+void LASRlasreader::set_projected_attributes(const std::vector<std::string>& attributes)
+{
+  projected_attributes = {"X", "Y", "Z"};
+  for (std::string attribute : attributes)
+  {
+    if (attribute.size() >= 2 && attribute.front() == '|' && attribute.back() == '|') attribute = attribute.substr(1, attribute.size() - 2);
+    attribute = map_attribute(attribute);
+    if (std::find(projected_attributes.begin(), projected_attributes.end(), attribute) == projected_attributes.end())
+      projected_attributes.push_back(attribute);
+  }
+}
+
+// Removes the attributes that the pipeline does not use from the schema of the file before any
+// point is read. The bits are kept because they share a byte with the Withheld flag.
+void LASRlasreader::project(AttributeSchema& schema) const
+{
+  if (projected_attributes.empty()) return;
+
+  std::vector<std::string> names;
+  for (const auto& attribute : schema.attributes)
+  {
+    if (attribute.type == AttributeType::BIT || attribute.name == "flags") continue;
+    if (std::find(projected_attributes.begin(), projected_attributes.end(), attribute.name) == projected_attributes.end())
+      names.push_back(attribute.name);
+  }
+
+  for (const auto& name : names) schema.remove_attribute(name);
+}
+
 bool LASRlasreader::process(Header*& header)
 {
   // LASRlasreader is responsible for populating the header.
@@ -54,12 +204,103 @@ bool LASRlasreader::process(Header*& header)
 
   header = new Header;
   lasio->populate_header(header);
+  project(header->schema);
+
+  if (!strips.empty())
+  {
+    // The records of the strips are copied as is. Files with another point format, other extra
+    // bytes or another quantization must be merged by LASlib.
+    bool compatible = true;
+    for (const auto& strip : strips) compatible = compatible && same_layout(strip->schema, header->schema);
+
+    if (!compatible)
+    {
+      strips.clear();
+      delete header;
+      header = new Header;
+
+      try
+      {
+        query(chunk, true);
+        lasio->populate_header(header);
+        project(header->schema);
+      }
+      catch (const std::exception& e)
+      {
+        last_error = e.what();
+        delete header;
+        header = nullptr;
+        return false;
+      }
+    }
+    else
+    {
+      // Record the strip of the main file for the next chunks, unless it is already known
+      std::string key = strip_key(chunk.main_files[0]);
+      if (!strip_cache->contains(key))
+      {
+        const Rectangle& bbox = chunk.main_bboxes[0];
+        pending = std::make_shared<Strip>(header->schema, bbox.xmin(), bbox.ymin(), bbox.xmax(), bbox.ymax(), chunk.buffer);
+        pending->file_npoints = header->number_of_point_records;
+        pending_key = key;
+      }
+
+      for (const auto& strip : strips) header->number_of_point_records += strip->file_npoints;
+    }
+  }
 
   this->header = header;
 
   return true;
 }
 
+// Reads the main file then the points of the strips of the neighbours that are in the buffered chunk
+bool LASRlasreader::read_point(Point* p)
+{
+  if (!main_read && lasio->read_point(p))
+  {
+    if (pending) pending->push_back(p);
+    return true;
+  }
+
+  if (pending)
+  {
+    pending->records.shrink_to_fit();
+    strip_cache->insert(pending_key, pending);
+    pending.reset();
+  }
+
+  double rxmin = chunk.xmin - chunk.buffer - QUERY_EPSILON;
+  double rymin = chunk.ymin - chunk.buffer - QUERY_EPSILON;
+  double rxmax = chunk.xmax + chunk.buffer + QUERY_EPSILON;
+  double rymax = chunk.ymax + chunk.buffer + QUERY_EPSILON;
+
+  while (strip_index < strips.size())
+  {
+    const Strip& strip = *strips[strip_index];
+
+    while (record_index < strip.size())
+    {
+      const unsigned char* record = strip.record(record_index++);
+      Point q(const_cast<unsigned char*>(record), &strip.schema);
+      double x = q.get_x();
+      double y = q.get_y();
+      if (x < rxmin || x >= rxmax || y < rymin || y >= rymax) continue; // Same test as LASlib
+
+      // The schema of the point may have been extended by the stages: the first bytes are the same
+      size_t size = p->schema->total_point_size;
+      memcpy(p->data, record, strip.point_size);
+      if (size > strip.point_size) memset(p->data + strip.point_size, 0, size - strip.point_size);
+      return true;
+    }
+
+    strip_index++;
+    record_index = 0;
+  }
+
+  return false;
+}
+
 // Streaming mode
 bool LASRlasreader::process(Point*& point)
 {
@@ -68,7 +309,7 @@ bool LASRlasreader::process(Point*& point)
 
   do
   {
-    if (lasio->read_point(point))
+    if (read_point(point))
     {
       if (point->inside_buffer(xmin, ymin, xmax, ymax, circular))
         point->set_buffered();
@@ -84,11 +325,37 @@ bool LASRlasreader::process(Point*& point)
   return true;
 }
 
+// Streaming mode by block: points are decoded directly in the block
+bool LASRlasreader::process(PointBlock& block)
+{
+  Point p;
+
+  while (!block.full())
+  {
+    block.next(p);
+
+    if (!read_point(&p))
+    {
+      block.eof = true;
+      break;
+    }
+
+    if (p.inside_buffer(xmin, ymin, xmax, ymax, circular))
+      p.set_buffered();
+
+    if (pointfilter.filter(&p)) continue;
+
+    block.commit();
+  }
+
+  return true;
+}
+
 // In memory mode
 bool LASRlasreader::process(PointCloud*& las)
 {
   if (las != nullptr) { delete las; las = nullptr; }
-  if (las == nullptr) las = new PointCloud(header);
+  if (las == nullptr) las = new PointCloud(header, columnar);
 
   streaming = false;
 
@@ -96,9 +363,11 @@ bool LASRlasreader::process(PointCloud*& las)
   progress->set_total(header->number_of_point_records);
   progress->set_prefix("read_las");
 
+  if (!read_laz_chunks(las)) return false;
+
   Point p(&header->schema);
 
-  while (lasio->read_point(&p))
+  while (read_point(&p))
   {
     if (progress->interrupted()) break;
     if (pointfilter.filter(&p)) continue;
@@ -112,12 +381,126 @@ bool LASRlasreader::process(PointCloud*& las)
   progress->done();
   if (verbose) print(" Number of point read %d\n", las->npoints);
 
+  if (!las->shrink_to_fit()) return false;
+
   if (verbose) print("Building a spatial index\n");
   las->update_header();
 
   return true;
 }
 
+// The chunks of a LAZ file are decompressed in parallel by several readers opened on the main
+// file. Each thread decodes whole chunks in its own buffer and the buffers are appended in the
+// order of the chunks so the point cloud is the same than when reading sequentially.
+bool LASRlasreader::read_laz_chunks(PointCloud* las)
+{
+  if (ncpu < 2 || lasio->get_laz_chunk_size() == 0) return true;
+
+  int64_t chunk_size = lasio->get_laz_chunk_size();
+  int64_t npoints = lasio->get_npoints();
+  int64_t nchunks = (npoints + chunk_size - 1) / chunk_size;
+  if (nchunks < 2) return true;
+
+  const std::string& file = chunk.main_files[0];
+  const AttributeSchema* schema = &header->schema;
+  size_t size = schema->total_point_size;
+
+  double rxmin = chunk.xmin - chunk.buffer - QUERY_EPSILON;
+  double rymin = chunk.ymin - chunk.buffer - QUERY_EPSILON;
+  double rxmax = chunk.xmax + chunk.buffer + QUERY_EPSILON;
+  double rymax = chunk.ymax + chunk.buffer + QUERY_EPSILON;
+
+  // Written in the ordered section but read by all the threads before decoding their chunk
+  std::atomic<bool> failed(false);
+  std::atomic<bool> interrupted(false);
+  int nthreads = (int)std::min<int64_t>(ncpu, nchunks);
+
+  #pragma omp parallel num_threads(nthreads)
+  {
+    LASio io;
+    bool opened = true;
+    std::vector<unsigned char> records;
+
+    try
+    {
+      if (!decoded_attributes.empty()) io.set_decoded_attributes(decoded_attributes);
+      io.open(file);
+    }
+    catch (const std::exception& e)
+    {
+      opened = false;
+      #pragma omp critical (read_laz_chunks)
+      {
+        failed = true;
+        last_error = e.what();
+      }
+    }
+
+    #pragma omp for ordered schedule(static, 1)
+    for (int64_t i = 0 ; i < nchunks ; i++)
+    {
+      int64_t first = i * chunk_size;
+      int64_t count = std::min(chunk_size, npoints - first);
+      int64_t n = 0;
+      bool ok = opened && !failed && !interrupted;
+
+      if (ok)
+      {
+        records.assign(count * size, 0);
+        Point q(records.data(), schema);
+
+        if (io.seek(first))
+        {
+          for (int64_t k = 0 ; k < count ; k++)
+          {
+            q.data = records.data() + n * size;
+            if (!io.read_point(&q)) break;
+
+            double x = q.get_x();
+            double y = q.get_y();
+            if (x < rxmin || x >= rxmax || y < rymin || y >= rymax) continue; // Same test as LASlib
+            n++;
+          }
+        }
+        else
+        {
+          ok = false;
+        }
+      }
+
+      #pragma omp ordered
+      {
+        if (opened && !ok && !failed && !interrupted)
+        {
+          failed = true;
+          last_error = "cannot seek the point " + std::to_string(first) + " in " + file;
+        }
+
+        if (!failed && !interrupted)
+        {
+          for (int64_t k = 0 ; k < n ; k++)
+          {
+            Point p(records.data() + k * size, schema);
+            if (pending) pending->push_back(&p);
+            if (pointfilter.filter(&p)) continue;
+            if (p.inside_buffer(xmin, ymin, xmax, ymax, circular)) p.set_buffered();
+            if (!las->add_point(p)) { failed = true; break; }
+          }
+
+          interrupted = progress->interrupted();
+          progress->update(first + count);
+          progress->show();
+        }
+      }
+    }
+  }
+
+  if (failed) return false;
+
+  main_read = true;
+  return true;
+}
+
 LASRlasreader::~LASRlasreader()
 {
   if (lasio)
@@ -12,9 +12,12 @@ public:
   ~LASRlasreader();
   bool process(Header*& header) override;
   bool process(Point*& point) override;
+  bool process(PointBlock& block) override;
   bool process(PointCloud*& las) override;
   bool set_chunk(Chunk& chunk) override;
   bool need_points() const override { return false; };
+  void set_decoded_attributes(const std::vector<std::string>& attributes) override;
+  void set_projected_attributes(const std::vector<std::string>& attributes) override;
   bool is_streamable() const override { return true; };
   std::string get_name() const override { return "reader_las"; }
   void clear(bool) override;
@@ -23,9 +26,33 @@ public:
   LASRlasreader* clone() const override { return new LASRlasreader(*this); };
 
 private:
+  bool read_point(Point* p);
+  bool read_laz_chunks(PointCloud* las);
+  bool query(const Chunk& chunk, bool neighbours);
+  bool open_strips(const Chunk& chunk);
+  std::shared_ptr<const Strip> fill_strip(const std::string& file, const Rectangle& bbox, const std::string& key);
+  std::string strip_key(const std::string& file) const;
+  void project(AttributeSchema& schema) const;
+
   Header* header; // ownwed only in streaming mode
   bool streaming;
   LASio* lasio;
+  bool main_read; // The main file has already been read by read_laz_chunks()
+
+  // Attributes read by the pipeline. The others are not decoded (LAZ 1.4 only). Empty if unknown.
+  std::vector<std::string> decoded_attributes;
+
+  // Attributes read or written by the pipeline. The others are not loaded. Empty if unknown.
+  std::vector<std::string> projected_attributes;
+
+  // Neighbouring files served from the StripCache. The main file is read with LASio, then the
+  // points of the strips that are in the buffered chunk.
+  Chunk chunk;
+  std::vector<std::shared_ptr<const Strip>> strips;
+  size_t strip_index;
+  size_t record_index;
+  std::shared_ptr<Strip> pending; // Strip of the main file recorded while reading it
+  std::string pending_key;
 };
 
 #endif
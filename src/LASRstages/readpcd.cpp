@@ -97,7 +97,7 @@ bool LASRpcdreader::process(Point*& point)
 bool LASRpcdreader::process(PointCloud*& las)
 {
   if (las != nullptr) { delete las; las = nullptr; }
-  if (las == nullptr) las = new PointCloud(header);
+  if (las == nullptr) las = new PointCloud(header, columnar);
 
   streaming = false;
 
@@ -127,6 +127,8 @@ bool LASRpcdreader::process(PointCloud*& las)
   progress->done();
   if (verbose) print(" Number of point read %d\n", las->npoints);
 
+  if (!las->shrink_to_fit()) return false;
+
   if (verbose) print("Building a spatial index\n");
   las->update_header();
 
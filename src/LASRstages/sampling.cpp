@@ -303,6 +303,12 @@ bool LASRsamplingvoxels::process(PointCloud*& las)
 }
 
 // PIXEL
+bool LASRsamplingpixels::need_attributes(std::vector<std::string>& attributes) const
+{
+  attributes.insert(attributes.end(), {"X", "Y", "Z", use_attribute});
+  return true;
+}
+
 bool LASRsamplingpixels::set_parameters(const nlohmann::json& stage)
 {
   res = stage.at("res");
@@ -9,6 +9,14 @@
 class LASRsampling : public Stage
 {
 public:
+  // The points are visited in a random order that depends on the number of points
+  bool is_filter_pushable() const override { return false; };
+  bool need_attributes(std::vector<std::string>& attributes) const override
+  {
+    attributes.insert(attributes.end(), {"X", "Y", "Z"});
+    return true;
+  };
+
   void shuffle(std::vector<int>& x, int shuffle_size)
   {
     std::mt19937 rng(0);
@@ -69,6 +77,7 @@ public:
   bool process(PointCloud*& las) override;
   bool random(PointCloud*& las);
   bool highest(PointCloud*& las, bool high = true);
+  bool need_attributes(std::vector<std::string>& attributes) const override;
   double need_buffer() const override { return res; }
   bool set_parameters(const nlohmann::json&) override;
   std::string get_name() const override { return "pixel_sampling"; }
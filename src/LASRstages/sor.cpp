@@ -1,6 +1,9 @@
 #include "openmp.h"
 #include "sor.h"
 
+#include <algorithm>
+#include <cmath>
+
 bool LASRsor::process(PointCloud*& las)
 {
   progress->reset();
@@ -19,38 +22,71 @@ bool LASRsor::process(PointCloud*& las)
   bool main_thread = omp_get_thread_num() == 0;
 
   if (verbose) print("Building KDtree spatial index\n");
-  las->build_kdtree();
-  #pragma omp parallel for num_threads(ncpu)
-  for (unsigned int i = 0 ; i < las->npoints ; i++)
+  las->build_kdtree(&pointfilter, ncpu);
+
+  // The k-nearest neighbours are searched by batches of points
+  const size_t batch_size = 16384;
+  std::vector<size_t> ids;
+  std::vector<double> xyz;
+  std::vector<size_t> offsets;
+  std::vector<size_t> idx;
+  std::vector<double> dmeans;
+
+  Point p;
+  p.set_schema(&las->header->schema);
+
+  for (size_t start = 0 ; start < las->npoints ; start += batch_size)
   {
-    if (progress->interrupted()) continue;
+    if (progress->interrupted()) break;
+
+    size_t end = std::min(start + batch_size, las->npoints);
+
+    ids.clear();
+    xyz.clear();
+    for (size_t i = start ; i < end ; i++)
+    {
+      if (!las->get_point(i, &p)) continue;
+      ids.push_back(i);
+      xyz.push_back(p.get_x());
+      xyz.push_back(p.get_y());
+      xyz.push_back(p.get_z());
+    }
 
-    Point p;
-    p.set_schema(&las->header->schema);
+    las->knn_batch(xyz, k+1, 0, offsets, idx, &pointfilter, ncpu);
 
-    if (!las->get_point(i, &p)) continue;
+    dmeans.resize(ids.size());
 
-    std::vector<Point> pts;
-    las->knn(p, k+1, pts, &pointfilter);
+    #pragma omp parallel for num_threads(ncpu)
+    for (size_t j = 0 ; j < ids.size() ; j++)
+    {
+      Point q;
+      q.set_schema(&las->header->schema);
 
-    double dsum = 0;
-    for (size_t i = 1; i < pts.size(); ++i) dsum += std::sqrt(std::pow(p.get_x() - pts[i].get_x(), 2) + std::pow(p.get_y() - pts[i].get_y(), 2) + std::pow(p.get_z() - pts[i].get_z(), 2));
-    double dmean =  dsum / (pts.size()-1);
-    distances[i] = dmean;
+      double dsum = 0;
+      size_t nn = offsets[j+1] - offsets[j];
+      for (size_t l = offsets[j] + 1 ; l < offsets[j+1] ; l++)
+      {
+        las->get_point(idx[l], &q);
+        dsum += std::sqrt(std::pow(xyz[3*j] - q.get_x(), 2) + std::pow(xyz[3*j+1] - q.get_y(), 2) + std::pow(xyz[3*j+2] - q.get_z(), 2));
+      }
+      dmeans[j] = dsum / (nn-1);
+    }
 
-    #pragma omp critical (sor)
+    // Average distance and variance (online)
+    for (size_t j = 0 ; j < ids.size() ; j++)
     {
-      // Average distance and variance
+      double dmean = dmeans[j];
+      distances[ids[j]] = dmean;
       n++;
       double delta = dmean - m0;
       m0 += delta/n;
       m2 += delta*(dmean - m0);
+    }
 
-      if (main_thread)
-      {
-        (*progress)++;
-        progress->show();
-      }
+    if (main_thread)
+    {
+      progress->update(end);
+      progress->show();
     }
   }
 
@@ -1,74 +1,499 @@
 #include "sort.h"
 
-#include "GridPartition.h"
+#include "Grouper.h"
+#include "LASio.h"
+#include "RadixSort.h"
+#include "openmp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+// Position of the cell (x,y) along a Hilbert curve filling a 2^order x 2^order grid
+static inline uint64_t hilbert(uint32_t x, uint32_t y, int order)
+{
+  uint64_t d = 0;
+  for (int level = order-1 ; level >= 0 ; level--)
+  {
+    uint32_t s = 1u << level;
+    uint32_t rx = (x & s) ? 1 : 0;
+    uint32_t ry = (y & s) ? 1 : 0;
+    d += (uint64_t)s * s * ((3 * rx) ^ ry);
+
+    // Rotate the quadrant. Only the bits below 'level' are used afterwards.
+    if (ry == 0)
+    {
+      if (rx == 1) { x = ~x; y = ~y; }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+uint64_t LASRsort::HilbertFrame::key(double x, double y) const
+{
+  double max = std::ldexp(1.0, order) - 1;
+  double cx = std::floor((x - x0)/res);
+  double cy = std::floor((y - y0)/res);
+  cx = std::min(std::max(cx, 0.0), max);
+  cy = std::min(std::max(cy, 0.0), max);
+  return hilbert((uint32_t)cx, (uint32_t)cy, order);
+}
+
+// Frame of 2^16 x 2^16 cells covering the bounding box of a file. Keys fit in 32 bits.
+static LASRsort::HilbertFrame local_frame(const Header* header)
+{
+  LASRsort::HilbertFrame frame;
+  frame.x0 = header->min_x;
+  frame.y0 = header->min_y;
+  frame.res = std::max(header->max_x - header->min_x, header->max_y - header->min_y) / 65536.0;
+  frame.order = 16;
+  if (!(frame.res > 0)) frame.res = 1;
+  return frame;
+}
+
+// Frame of 2^32 x 2^32 cells of 1 cm centered on the origin of the CRS. Points from different
+// files are ordered consistently without knowing the extent of the collection in advance.
+static LASRsort::HilbertFrame global_frame(double units)
+{
+  LASRsort::HilbertFrame frame;
+  frame.res = 0.01 * units;
+  frame.x0 = -std::ldexp(frame.res, 31);
+  frame.y0 = -std::ldexp(frame.res, 31);
+  frame.order = 32;
+  return frame;
+}
+
+// Copy a point in a record of total_point_size bytes whatever the memory layout of the point
+static inline void copy_record(const Point* p, unsigned char* record)
+{
+  if (p->is_record())
+  {
+    memcpy(record, p->data, p->schema->total_point_size);
+    return;
+  }
+
+  memset(record, 0, p->schema->total_point_size);
+  for (const auto& attr : p->schema->attributes) memcpy(record + attr.offset, p->address(attr), attr.size);
+}
+
+LASRsort::LASRsort()
+{
+  spatial = true;
+  keep_buffer = false;
+  requantize = false;
+  run_size = 10000000;
+  lasio = nullptr;
+}
+
+LASRsort::~LASRsort()
+{
+  close_runs();
+
+  if (lasio)
+  {
+    // # nocov start
+    warning("internal error: please report, a LASwriter is still opened when destructing LASRsort. The LAS or LAZ file written may be corrupted\n");
+    lasio->close();
+    delete lasio;
+    lasio = nullptr;
+    // # nocov end
+  }
+}
 
 bool LASRsort::set_parameters(const nlohmann::json& stage)
 {
   spatial = stage.value("spatial", true);
+  run_size = stage.value("run_size", 10000000);
+  if (run_size < 1) run_size = 1;
+  return true;
+}
+
+bool LASRsort::set_input_file_name(const std::string& file)
+{
+  if (template_filename.empty()) return true;
+
+  ofile = template_filename;
+  ifile = file;
+  size_t pos = ofile.find('*');
+
+  if (pos != std::string::npos)
+  {
+    ofile.replace(pos, 1, ifile);
+  }
+
+  return true;
+}
+
+bool LASRsort::set_output_file(const std::string& file)
+{
+  if (file.empty()) return true;
+
+  template_filename = file;
+
+  size_t pos = file.find('*');
+  if (pos == std::string::npos)
+  {
+    merged = true;
+  }
+
+  return true;
+}
+
+bool LASRsort::set_chunk(Chunk& chunk)
+{
+  Stage::set_chunk(chunk.xmin, chunk.ymin, chunk.xmax, chunk.ymax);
+  keep_buffer = chunk.buffer == 0;
+  circular = chunk.shape == ShapeType::CIRCLE;
   return true;
 }
 
+bool LASRsort::set_header(Header*& header)
+{
+  if (template_filename.empty()) return true;
+
+  // We already received the header of this file or we are merging several files in a single one
+  if (lasio)
+  {
+    if (header->schema.total_point_size == schema.total_point_size && header->schema.attributes.size() == schema.attributes.size())
+    {
+      bool same_layout = true;
+      for (size_t i = 0 ; i < schema.attributes.size() ; i++)
+      {
+        const Attribute& a = header->schema.attributes[i];
+        const Attribute& b = schema.attributes[i];
+        same_layout = same_layout && a.name == b.name && a.type == b.type && a.offset == b.offset && a.size == b.size;
+      }
+      if (same_layout)
+      {
+        // In merged mode the files may have different scale factors and offsets
+        const auto& a = header->schema.attributes;
+        const auto& b = schema.attributes;
+        requantize = a[AttributeCore::X] != b[AttributeCore::X] || a[AttributeCore::Y] != b[AttributeCore::Y] || a[AttributeCore::Z] != b[AttributeCore::Z];
+        return true;
+      }
+    }
+
+    last_error = "sort_points() cannot merge point clouds with different point formats in a single file";
+    return false;
+  }
+
+  // Use a tmp copy of the header to force some option without modifying the original header
+  Header h = *header;
+  h.signature = "LASF";
+  h.point_data_format = 0xFF;
+  h.version_minor = 0xFF;
+
+  try
+  {
+    lasio = new LASio();
+    lasio->init(&h);
+  }
+  catch (const std::exception& e)
+  {
+    last_error = e.what();
+    return false;
+  }
+
+  schema = header->schema;
+  requantize = false;
+  frame = (merged) ? global_frame(crs.get_linear_units()) : local_frame(header);
+
+  return true;
+}
+
+// Order of the points along a Hilbert curve. The keys are computed in parallel then sorted with a
+// parallel radix sort. Index is the storage type of the order. The order is always 64-bit.
+template<typename Index>
+static void spatial_order(PointCloud* las, const LASRsort::HilbertFrame& frame, int ncpu, std::vector<uint64_t>& order)
+{
+  size_t n = las->npoints;
+  std::vector<uint32_t> keys(n);
+  std::vector<Index> index(n);
+
+  #pragma omp parallel for num_threads(ncpu)
+  for (size_t i = 0 ; i < n ; i++)
+  {
+    Point p;
+    p.set_schema(&las->header->schema);
+    las->get_point(i, &p);
+    keys[i] = (uint32_t)frame.key(p.get_x(), p.get_y());
+    index[i] = (Index)i;
+  }
+
+  radix_sort(keys, index, 32, ncpu);
+
+  order.assign(index.begin(), index.end());
+}
+
 bool LASRsort::process(PointCloud*& las)
 {
-  auto start_time = std::chrono::high_resolution_clock::now();
+  if (spatial)
+  {
+    std::vector<uint64_t> order;
+    HilbertFrame local = local_frame(las->header);
+    if (Grouper32::fits(las->npoints))
+      spatial_order<uint32_t>(las, local, ncpu, order);
+    else
+      spatial_order<uint64_t>(las, local, ncpu, order);
+
+    if (order.size() != las->npoints)
+    {
+      last_error = "Internal error. Invalid order size"; // # nocov
+      return false; // # nocov
+    }
+
+    if (!las->sort(order)) return false;
+  }
+
+  if (template_filename.empty()) return true;
+
+  // The points are already sorted but they are handled as a stream to produce the same output
+  // in merged mode where the points of all the files must be sorted together
+  while (las->read_point())
+  {
+    if (!append(&las->point)) return false;
+  }
+
+  return true;
+}
+
+bool LASRsort::process(Point*& p)
+{
+  if (p == nullptr) return true;
+  if (p->get_deleted()) return true;
+  return append(p);
+}
 
-  // Sort by channel > gpstime > return number sort
-  //if (!las->sort()) return false;
+bool LASRsort::process(PointBlock& block)
+{
+  Point p;
+  for (size_t i = 0 ; i < block.size() ; i++)
+  {
+    block.seek(i, p);
+    if (p.get_deleted()) continue;
+    if (!append(&p)) return false;
+  }
 
-  auto end_time = std::chrono::high_resolution_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-  float second = (float)duration.count()/1000.0f;
+  return true;
+}
 
-  //print("  First sort took %.2f sec.\n", second);*/
+bool LASRsort::append(Point* p)
+{
+  if (!keep_buffer && p->inside_buffer(xmin, ymin, xmax, ymax, circular)) return true;
+  if (pointfilter.filter(p)) return true;
 
-  if (!spatial) return true;
+  size_t size = schema.total_point_size;
+  if (records.empty()) records.reserve(std::min<size_t>(run_size, 1000000) * size);
 
-  start_time = std::chrono::high_resolution_clock::now();
+  size_t n = keys.size();
+  records.resize((n+1)*size);
+  copy_record(p, records.data() + n*size);
 
-  double res = 50 * crs.get_linear_units();
+  // The coordinates are requantized with the scale factors and offsets of the first file
+  if (requantize)
+  {
+    Point q(records.data() + n*size, &schema);
+    q.set_x(p->get_x());
+    q.set_y(p->get_y());
+    q.set_z(p->get_z());
+  }
 
-  // Spatial sort
-  GridPartition grid(las->header->min_x, las->header->min_y, las->header->max_x, las->header->max_y, res);
-  while (las->read_point()) grid.insert(las->point.get_x(), las->point.get_y());
-  auto& umap = grid.map;
-  std::map<int, std::vector<Interval>> sorted_map(umap.begin(), umap.end());   // Use a map to automatically sort the keys
+  keys.push_back(spatial ? frame.key(p->get_x(), p->get_y()) : 0);
 
-  std::vector<int> order;
-  order.reserve(las->npoints);
+  if (keys.size() >= run_size) return spill();
 
-  for (const auto& pair : sorted_map)
+  return true;
+}
+
+// Sort the current run and write it in a temporary file as a sequence of key + record
+bool LASRsort::spill()
+{
+  if (keys.empty()) return true;
+
+  size_t size = schema.total_point_size;
+  std::vector<uint64_t> index(keys.size());
+  for (size_t i = 0 ; i < index.size() ; i++) index[i] = i;
+  radix_sort(keys, index, frame.order*2, ncpu);
+
+  FILE* file = std::tmpfile();
+  if (file == nullptr)
   {
-    for (auto interval : pair.second)
+    last_error = "cannot create a temporary file to sort the points"; // # nocov
+    return false; // # nocov
+  }
+
+  for (size_t i = 0 ; i < index.size() ; i++)
+  {
+    if (fwrite(&keys[i], sizeof(uint64_t), 1, file) != 1 || fwrite(records.data() + index[i]*size, size, 1, file) != 1)
     {
-      int cell = pair.first;
-      int start = interval.start;
-      int end = interval.end;
+      // # nocov start
+      fclose(file);
+      last_error = "cannot write in a temporary file to sort the points. Disk full?";
+      return false;
+      // # nocov end
+    }
+  }
+
+  runs.push_back({file, keys.size()});
+  keys.clear();
+  records.clear();
 
-      for(int i = start ; i <= end; i++) order.push_back(i);
+  return true;
+}
+
+// Write the sorted points. If everything fits in memory the run is sorted and written directly.
+// Otherwise the runs are merged with a k-way merge that reads each run by blocks.
+bool LASRsort::flush()
+{
+  if (keys.empty() && runs.empty()) return true;
+  if (!open_writer()) return false;
+
+  size_t size = schema.total_point_size;
+  Point p(nullptr, &schema);
+
+  if (runs.empty())
+  {
+    std::vector<uint64_t> index(keys.size());
+    for (size_t i = 0 ; i < index.size() ; i++) index[i] = i;
+    radix_sort(keys, index, frame.order*2, ncpu);
+
+    for (size_t i : index)
+    {
+      p.data = records.data() + i*size;
+      lasio->write_point(&p);
     }
+
+    keys.clear();
+    records.clear();
+    records.shrink_to_fit();
+    return true;
   }
 
-  if (order.size() != las->header->number_of_point_records)
+  if (!spill()) return false;
+  records.shrink_to_fit();
+
+  // Each run is read by blocks. The memory used is bounded by run_size points whatever the number of runs.
+  size_t item = sizeof(uint64_t) + size;
+  size_t block = std::max<size_t>(run_size / runs.size(), 1024);
+
+  struct Cursor
   {
-    last_error = "Internal error. Invalid order size";
-    return false;
+    std::vector<unsigned char> buffer;
+    uint64_t remaining; // Points not read yet in the file
+    size_t n;           // Points in the buffer
+    size_t i;           // Position in the buffer
+  };
+
+  std::vector<Cursor> cursors(runs.size());
+
+  auto refill = [&](size_t r)
+  {
+    Cursor& c = cursors[r];
+    c.n = std::min<uint64_t>(block, c.remaining);
+    c.i = 0;
+    c.buffer.resize(c.n * item);
+    if (c.n > 0 && fread(c.buffer.data(), item, c.n, runs[r].file) != c.n) return false;
+    c.remaining -= c.n;
+    return true;
+  };
+
+  auto key = [&](size_t r) { uint64_t k; memcpy(&k, cursors[r].buffer.data() + cursors[r].i*item, sizeof(uint64_t)); return k; };
+
+  // Ties are broken by run index so the sort is stable
+  typedef std::pair<uint64_t, size_t> Entry;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+
+  for (size_t r = 0 ; r < runs.size() ; r++)
+  {
+    rewind(runs[r].file);
+    cursors[r].remaining = runs[r].npoints;
+    if (!refill(r))
+    {
+      last_error = "cannot read a temporary file to sort the points"; // # nocov
+      return false; // # nocov
+    }
+    if (cursors[r].n > 0) heap.push({key(r), r});
   }
 
-  end_time = std::chrono::high_resolution_clock::now();
-  duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-  second = (float)duration.count()/1000.0f;
+  while (!heap.empty())
+  {
+    size_t r = heap.top().second;
+    heap.pop();
 
-  //print("  Indexing took %.2f sec.\n", second);
+    Cursor& c = cursors[r];
+    p.data = c.buffer.data() + c.i*item + sizeof(uint64_t);
+    lasio->write_point(&p);
 
-  start_time = std::chrono::high_resolution_clock::now();
+    c.i++;
+    if (c.i == c.n)
+    {
+      if (!refill(r))
+      {
+        last_error = "cannot read a temporary file to sort the points"; // # nocov
+        return false; // # nocov
+      }
+    }
+    if (c.i < c.n) heap.push({key(r), r});
+  }
 
-  if (!las->sort(order)) return false;
+  close_runs();
 
-  end_time = std::chrono::high_resolution_clock::now();
-  duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-  second = (float)duration.count()/1000.0f;
+  return true;
+}
 
-  //print("  Second sort took %.2f sec.\n", second);
+bool LASRsort::open_writer()
+{
+  if (lasio->is_opened()) return true;
+
+  try
+  {
+    lasio->create(ofile);
+    written.push_back(ofile);
+  }
+  catch (const std::exception& e)
+  {
+    last_error = e.what();
+    return false;
+  }
 
   return true;
-}
\ No newline at end of file
+}
+
+bool LASRsort::write()
+{
+  if (template_filename.empty()) return true;
+  if (merged) return true;
+  return flush();
+}
+
+void LASRsort::close_runs()
+{
+  for (auto& run : runs) fclose(run.file);
+  runs.clear();
+}
+
+void LASRsort::clear(bool last)
+{
+  // In merged mode the points of all the files are written at the very end
+  if (!merged || last)
+  {
+    if (merged && lasio && !flush())
+    {
+      warning("%s\n", last_error.c_str()); // # nocov
+    }
+
+    keys.clear();
+    records.clear();
+    records.shrink_to_fit();
+    close_runs();
+
+    if (lasio)
+    {
+      lasio->close();
+      delete lasio;
+      lasio = nullptr;
+    }
+  }
+}
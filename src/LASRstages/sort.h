@@ -3,19 +3,70 @@
 
 #include "Stage.h"
 
-class LASRsort : public Stage
+#include <cstdio>
+
+class LASio;
+
+class LASRsort : public StageWriter
 {
 public:
-  LASRsort() : spatial(false) { };
+  LASRsort();
+  ~LASRsort();
+  bool process(Point*& p) override;
+  bool process(PointBlock& block) override;
   bool process(PointCloud*& las) override;
+  bool set_chunk(Chunk& chunk) override;
+  bool set_header(Header*& header) override;
+  bool set_input_file_name(const std::string& file) override;
+  bool set_output_file(const std::string& file) override;
   bool set_parameters(const nlohmann::json&) override;
+  bool write() override;
+  void clear(bool last) override;
   std::string get_name() const override { return "sort"; };
 
+  // Without output file the stage sorts the point cloud in memory. With an output file it sorts
+  // the stream out-of-core and writes the sorted points.
+  bool is_streamable() const override { return !template_filename.empty(); };
+
   // multi-threading
+  bool is_parallelizable() const override { return merged == false; };
   LASRsort* clone() const override { return new LASRsort(*this); };
 
+  // Maps coordinates to their position along a Hilbert curve on a grid of 2^order x 2^order cells
+  struct HilbertFrame
+  {
+    double x0 = 0;
+    double y0 = 0;
+    double res = 1;
+    int order = 16;
+    uint64_t key(double x, double y) const;
+  };
+
 private:
+  // A run is a sorted sequence of points spilled in a temporary file
+  struct Run
+  {
+    FILE* file;
+    uint64_t npoints;
+  };
+
+  bool append(Point* p);
+  bool spill();
+  bool flush();
+  bool open_writer();
+  void close_runs();
+
   bool spatial;
+  bool keep_buffer;
+  bool requantize;                      // The current file has not the same quantization than the output
+  size_t run_size;                      // Maximum number of points held in memory
+  HilbertFrame frame;
+  AttributeSchema schema;               // Schema of the records in the runs
+  std::vector<unsigned char> records;   // Points of the current run
+  std::vector<uint64_t> keys;           // Hilbert keys of the points of the current run
+  std::vector<Run> runs;
+
+  LASio* lasio;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -26,13 +26,38 @@ bool LASRsummary::set_parameters(const nlohmann::json& stage)
   std::vector<std::string> metrics;
   if (stage.contains("metrics")) metrics = get_vector<std::string>(stage.at("metrics"));
 
-  if (!metrics_engine.parse(metrics, false)) return false;
+  if (!metrics_engine.parse(metrics, true)) return false;
 
   return true;
 }
 
+bool LASRsummary::need_attributes(std::vector<std::string>& attributes) const
+{
+  attributes.insert(attributes.end(), {"X", "Y", "Z", "Intensity", "ReturnNumber", "NumberOfReturns", "Classification", "Synthetic", "Withheld"});
+  metrics_engine.get_attributes(attributes);
+  return true;
+}
+
+bool LASRsummary::set_chunk(Chunk& chunk)
+{
+  state.clear();
+  metrics_engine.reset();
+  return Stage::set_chunk(chunk);
+}
+
+// The state of the streamable metrics is initialized on the first point of the chunk. A streamed
+// chunk without point is not recorded by the engine and must not produce metrics.
+void LASRsummary::init_metrics()
+{
+  if (!metrics_engine.active() || !metrics_engine.is_streamable() || !state.empty()) return;
+  state.resize(metrics_engine.get_state_size());
+  metrics_engine.init_state(state.data());
+}
+
 bool LASRsummary::process(Point*& p)
 {
+  init_metrics();
+
   if (p->get_deleted()) return true;
   if (pointfilter.filter(p)) return true;
   if (p->inside_buffer(xmin, ymin, xmax, ymax, circular)) return true; // avoid counting buffer points
@@ -54,7 +79,10 @@ bool LASRsummary::process(Point*& p)
   zhistogram[z_idx]++;
   ihistogram[i_idx]++;
 
-  if (metrics_engine.active())  cloud.push_back(*p);
+  if (!state.empty())
+    metrics_engine.accumulate(state.data(), p);
+  else if (metrics_engine.active())
+    cloud.push_back(p->index); // metrics are computed only in process(PointCloud*&)
 
   return true;
 }
@@ -72,21 +100,48 @@ bool LASRsummary::process(PointCloud*& las)
     process(p);
   }
 
-  if (metrics_engine.active())
+  if (metrics_engine.active() && !metrics_engine.is_streamable())
   {
-    for (int i = 0 ; i < metrics_engine.size() ; i++)
-    {
-      const std::string& name = metrics_engine.get_name(i);
-      float val = metrics_engine.get_metric(i, cloud);
-      metrics[name].push_back(val);
-    }
-
+    PointSpan points = las->span(cloud);
+    std::vector<float> values;
+    metrics_engine.compute(points, values);
+    push_metrics(values);
     cloud.clear();
   }
 
+  // Streamable metrics in a pipeline that is not streamable
+  init_metrics();
+  finalize_metrics();
+
+  return true;
+}
+
+bool LASRsummary::write()
+{
+  // Streamed pipeline: the last point of the chunk has been processed
+  finalize_metrics();
   return true;
 }
 
+void LASRsummary::finalize_metrics()
+{
+  if (state.empty()) return;
+
+  std::vector<float> values(metrics_engine.size());
+  metrics_engine.finalize(state.data(), values.data());
+  push_metrics(values);
+  state.clear();
+}
+
+void LASRsummary::push_metrics(const std::vector<float>& values)
+{
+  for (int i = 0 ; i < metrics_engine.size() ; i++)
+  {
+    const std::string& name = metrics_engine.get_name(i);
+    metrics[name].push_back(values[i]);
+  }
+}
+
 void LASRsummary::merge(const Stage* other)
 {
   const LASRsummary* o = dynamic_cast<const LASRsummary*>(other);
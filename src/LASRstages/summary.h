@@ -14,8 +14,11 @@ public:
   LASRsummary();
   bool process(Point*& p) override;
   bool process(PointCloud*& las) override;
-  bool is_streamable() const override { return !metrics_engine.active(); }
+  bool is_streamable() const override { return !metrics_engine.active() || metrics_engine.is_streamable(); }
   bool set_parameters(const nlohmann::json&) override;
+  bool set_chunk(Chunk& chunk) override;
+  bool need_attributes(std::vector<std::string>& attributes) const override;
+  bool write() override;
   std::string get_name() const override { return "summary"; }
 
   // multi-threading
@@ -33,6 +36,9 @@ public:
 
 private:
   void merge_maps(std::map<int, uint64_t>& map1, const std::map<int, uint64_t>& map2);
+  void push_metrics(const std::vector<float>& values);
+  void init_metrics();
+  void finalize_metrics();
 
 private:
   AttributeAccessor get_synthetic;
@@ -57,7 +63,8 @@ private:
   std::map<std::string, std::vector<float>> metrics;
 
   MetricManager metrics_engine;
-  PointCollection cloud;
+  std::vector<size_t> cloud; // indexes of the points used to compute the metrics
+  std::vector<double> state; // state of the streamable metrics of the chunk (empty until the first point)
 };
 
 #endif
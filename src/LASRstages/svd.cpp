@@ -162,7 +162,7 @@ bool LASRsvd::process(PointCloud*& las)
   if (verbose) print("  Building KDtree spatial index\n");
   auto start = std::chrono::high_resolution_clock::now();
 
-  las->build_kdtree();
+  las->build_kdtree(nullptr, ncpu);
 
   auto end = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> elapsed = end - start;
@@ -175,7 +175,9 @@ bool LASRsvd::process(PointCloud*& las)
   progress->set_ncpu(ncpu);
   progress->show();
 
-  #pragma omp parallel for num_threads(ncpu)
+  std::vector<size_t> idx;
+
+  #pragma omp parallel for num_threads(ncpu) firstprivate(idx)
   for (size_t i = 0 ; i < las->npoints ; i++)
   {
     if (progress->interrupted()) continue;
@@ -185,14 +187,15 @@ bool LASRsvd::process(PointCloud*& las)
 
     if (!las->get_point(i, &p)) continue;
 
-    std::vector<Point> pts;
+    idx.clear();
     switch (mode)
     {
-      case PURERADIUS: { las->query_sphere(p, r, pts, nullptr); break; }
-      case PUREKNN:    { las->knn(p, k, pts, nullptr); break; }
-      case KNNRADIUS:  { las->rknn(p, k, r, pts, nullptr); break; }
+      case PURERADIUS: { las->query_sphere(p, r, idx, nullptr); break; }
+      case PUREKNN:    { las->knn(p, k, idx, nullptr); break; }
+      case KNNRADIUS:  { las->rknn(p, k, r, idx, nullptr); break; }
       default: { break; }
     }
+    PointSpan pts = las->span(idx);
 
     Eigen::MatrixXd A(pts.size(), 3);
     Eigen::MatrixXd coeff; // Principal component matrix
@@ -201,9 +204,10 @@ bool LASRsvd::process(PointCloud*& las)
     // Fill the matrix A with points
     for (size_t k = 0; k < pts.size(); ++k)
     {
-      A(k, 0) = pts[k].get_x();
-      A(k, 1) = pts[k].get_y();
-      A(k, 2) = pts[k].get_z();
+      const Point& q = pts[k];
+      A(k, 0) = q.get_x();
+      A(k, 1) = q.get_y();
+      A(k, 2) = q.get_z();
     }
 
     // Compute the mean
@@ -216,6 +216,8 @@ bool LASRtransformwith::process(PointCloud*& las)
       set_and_get_value(&las->point, z);
     }
 
+    if (attribute.empty() || attribute == "Z" || attribute == "z") las->touch_xyz(false);
+
     las->update_header();
     las->delete_deleted();
 
@@ -252,6 +254,7 @@ bool LASRtransformwith::process(PointCloud*& las)
     las->header->schema.attributes[AttributeCore::Y].value_offset = new_yoffset;
     las->header->schema.attributes[AttributeCore::Z].value_offset = new_zoffset;
 
+    las->touch_xyz();
     las->seek(0);
 
     las->update_header();
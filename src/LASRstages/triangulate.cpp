@@ -9,15 +9,26 @@
 #include "FastGridPartition2D.h"
 
 #include "delaunator/delaunator.hpp"
+#include "hporro/pred3d.h" // orient2d() and incircle()
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <unordered_map>
 
 LASRtriangulate::LASRtriangulate()
 {
   npoints = 0;
   las = nullptr;
-  d = nullptr;
   vector.set_geometry_type(wkbMultiPolygon25D);
 }
 
+bool LASRtriangulate::need_attributes(std::vector<std::string>& attributes) const
+{
+  attributes.insert(attributes.end(), {"X", "Y", "Z", use_attribute});
+  return true;
+}
+
 bool LASRtriangulate::set_parameters(const nlohmann::json& stage)
 {
   double max_edge = stage.at("max_edge");
@@ -42,30 +53,52 @@ bool LASRtriangulate::process(PointCloud*& las)
 
   // Add an angstrom of noise to fix #217
   // Honnextly I don't now why.
-  std::default_random_engine gen(std::random_device{}());
+  // The seed is fixed so that the mesh of the same points is always the same.
+  std::default_random_engine gen(0);
   std::normal_distribution<double> noise(0.0, 1e-10);
 
   // For numerical stability
   double xoffset = (las->header->min_x+las->header->max_x)/2;
   double yoffset = (las->header->min_y+las->header->max_y)/2;
 
-  Point* p;
-  while (las->read_point())
+  PointMask mask;
+  pointfilter.filter(las, mask);
+
+  las->scan_xyz([&](const auto& flags, const auto& X, const auto& Y, const auto&)
   {
-    p = &las->point;
-    if (pointfilter.filter(p)) continue;
-    coords.push_back(p->get_x() - xoffset + noise(gen));
-    coords.push_back(p->get_y() - yoffset + noise(gen));
-    index_map.push_back(las->current_point);
-    npoints++;
-  }
+    for (size_t i = 0 ; i < las->npoints ; i++)
+    {
+      if ((flags[i] & 1) || !mask.get(i)) continue;
+      coords.push_back(X.value(i) - xoffset + noise(gen));
+      coords.push_back(Y.value(i) - yoffset + noise(gen));
+      index_map.push_back(i);
+      npoints++;
+    }
+  });
 
-  // Other stage that use the triangulation should handle d == nullptr
+  // Other stage that use the triangulation should handle an empty triangulation
   if (coords.size() < 6) return true;
 
+  // Large point clouds are triangulated by strips in parallel. If the stitched mesh cannot be proven
+  // to be the Delaunay triangulation of the points we fall back to the sequential triangulation
+  int nstrips = (int)std::min<size_t>(ncpu, npoints / min_points_per_strip);
+  if (nstrips >= 2)
+  {
+    if (parallel_delaunay(coords, nstrips, triangles))
+    {
+      if (verbose) print("  Parallel triangulation: %d strips stitched\n", nstrips);
+      progress->done();
+      return true;
+    }
+
+    if (verbose) print("  Parallel triangulation failed the seam verification. Sequential fallback.\n"); // # nocov
+    triangles.clear();
+  }
+
   try
   {
-    d = new delaunator::Delaunator(coords);
+    delaunator::Delaunator d(coords);
+    triangles = std::move(d.triangles);
   }
   catch(const std::exception& e)
   {
@@ -79,19 +112,450 @@ bool LASRtriangulate::process(PointCloud*& las)
   return true;
 }
 
+namespace
+{
+  // An edge of a triangle that does not have a neighbour in the triangulation of its own strip.
+  // (u,v) is the edge in the order of the triangle and w is the opposite vertex.
+  struct SeamEdge
+  {
+    size_t u, v, w;
+    size_t lo() const { return std::min(u, v); }
+    size_t hi() const { return std::max(u, v); }
+    bool operator<(const SeamEdge& other) const { return lo() < other.lo() || (lo() == other.lo() && hi() < other.hi()); }
+  };
+}
+
+static inline double orient(const std::vector<double>& coords, size_t a, size_t b, size_t c)
+{
+  return orient2d(&coords[2*a], &coords[2*b], &coords[2*c]);
+}
+
+// Counter clockwise convex hull of a subset of the points with Andrew's monotone chain
+static std::vector<size_t> convex_hull(const std::vector<double>& coords, std::vector<size_t> candidates)
+{
+  std::sort(candidates.begin(), candidates.end(), [&coords](size_t a, size_t b)
+  {
+    return coords[2*a] < coords[2*b] || (coords[2*a] == coords[2*b] && coords[2*a+1] < coords[2*b+1]);
+  });
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+  if (candidates.size() < 3) return candidates;
+
+  std::vector<size_t> hull(2*candidates.size());
+  size_t k = 0;
+  for (size_t i = 0 ; i < candidates.size() ; i++)
+  {
+    while (k >= 2 && orient(coords, hull[k-2], hull[k-1], candidates[i]) <= 0) k--;
+    hull[k++] = candidates[i];
+  }
+  for (size_t i = candidates.size()-1, t = k+1 ; i > 0 ; i--)
+  {
+    while (k >= t && orient(coords, hull[k-2], hull[k-1], candidates[i-1]) <= 0) k--;
+    hull[k++] = candidates[i-1];
+  }
+  hull.resize(k-1);
+
+  return hull;
+}
+
+// Sorts the edges and pairs them. The two edges of a pair must have opposite directions and be
+// locally Delaunay. The edges without pair are returned in 'border'. Returns false if the edges do
+// not belong to a valid Delaunay mesh.
+static bool pair_edges(const std::vector<double>& coords, std::vector<SeamEdge>& edges, double sign, std::vector<SeamEdge>& border)
+{
+  std::sort(edges.begin(), edges.end());
+
+  for (size_t i = 0 ; i < edges.size() ; )
+  {
+    size_t j = i+1;
+    while (j < edges.size() && edges[j].lo() == edges[i].lo() && edges[j].hi() == edges[i].hi()) j++;
+
+    if (j - i == 1)
+    {
+      border.push_back(edges[i]);
+    }
+    else if (j - i == 2)
+    {
+      const SeamEdge& e1 = edges[i];
+      const SeamEdge& e2 = edges[i+1];
+      if (e1.u != e2.v) return false;
+      double inside = incircle(&coords[2*e1.u], &coords[2*e1.v], &coords[2*e1.w], &coords[2*e2.w]);
+      if (inside*sign > 0) return false;
+    }
+    else
+    {
+      return false;
+    }
+
+    i = j;
+  }
+
+  return true;
+}
+
+// The points are split in vertical strips with the same number of points and each strip is
+// triangulated independently with a margin on each side. A triangle whose circumcircle lies within
+// the strip and its margins has no point in its circumcircle at all. It is thus a triangle of the
+// global Delaunay triangulation and it is kept by the strip that contains its centroid. The other
+// triangles are mostly the slivers along the convex hull. Their region is triangulated sequentially
+// with the points that are not vertices of the kept triangles plus the vertices of the border of the
+// kept triangles. The final mesh is verified with exact predicates:
+// 1. Every edge is shared by two triangles with opposite orientations or lies on the convex hull and
+//    the area of the mesh is the area of the convex hull, i.e. the mesh is a triangulation.
+// 2. Every edge between triangles from different triangulations is locally Delaunay. A triangulation
+//    that is locally Delaunay everywhere is the Delaunay triangulation.
+// 3. Every point is a vertex of the mesh except points skipped by delaunator as duplicates.
+// Consequently when the verification succeeds the mesh is the one computed by a single delaunator up
+// to the order of the triangles and to the choice of a diagonal of cocircular points or of one point
+// among duplicated points. Returns false if the mesh is not valid.
+bool LASRtriangulate::parallel_delaunay(const std::vector<double>& coords, int nstrips, std::vector<size_t>& mesh) const
+{
+  size_t n = coords.size()/2;
+
+  // Bounds of the strips at the quantiles of X
+  std::vector<double> x(n);
+  for (size_t i = 0 ; i < n ; i++) x[i] = coords[2*i];
+  auto range = std::minmax_element(x.begin(), x.end());
+  double xmin = *range.first;
+  double xmax = *range.second;
+  double margin = 0.1*(xmax-xmin)/nstrips;
+
+  std::vector<double> bounds(nstrips+1);
+  bounds[0] = -std::numeric_limits<double>::infinity();
+  bounds[nstrips] = std::numeric_limits<double>::infinity();
+  size_t prev = 0;
+  for (int s = 1 ; s < nstrips ; s++)
+  {
+    size_t q = s*n/nstrips;
+    std::nth_element(x.begin() + prev, x.begin() + q, x.end());
+    bounds[s] = x[q];
+    prev = q;
+  }
+  std::vector<double>().swap(x);
+
+  std::vector<std::vector<size_t>> kept(nstrips);
+  std::vector<std::vector<SeamEdge>> seams(nstrips);
+  std::vector<std::vector<size_t>> skipped(nstrips);
+  std::vector<std::vector<size_t>> hulls(nstrips);
+  std::vector<double> areas(nstrips, 0);
+  std::vector<double> signs(nstrips, 0);
+  std::vector<char> valid(nstrips, 1);
+
+  #pragma omp parallel for num_threads(nstrips) schedule(static, 1)
+  for (int s = 0 ; s < nstrips ; s++)
+  {
+    double lo = bounds[s];
+    double hi = bounds[s+1];
+
+    std::vector<size_t> ids;
+    std::vector<double> local;
+    for (size_t i = 0 ; i < n ; i++)
+    {
+      double xi = coords[2*i];
+      if (xi >= lo - margin && xi < hi + margin)
+      {
+        ids.push_back(i);
+        local.push_back(xi);
+        local.push_back(coords[2*i+1]);
+      }
+    }
+
+    try
+    {
+      delaunator::Delaunator d(local);
+
+      const auto& tri = d.triangles;
+      const auto& half = d.halfedges;
+      size_t ntri = tri.size()/3;
+
+      std::vector<char> keep(ntri);
+      for (size_t t = 0 ; t < ntri ; t++)
+      {
+        double ax = local[2*tri[3*t]], ay = local[2*tri[3*t]+1];
+        double bx = local[2*tri[3*t+1]], by = local[2*tri[3*t+1]+1];
+        double cx = local[2*tri[3*t+2]], cy = local[2*tri[3*t+2]+1];
+
+        double centroid = (ax+bx+cx)/3;
+        if (centroid < lo || centroid >= hi) { keep[t] = 0; continue; }
+
+        // Circumcircle with a conservative tolerance
+        double dx = bx - ax, dy = by - ay;
+        double ex = cx - ax, ey = cy - ay;
+        double bl = dx*dx + dy*dy;
+        double cl = ex*ex + ey*ey;
+        double det = dx*ey - dy*ex;
+        double ox = (ey*bl - dy*cl)*0.5/det;
+        double oy = (dx*cl - ex*bl)*0.5/det;
+        double r = std::sqrt(ox*ox + oy*oy);
+        double tol = 1e-6*(r+1);
+        ox += ax;
+
+        keep[t] = det != 0 && ox - r - tol >= lo - margin && ox + r + tol < hi + margin;
+      }
+
+      std::vector<char> in_mesh(ids.size(), 0);
+      for (size_t e = 0 ; e < tri.size() ; e++) in_mesh[tri[e]] = 1;
+
+      // Duplicated points: delaunator inserts only one of them but not necessarily the same one in
+      // every strip. The one with the lowest index is used everywhere so the strips can be stitched.
+      std::unordered_map<size_t, size_t> twins;
+      std::unordered_map<uint64_t, std::vector<size_t>> cells;
+      auto cell = [](double x, double y) { return (uint64_t)std::llround(x*1e6)*73856093 ^ (uint64_t)std::llround(y*1e6)*19349663; };
+      for (size_t j = 0 ; j < ids.size() ; j++)
+      {
+        if (in_mesh[j]) continue;
+        for (int dx = -1 ; dx <= 1 ; dx++)
+          for (int dy = -1 ; dy <= 1 ; dy++)
+            cells[cell(local[2*j] + dx*1e-6, local[2*j+1] + dy*1e-6)].push_back(j);
+      }
+      if (!cells.empty())
+      {
+        for (size_t j = 0 ; j < ids.size() ; j++)
+        {
+          if (!in_mesh[j]) continue;
+          auto it = cells.find(cell(local[2*j], local[2*j+1]));
+          if (it == cells.end()) continue;
+          size_t rep = ids[j];
+          for (size_t k : it->second)
+          {
+            if (std::abs(local[2*k] - local[2*j]) <= 1e-9 && std::abs(local[2*k+1] - local[2*j+1]) <= 1e-9)
+              rep = std::min(rep, ids[k]);
+          }
+          if (rep != ids[j]) twins[j] = rep;
+        }
+      }
+      auto id = [&](size_t j) { auto it = twins.find(j); return (it == twins.end()) ? ids[j] : it->second; };
+
+      for (size_t t = 0 ; t < ntri ; t++)
+      {
+        if (!keep[t]) continue;
+
+        size_t a = tri[3*t], b = tri[3*t+1], c = tri[3*t+2];
+        double area = orient(local, a, b, c);
+        if (signs[s] == 0) signs[s] = (area > 0) ? 1 : -1;
+        if (area*signs[s] <= 0) { valid[s] = 0; break; }
+        areas[s] += std::abs(area)/2;
+
+        kept[s].push_back(id(a));
+        kept[s].push_back(id(b));
+        kept[s].push_back(id(c));
+
+        for (size_t k = 0 ; k < 3 ; k++)
+        {
+          size_t e = 3*t+k;
+          size_t twin = half[e];
+          if (twin != delaunator::INVALID_INDEX && keep[twin/3]) continue;
+          size_t u = tri[e];
+          size_t v = tri[3*t+(k+1)%3];
+          size_t w = tri[3*t+(k+2)%3];
+          seams[s].push_back({id(u), id(v), id(w)});
+        }
+      }
+
+      // Points of this strip that are not inserted because they are duplicates
+      for (size_t j = 0 ; j < ids.size() ; j++)
+      {
+        double xj = local[2*j];
+        if ((!in_mesh[j] || twins.count(j)) && xj >= lo && xj < hi) skipped[s].push_back(ids[j]);
+      }
+
+      // The vertices of the convex hull are on the hull of the strip that contains them
+      size_t h = d.hull_start;
+      do { hulls[s].push_back(ids[h]); h = d.hull_next[h]; } while (h != d.hull_start);
+    }
+    catch (const std::exception& e)
+    {
+      valid[s] = 0;
+    }
+  }
+
+  // The orientation of the triangles produced by delaunator. Every triangle must have the same.
+  double sign = 0;
+  for (int s = 0 ; s < nstrips ; s++)
+  {
+    if (!valid[s]) return false;
+    if (signs[s] == 0) continue;
+    if (sign == 0) sign = signs[s];
+    if (signs[s] != sign) return false;
+  }
+  if (sign == 0) return false;
+
+  // Stitch the strips. The edges without pair are the border of the region covered by the kept
+  // triangles.
+  std::vector<SeamEdge> edges;
+  for (auto& seam : seams) { edges.insert(edges.end(), seam.begin(), seam.end()); std::vector<SeamEdge>().swap(seam); }
+
+  std::vector<SeamEdge> border;
+  if (!pair_edges(coords, edges, sign, border)) return false;
+  std::vector<SeamEdge>().swap(edges);
+
+  std::vector<size_t> candidates;
+  for (const auto& hull : hulls) candidates.insert(candidates.end(), hull.begin(), hull.end());
+  std::vector<size_t> hull = convex_hull(coords, candidates);
+  if (hull.size() < 3) return false;
+
+  auto on_hull = [&](const SeamEdge& e)
+  {
+    double side = orient(coords, e.u, e.v, e.w);
+    for (size_t h : hull) { if (orient(coords, e.u, e.v, h)*side < 0) return false; }
+    return true;
+  };
+
+  // The points that are not in the region covered by the kept triangles (except the duplicates), plus the
+  // vertices of its border, are triangulated sequentially. The triangles out of the region complete the mesh.
+  std::vector<char> covered(n, 0);
+  for (const auto& tri : kept) for (size_t i : tri) covered[i] = 1;
+  for (const auto& skip : skipped) for (size_t i : skip) covered[i] = 1;
+
+  std::vector<char> remaining(n, 0);
+  size_t nremaining = 0;
+  for (size_t i = 0 ; i < n ; i++) { remaining[i] = !covered[i]; nremaining += !covered[i]; }
+
+  if ((double)border.size()*(double)hull.size() > 1e8) return false; // # nocov
+
+  std::vector<SeamEdge> inner;
+  for (const auto& e : border)
+  {
+    remaining[e.u] = 1;
+    remaining[e.v] = 1;
+    if (!on_hull(e)) inner.push_back(e);
+  }
+
+  std::vector<SeamEdge> filling;
+  std::vector<size_t> fill;
+  std::vector<size_t> duplicates;
+  double fill_area = 0;
+
+  if (nremaining > 0 || !inner.empty())
+  {
+    std::vector<size_t> ids;
+    std::vector<double> local;
+    for (size_t i = 0 ; i < n ; i++)
+    {
+      if (!remaining[i]) continue;
+      ids.push_back(i);
+      local.push_back(coords[2*i]);
+      local.push_back(coords[2*i+1]);
+    }
+
+    try
+    {
+      delaunator::Delaunator d(local);
+
+      const auto& tri = d.triangles;
+      const auto& half = d.halfedges;
+
+      // Directed edges of this triangulation and undirected edges of the border
+      std::vector<std::array<size_t,3>> directed(tri.size());
+      for (size_t e = 0 ; e < tri.size() ; e++) directed[e] = {ids[tri[e]], ids[tri[(e % 3 == 2) ? e-2 : e+1]], e};
+      std::sort(directed.begin(), directed.end());
+
+      std::vector<std::pair<size_t,size_t>> blocked;
+      for (const auto& e : border) blocked.push_back({e.lo(), e.hi()});
+      std::sort(blocked.begin(), blocked.end());
+
+      // Flood fill from the triangles on the other side of the inner border
+      std::vector<char> in_fill(tri.size()/3, 0);
+      std::vector<size_t> stack;
+      for (const auto& e : inner)
+      {
+        std::array<size_t,3> key = {e.v, e.u, 0};
+        auto it = std::lower_bound(directed.begin(), directed.end(), key);
+        if (it == directed.end() || (*it)[0] != e.v || (*it)[1] != e.u) return false;
+        size_t t = (*it)[2]/3;
+        if (!in_fill[t]) { in_fill[t] = 1; stack.push_back(t); }
+      }
+
+      while (!stack.empty())
+      {
+        size_t t = stack.back();
+        stack.pop_back();
+
+        for (size_t k = 0 ; k < 3 ; k++)
+        {
+          size_t e = 3*t+k;
+          size_t a = ids[tri[e]];
+          size_t b = ids[tri[3*t+(k+1)%3]];
+          if (std::binary_search(blocked.begin(), blocked.end(), std::make_pair(std::min(a,b), std::max(a,b)))) continue;
+          size_t twin = half[e];
+          if (twin == delaunator::INVALID_INDEX || in_fill[twin/3]) continue;
+          in_fill[twin/3] = 1;
+          stack.push_back(twin/3);
+        }
+      }
+
+      for (size_t t = 0 ; t < tri.size()/3 ; t++)
+      {
+        if (!in_fill[t]) continue;
+
+        size_t a = ids[tri[3*t]], b = ids[tri[3*t+1]], c = ids[tri[3*t+2]];
+        double area = orient(coords, a, b, c);
+        if (area*sign <= 0) return false;
+        fill_area += std::abs(area)/2;
+
+        fill.insert(fill.end(), {a, b, c});
+        filling.push_back({a, b, c});
+        filling.push_back({b, c, a});
+        filling.push_back({c, a, b});
+      }
+
+      // Points that delaunator did not insert because they are duplicates
+      std::vector<char> in_mesh(ids.size(), 0);
+      for (size_t e = 0 ; e < tri.size() ; e++) in_mesh[tri[e]] = 1;
+      for (size_t j = 0 ; j < ids.size() ; j++) { if (!in_mesh[j]) duplicates.push_back(ids[j]); }
+    }
+    catch (const std::exception& e)
+    {
+      return false;
+    }
+  }
+
+  // Verification of the stitching: every edge must be paired or on the convex hull
+  filling.insert(filling.end(), border.begin(), border.end());
+  std::vector<SeamEdge> unpaired;
+  if (!pair_edges(coords, filling, sign, unpaired)) return false;
+  for (const auto& e : unpaired) { if (!on_hull(e)) return false; }
+
+  double hull_area = 0;
+  for (size_t i = 0 ; i < hull.size() ; i++)
+  {
+    size_t a = hull[i];
+    size_t b = hull[(i+1)%hull.size()];
+    hull_area += coords[2*a]*coords[2*b+1] - coords[2*b]*coords[2*a+1];
+  }
+  hull_area = std::abs(hull_area)/2;
+
+  double mesh_area = fill_area;
+  for (double area : areas) mesh_area += area;
+  if (std::abs(mesh_area - hull_area) > 1e-6*hull_area) return false;
+
+  // Every point must be in the mesh
+  for (size_t i : fill) covered[i] = 1;
+  for (size_t i : duplicates) covered[i] = 1;
+  for (size_t i = 0 ; i < n ; i++) { if (!covered[i]) return false; }
+
+  size_t total = fill.size();
+  for (const auto& tri : kept) total += tri.size();
+  mesh.clear();
+  mesh.reserve(total);
+  for (auto& tri : kept) { mesh.insert(mesh.end(), tri.begin(), tri.end()); std::vector<size_t>().swap(tri); }
+  mesh.insert(mesh.end(), fill.begin(), fill.end());
+
+  return true;
+}
+
 bool LASRtriangulate::interpolate(std::vector<double>& res, const Raster* raster)
 {
   AttributeAccessor accessor(use_attribute);
 
-  int n = (raster == nullptr) ? las->npoints : raster->get_ncells();
+  size_t n = (raster == nullptr) ? las->npoints : raster->get_ncells();
   res.resize(n);
   std::fill(res.begin(), res.end(), NA_F64);
 
-  if (d == nullptr) return true;
+  if (triangles.empty()) return true;
   if (res.size() == 0) return true; // Fix #40
 
   progress->reset();
-  progress->set_total(d->triangles.size()/3);
+  progress->set_total(triangles.size()/3);
   progress->set_prefix("Interpolation");
   progress->set_ncpu(ncpu);
   progress->show();
@@ -104,23 +568,23 @@ bool LASRtriangulate::interpolate(std::vector<double>& res, const Raster* raster
 
   // 1. loop through the triangles, search the points inside triangle, interpolate
   #pragma omp parallel for num_threads(ncpu)
-  for (unsigned int i = 0 ; i < d->triangles.size() ; i+=3)
+  for (size_t i = 0 ; i < triangles.size() ; i+=3)
   {
     if (progress->interrupted()) continue;
 
-    int id;
+    size_t id;
     Point A,B,C;
     A.set_schema(&las->header->schema);
     B.set_schema(&las->header->schema);
     C.set_schema(&las->header->schema);
 
-    id = index_map[d->triangles[i]];
+    id = index_map[triangles[i]];
     las->get_point(id, &A);
 
-    id = index_map[d->triangles[i+1]];
+    id = index_map[triangles[i+1]];
     las->get_point(id, &B);
 
-    id = index_map[d->triangles[i+2]];
+    id = index_map[triangles[i+2]];
     las->get_point(id, &C);
 
     PointXYZ a(A.get_x(), A.get_y(), accessor(&A));
@@ -189,15 +653,15 @@ bool LASRtriangulate::interpolate(std::vector<double>& res, const Raster* raster
 
 bool LASRtriangulate::contour(std::vector<Edge>& e) const
 {
-  // d is nullptr if the triangulation was not computed because we do not have enough points.
+  // triangles is empty if the triangulation was not computed because we do not have enough points.
   // In this case 'contour' should not fail
-  if (d == nullptr) return true; // # nocov
+  if (triangles.empty()) return true; // # nocov
 
   std::unordered_set<Edge> edges;
 
   progress->reset();
   progress->set_prefix("Delaunay contours");
-  progress->set_total(d->triangles.size()/3);
+  progress->set_total(triangles.size()/3);
   progress->set_ncpu(ncpu);
   progress->show();
 
@@ -206,23 +670,23 @@ bool LASRtriangulate::contour(std::vector<Edge>& e) const
   bool main_thread = omp_get_thread_num() == 0;
 
   #pragma omp parallel for num_threads(ncpu)
-  for (unsigned int i = 0 ; i < d->triangles.size() ; i+=3)
+  for (size_t i = 0 ; i < triangles.size() ; i+=3)
   {
     if (progress->interrupted()) continue;
 
-    int id;
+    size_t id;
     Point a, b, c;
     a.set_schema(&las->header->schema);
     b.set_schema(&las->header->schema);
     c.set_schema(&las->header->schema);
 
-    id = index_map[d->triangles[i]];
+    id = index_map[triangles[i]];
     las->get_point(id, &a);
 
-    id = index_map[d->triangles[i+1]];
+    id = index_map[triangles[i+1]];
     las->get_point(id, &b);
 
-    id = index_map[d->triangles[i+2]];
+    id = index_map[triangles[i+2]];
     las->get_point(id, &c);
 
     TriangleXYZ triangle(a, b, c);
@@ -266,29 +730,29 @@ bool LASRtriangulate::write()
 
   AttributeAccessor accessor(use_attribute);
 
-  progress->set_total(d->triangles.size()/3);
+  progress->set_total(triangles.size()/3);
   progress->set_prefix("Write triangulation");
   progress->show();
 
   auto start_time = std::chrono::high_resolution_clock::now();
 
-  std::vector<TriangleXYZ> triangles;
+  std::vector<TriangleXYZ> polygons;
 
-  for (unsigned int i = 0 ; i < d->triangles.size(); i+=3)
+  for (size_t i = 0 ; i < triangles.size(); i+=3)
   {
-    int id;
+    size_t id;
     Point A,B,C;
     A.set_schema(&las->header->schema);
     B.set_schema(&las->header->schema);
     C.set_schema(&las->header->schema);
 
-    id = index_map[d->triangles[i]];
+    id = index_map[triangles[i]];
     las->get_point(id, &A);
 
-    id = index_map[d->triangles[i+1]];
+    id = index_map[triangles[i+1]];
     las->get_point(id, &B);
 
-    id = index_map[d->triangles[i+2]];
+    id = index_map[triangles[i+2]];
     las->get_point(id, &C);
 
     TriangleXYZ triangle(A, B, C);
@@ -297,7 +761,7 @@ bool LASRtriangulate::write()
     if (trim == 0 || keep_triangle)
     {
       triangle.make_clock_wise();
-      triangles.push_back(triangle);
+      polygons.push_back(triangle);
     }
 
     (*progress)++;
@@ -309,7 +773,7 @@ bool LASRtriangulate::write()
 
   #pragma omp critical (write_triangulation)
   {
-    vector.write(triangles);
+    vector.write(polygons);
   }
 
   if (verbose)
@@ -329,7 +793,7 @@ void LASRtriangulate::clear(bool last)
 {
   coords.clear();
   index_map.clear();
-  delete d;
-  d = nullptr;
+  triangles.clear();
+  triangles.shrink_to_fit();
   npoints = 0;
 }
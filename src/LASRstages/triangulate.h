@@ -9,11 +9,6 @@
 
 class Raster;
 
-namespace delaunator
-{
-  class Delaunator;
-}
-
 class LASRtriangulate : public StageVector
 {
 public:
@@ -22,6 +17,7 @@ public:
   bool interpolate(std::vector<double>& res, const Raster* raster = nullptr);
   bool contour(std::vector<Edge>& edges) const;
   double need_buffer() const override { return 20.0; }
+  bool need_attributes(std::vector<std::string>& attributes) const override;
   void clear(bool last) override;
   bool write() override;
   bool set_parameters(const nlohmann::json&) override;
@@ -31,14 +27,20 @@ public:
   bool is_parallelizable() const override { return true; };
   LASRtriangulate* clone() const override { return new LASRtriangulate(*this); };
 
+private:
+  bool parallel_delaunay(const std::vector<double>& coords, int nstrips, std::vector<size_t>& mesh) const;
+
+  // Below this number of points per thread the triangulation is not split in strips
+  static constexpr size_t min_points_per_strip = 100000;
+
 private:
   bool keep_large;
   double trim;
-  unsigned int npoints;
+  size_t npoints;
   std::vector<double> coords;
-  std::vector<int> index_map;
+  std::vector<uint64_t> index_map;
   std::string use_attribute;
-  delaunator::Delaunator* d;
+  std::vector<size_t> triangles; // Triplets of indexes in index_map
   PointCloud* las;
 };
 
@@ -79,19 +79,7 @@ bool LASRlaswriter::process(Point*& p)
   if (p->get_deleted()) return true;
 
   // No writer initialized? Create a writer.
-  if (!lasio->is_opened())
-  {
-    try
-    {
-      lasio->create(ofile);
-      written.push_back(ofile);
-    }
-    catch (const std::exception& e)
-    {
-      last_error = e.what();
-      return false;
-    }
-  }
+  if (!open_writer()) return false;
 
   //  If the point in not in the buffer we can write it
   if (keep_buffer || !p->inside_buffer(xmin, ymin, xmax, ymax, circular))
@@ -127,6 +115,42 @@ bool LASRlaswriter::process(Point*& p)
   return true;
 }
 
+bool LASRlaswriter::process(PointBlock& block)
+{
+  pointfilter.filter(block, pointmask);
+
+  Point p;
+  for (size_t i = 0 ; i < block.size() ; i++)
+  {
+    block.seek(i, p);
+    if (p.get_deleted()) continue;
+    if (!open_writer()) return false;
+    if (!keep_buffer && p.inside_buffer(xmin, ymin, xmax, ymax, circular)) continue;
+    if (!pointmask.get(i)) continue;
+    lasio->write_point(&p);
+  }
+
+  return true;
+}
+
+bool LASRlaswriter::open_writer()
+{
+  if (lasio->is_opened()) return true;
+
+  try
+  {
+    lasio->create(ofile);
+    written.push_back(ofile);
+  }
+  catch (const std::exception& e)
+  {
+    last_error = e.what();
+    return false;
+  }
+
+  return true;
+}
+
 bool LASRlaswriter::process(PointCloud*& las)
 {
   progress->reset();
@@ -15,6 +15,7 @@ public:
   bool set_input_file_name(const std::string& file) override;
   bool set_output_file(const std::string& file) override;
   bool process(Point*& p) override;
+  bool process(PointBlock& block) override;
   bool process(PointCloud*& las) override;
   bool is_streamable() const override { return true; };
   void clear(bool last) override;
@@ -26,6 +27,7 @@ public:
   LASRlaswriter* clone() const override { return new LASRlaswriter(*this); };
 
 private:
+  bool open_writer();
   void clean_copc_ext(std::string& path);
 
   bool keep_buffer;
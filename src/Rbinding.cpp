@@ -178,11 +178,15 @@ std::string generate_json(SEXP ptr, std::vector<std::string> on, Rcpp::List with
   double buffer = 0.0;
   double chunk = 0.0;
   bool verbose = false;
+  bool columnar = false;
   bool progress = true;
   std::string strategy = "concurrent-points";
   std::string profile_file = "";
   std::string progress_file = "";
   std::string log_file = "";
+  std::string header_cache = "";
+  double max_memory = 0.0;
+  double buffer_cache = 512.0;
   std::vector<int> ncores = {1, 0};
   std::vector<bool> noprocess;
 
@@ -197,11 +201,15 @@ std::string generate_json(SEXP ptr, std::vector<std::string> on, Rcpp::List with
   update_if_present(buffer, "buffer");
   update_if_present(chunk, "chunk");
   update_if_present(verbose, "verbose");
+  update_if_present(columnar, "columnar");
   update_if_present(progress, "progress");
   update_if_present(strategy, "strategy");
   update_if_present(profile_file, "profile_file");
   update_if_present(progress_file, "progress_file");
   update_if_present(log_file, "log_file");
+  update_if_present(header_cache, "header_cache");
+  update_if_present(max_memory, "max_memory");
+  update_if_present(buffer_cache, "buffer_cache");
   update_if_present(ncores, "ncores");
   update_if_present(noprocess, "noprocess");
 
@@ -212,6 +220,7 @@ std::string generate_json(SEXP ptr, std::vector<std::string> on, Rcpp::List with
   // Set parameters
   p.set_files(on);
   p.set_verbose(verbose);
+  p.set_columnar(columnar);
   p.set_buffer(buffer);
   p.set_progress(progress);
   p.set_chunk(chunk);
@@ -220,6 +229,9 @@ std::string generate_json(SEXP ptr, std::vector<std::string> on, Rcpp::List with
   p.set_log_file(log_file);
   p.set_progress_file(progress_file);
   p.set_profile_file(profile_file);
+  p.set_header_cache(header_cache);
+  p.set_max_memory(max_memory);
+  p.set_buffer_cache(buffer_cache);
 
   if (strategy == "sequential")
     p.set_sequential_strategy();
@@ -229,6 +241,8 @@ std::string generate_json(SEXP ptr, std::vector<std::string> on, Rcpp::List with
     p.set_concurrent_files_strategy(ncores[0]);
   else if(strategy == "nested")
     p.set_nested_strategy(ncores[0], ncores[1]);
+  else if (strategy == "auto")
+    p.set_auto_strategy(ncores[0]);
   else
     throw std::invalid_argument("Invalid strategy");
 